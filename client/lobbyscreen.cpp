@@ -16,6 +16,8 @@ LobbyScreen::LobbyScreen(NetworkManager *network, QWidget *parent)
             this, &LobbyScreen::onRoomListReceived);
     connect(networkManager, &NetworkManager::roomCreated, 
             this, &LobbyScreen::onRoomCreated);
+    connect(networkManager, &NetworkManager::leaderboardReceived, 
+            this, &LobbyScreen::onLeaderboardReceived);
     // Note: errorReceived is handled by LoginScreen only to avoid duplicate message boxes
 }
 
@@ -81,6 +83,25 @@ void LobbyScreen::setupUI()
     listLayout->addLayout(buttonLayout);
     
     mainLayout->addWidget(roomListGroup);
+    mainLayout->addSpacing(20);
+    
+    // Leaderboard group
+    QGroupBox *leaderboardGroup = new QGroupBox("Leaderboard", this);
+    leaderboardGroup->setStyleSheet("QGroupBox { font-size: 12pt; font-weight: bold; }");
+    QVBoxLayout *leaderboardLayout = new QVBoxLayout(leaderboardGroup);
+    
+    leaderboardTable = new QTableWidget(0, 3, this);
+    leaderboardTable->setHorizontalHeaderLabels({"Rank", "Player", "Score"});
+    leaderboardTable->horizontalHeader()->setStretchLastSection(true);
+    leaderboardTable->verticalHeader()->setVisible(false);
+    leaderboardTable->setSelectionMode(QAbstractItemView::NoSelection);
+    leaderboardTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    leaderboardLayout->addWidget(leaderboardTable);
+    
+    myRankLabel = new QLabel(this);
+    leaderboardLayout->addWidget(myRankLabel);
+    
+    mainLayout->addWidget(leaderboardGroup);
     
     // Connect signals
     connect(refreshButton, &QPushButton::clicked, this, &LobbyScreen::onRefreshClicked);
@@ -94,11 +115,13 @@ void LobbyScreen::refresh()
 {
     welcomeLabel->setText("Welcome, " + networkManager->getCurrentUsername() + "!");
     networkManager->sendListRooms();
+    networkManager->sendLeaderboard();
 }
 
 void LobbyScreen::onRefreshClicked()
 {
     networkManager->sendListRooms();
+    networkManager->sendLeaderboard();
 }
 
 void LobbyScreen::onCreateRoomClicked()
@@ -140,6 +163,26 @@ void LobbyScreen::onRoomListReceived(const QVector<RoomInfo> &rooms)
     updateRoomList(rooms);
 }
 
+void LobbyScreen::onLeaderboardReceived(const QVector<LeaderboardEntry> &entries, int totalPlayers, int myRank, int myScore)
+{
+    leaderboardTable->setRowCount(0);
+    
+    for (const LeaderboardEntry &entry : entries) {
+        int row = leaderboardTable->rowCount();
+        leaderboardTable->insertRow(row);
+        
+        leaderboardTable->setItem(row, 0, new QTableWidgetItem(QString::number(entry.rank)));
+        leaderboardTable->setItem(row, 1, new QTableWidgetItem(entry.username));
+        leaderboardTable->setItem(row, 2, new QTableWidgetItem(QString::number(entry.score)));
+    }
+    
+    if (myRank > 0) {
+        myRankLabel->setText(QString("Your rank: #%1 of %2 (%3 points)").arg(myRank).arg(totalPlayers).arg(myScore));
+    } else {
+        myRankLabel->setText("Your rank: unranked (play a game to join)");
+    }
+}
+
 void LobbyScreen::onRoomCreated(int /* roomId */, const QString & /* roomName */)
 {
     // Room created, will automatically transition to room screen
@@ -23,6 +23,7 @@ private slots:
     void onJoinRoomClicked();
     void onRoomDoubleClicked(int row, int column);
     void onRoomListReceived(const QVector<RoomInfo> &rooms);
+    void onLeaderboardReceived(const QVector<LeaderboardEntry> &entries, int totalPlayers, int myRank, int myScore);
     void onRoomCreated(int roomId, const QString &roomName);
     void onError(const QString &error);
 
@@ -35,6 +36,8 @@ private:
     QPushButton *createButton;
     QPushButton *joinButton;
     QLineEdit *roomNameEdit;
+    QTableWidget *leaderboardTable;
+    QLabel *myRankLabel;
     
     void setupUI();
     void updateRoomList(const QVector<RoomInfo> &rooms);
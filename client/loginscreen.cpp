@@ -18,6 +18,7 @@ LoginScreen::LoginScreen(NetworkManager *network, QWidget *parent)
     connect(networkManager, &NetworkManager::loginSuccessful, this, &LoginScreen::onLoginSuccessful);
     connect(networkManager, &NetworkManager::reconnectSuccessful, this, &LoginScreen::onReconnectSuccessful);
     connect(networkManager, &NetworkManager::registerSuccessful, this, &LoginScreen::onRegisterSuccessful);
+    connect(networkManager, &NetworkManager::nameAvailabilityReceived, this, &LoginScreen::onNameAvailabilityReceived);
     connect(networkManager, &NetworkManager::connectionError, this, &LoginScreen::onError);
     connect(networkManager, &NetworkManager::errorReceived, this, &LoginScreen::onError);
     
@@ -82,11 +83,13 @@ void LoginScreen::setupUI()
     usernameEdit = new QLineEdit(this);
     passwordEdit = new QLineEdit(this);
     passwordEdit->setEchoMode(QLineEdit::Password);
+    nameStatusLabel = new QLabel(this);
     
     loginButton = new QPushButton("Login", this);
     registerButton = new QPushButton("Register", this);
     
     authLayout->addRow("Username:", usernameEdit);
+    authLayout->addRow("", nameStatusLabel);
     authLayout->addRow("Password:", passwordEdit);
     
     QHBoxLayout *buttonLayout = new QHBoxLayout();
@@ -104,6 +107,10 @@ void LoginScreen::setupUI()
     connect(loginButton, &QPushButton::clicked, this, &LoginScreen::onLoginClicked);
     connect(registerButton, &QPushButton::clicked, this, &LoginScreen::onRegisterClicked);
     
+    // Check name availability when the username field loses focus
+    connect(usernameEdit, &QLineEdit::editingFinished, this, &LoginScreen::onUsernameEditingFinished);
+    connect(usernameEdit, &QLineEdit::textEdited, nameStatusLabel, &QLabel::clear);
+    
     // Enable return key
     connect(passwordEdit, &QLineEdit::returnPressed, this, &LoginScreen::onLoginClicked);
 }
@@ -171,6 +178,32 @@ void LoginScreen::onRegisterClicked()
     networkManager->sendRegister(username, password);
 }
 
+void LoginScreen::onUsernameEditingFinished()
+{
+    QString username = usernameEdit->text().trimmed();
+    
+    if (username.isEmpty() || !networkManager->isConnected()) {
+        nameStatusLabel->clear();
+        return;
+    }
+    
+    networkManager->sendCheckName(username);
+}
+
+void LoginScreen::onNameAvailabilityReceived(const QString &username, bool available)
+{
+    // Ignore stale answers for a name the user has since changed
+    if (username != usernameEdit->text().trimmed()) {
+        return;
+    }
+    
+    if (available) {
+        nameStatusLabel->setText("<font color='green'>Username available</font>");
+    } else {
+        nameStatusLabel->setText("<font color='gray'>Username registered</font>");
+    }
+}
+
 void LoginScreen::onConnected()
 {
     updateUIState();
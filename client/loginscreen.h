@@ -25,6 +25,8 @@ private slots:
     void onLoginSuccessful(const QString &username);
     void onReconnectSuccessful(const QString &username);
     void onRegisterSuccessful();
+    void onUsernameEditingFinished();
+    void onNameAvailabilityReceived(const QString &username, bool available);
     void onError(const QString &error);
 
 private:
@@ -42,6 +44,7 @@ private:
     // Authentication UI
     QLineEdit *usernameEdit;
     QLineEdit *passwordEdit;
+    QLabel *nameStatusLabel;
     QPushButton *loginButton;
     QPushButton *registerButton;
     
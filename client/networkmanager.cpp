@@ -95,6 +95,11 @@ void NetworkManager::sendLogin(const QString &username, const QString &password)
     sendCommand(QString("LOGIN|%1|%2").arg(username, password));
 }
 
+void NetworkManager::sendCheckName(const QString &username)
+{
+    sendCommand(QString("CHECK_NAME|%1").arg(username));
+}
+
 void NetworkManager::sendListRooms()
 {
     sendCommand("LIST_ROOMS");
@@ -145,6 +150,11 @@ void NetworkManager::sendReadyNextRound()
     sendCommand("READY_NEXT_ROUND");
 }
 
+void NetworkManager::sendLeaderboard(int count)
+{
+    sendCommand(QString("LEADERBOARD|%1").arg(count));
+}
+
 void NetworkManager::onConnected()
 {
     qDebug() << "Connected to server";
@@ -266,9 +276,18 @@ void NetworkManager::handleMessage(const QString &message)
     else if (command == "REGISTER_OK") {
         emit registerSuccessful();
     }
+    else if (command == "NAME_AVAILABLE" || command == "NAME_TAKEN") {
+        // Format: NAME_AVAILABLE|username or NAME_TAKEN|username
+        if (parts.size() > 1) {
+            emit nameAvailabilityReceived(parts[1], command == "NAME_AVAILABLE");
+        }
+    }
     else if (command == "ROOM_LIST") {
         parseRoomList(parts);
     }
+    else if (command == "LEADERBOARD") {
+        parseLeaderboard(parts);
+    }
     else if (command == "ROOM_CREATED") {
         if (parts.size() >= 3) {
             int roomId = parts[1].toInt();
@@ -397,6 +416,29 @@ void NetworkManager::parseRoomList(const QStringList &parts)
     emit roomListReceived(rooms);
 }
 
+void NetworkManager::parseLeaderboard(const QStringList &parts)
+{
+    QVector<LeaderboardEntry> entries;
+    
+    // Format: LEADERBOARD|total|my_rank|my_score|name:score|name:score|...
+    if (parts.size() < 4) {
+        return;
+    }
+    
+    for (int i = 4; i < parts.size(); i++) {
+        QStringList entryParts = parts[i].split(':');
+        if (entryParts.size() >= 2) {
+            LeaderboardEntry entry;
+            entry.rank = entries.size() + 1;
+            entry.username = entryParts[0];
+            entry.score = entryParts[1].toInt();
+            entries.append(entry);
+        }
+    }
+    
+    emit leaderboardReceived(entries, parts[1].toInt(), parts[2].toInt(), parts[3].toInt());
+}
+
 void NetworkManager::parseRoomStatus(const QStringList &parts)
 {
     players.clear();
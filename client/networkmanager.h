@@ -22,6 +22,12 @@ struct PlayerInfo {
     int ping;  // Ping in milliseconds
 };
 
+struct LeaderboardEntry {
+    int rank;
+    QString username;
+    int score;
+};
+
 struct GameData {
     QString equation;
     QVector<QVector<int>> matrices[4];  // 4 matrices, each 4x4
@@ -46,6 +52,7 @@ public:
     // Protocol commands
     void sendRegister(const QString &username, const QString &password);
     void sendLogin(const QString &username, const QString &password);
+    void sendCheckName(const QString &username);
     void sendListRooms();
     void sendCreateRoom(const QString &roomName);
     void sendJoinRoom(int roomId);
@@ -56,6 +63,7 @@ public:
     void sendSubmit(int row, int col);
     void sendPong();
     void sendReadyNextRound();  // Send ready for next round
+    void sendLeaderboard(int count = 10);
     
     // Getters for current state
     QString getCurrentUsername() const { return currentUsername; }
@@ -81,9 +89,11 @@ signals:
     void reconnectSuccessful(const QString &username);  // For reconnect after disconnect
     void registerSuccessful();
     void authError(const QString &error);
+    void nameAvailabilityReceived(const QString &username, bool available);
     
     // Lobby signals
     void roomListReceived(const QVector<RoomInfo> &rooms);
+    void leaderboardReceived(const QVector<LeaderboardEntry> &entries, int totalPlayers, int myRank, int myScore);
     
     // Room signals
     void roomCreated(int roomId, const QString &roomName);
@@ -142,6 +152,7 @@ private:
     void handleMessage(const QString &message);
     void parseGameStart(const QStringList &parts);
     void parseRoomList(const QStringList &parts);
+    void parseLeaderboard(const QStringList &parts);
     void parseRoomStatus(const QStringList &parts);
     
     // Utility
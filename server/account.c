@@ -0,0 +1,221 @@
+#include "server.h"
+#include <pthread.h>
+#include <fcntl.h>
+
+// Active storage backend
+static const AccountBackend *backend = NULL;
+
+// I/O thread and request queues (ring buffers guarded by queue_lock)
+static pthread_t io_thread;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static AccountRequest pending[ACCOUNT_QUEUE_SIZE];
+static int pending_head = 0;
+static int pending_count = 0;
+static AccountRequest completed[ACCOUNT_QUEUE_SIZE];
+static int completed_head = 0;
+static int completed_count = 0;
+static int in_flight = 0;  // Submitted but not yet dispatched
+static int running = 0;
+
+// Self-pipe: I/O thread writes a byte per completion, event loop selects on read end
+static int wake_pipe[2] = {-1, -1};
+
+// Run one request against the backend (I/O thread)
+static void account_execute(AccountRequest *req) {
+    switch (req->op) {
+        case ACCOUNT_OP_LOOKUP:
+            req->status = backend->lookup(req->username, req->password);
+            break;
+        case ACCOUNT_OP_CREATE:
+            req->status = backend->create(req->username, req->password, req->known_absent);
+            break;
+        case ACCOUNT_OP_EXISTS:
+            req->status = backend->exists(req->username);
+            break;
+        case ACCOUNT_OP_UPDATE_STATS:
+            req->status = backend->update_stats(req->stats, req->stats_count);
+            break;
+        default:
+            req->status = ACCOUNT_IO_ERROR;
+    }
+}
+
+// I/O thread main loop
+static void *account_io_main(void *arg) {
+    (void)arg;
+    
+    pthread_mutex_lock(&queue_lock);
+    while (1) {
+        while (pending_count == 0 && running) {
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        }
+        
+        // Drain remaining requests before exiting on shutdown
+        if (pending_count == 0) break;
+        
+        AccountRequest req = pending[pending_head];
+        pending_head = (pending_head + 1) % ACCOUNT_QUEUE_SIZE;
+        pending_count--;
+        pthread_mutex_unlock(&queue_lock);
+        
+        account_execute(&req);
+        
+        pthread_mutex_lock(&queue_lock);
+        completed[(completed_head + completed_count) % ACCOUNT_QUEUE_SIZE] = req;
+        completed_count++;
+        
+        // Wake event loop (pipe full just means a wakeup is already pending)
+        if (write(wake_pipe[1], "x", 1) < 0 && errno != EAGAIN) {
+            perror("write");
+        }
+    }
+    pthread_mutex_unlock(&queue_lock);
+    
+    return NULL;
+}
+
+// Select backend, open storage and start I/O thread
+int account_init(void) {
+    const char *name = getenv("ACCOUNT_BACKEND");
+    if (!name || !name[0]) {
+        name = ACCOUNT_BACKEND_DEFAULT;
+    }
+    
+    if (strcmp(name, "kv") == 0) {
+        backend = &account_kv_backend;
+    } else if (strcmp(name, "file") == 0) {
+        backend = &account_file_backend;
+    } else {
+        log_write(LOG_WARN, LOG_STORAGE, "Unknown account backend '%s', using file", name);
+        backend = &account_file_backend;
+    }
+    
+    if (!backend->open()) {
+        log_write(LOG_ERROR, LOG_STORAGE, "Failed to open account backend '%s'", backend->name);
+        return 0;
+    }
+    
+    if (pipe(wake_pipe) < 0) {
+        perror("pipe");
+        return 0;
+    }
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+    
+    running = 1;
+    if (pthread_create(&io_thread, NULL, account_io_main, NULL) != 0) {
+        perror("pthread_create");
+        running = 0;
+        return 0;
+    }
+    
+    log_write(LOG_INFO, LOG_STORAGE, "Account backend: %s", backend->name);
+    return 1;
+}
+
+// Stop I/O thread after it drains queued requests, deliver what it finished
+// (freeing stats batches, re-marking failed ones), write the remaining player
+// stats directly, then close storage
+void account_shutdown(Server *server) {
+    if (!running) return;
+    
+    pthread_mutex_lock(&queue_lock);
+    running = 0;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    
+    pthread_join(io_thread, NULL);
+    account_dispatch_completions(server);
+    stats_save();
+    backend->close();
+    
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    wake_pipe[0] = wake_pipe[1] = -1;
+}
+
+// Get active backend
+const AccountBackend *account_backend(void) {
+    return backend;
+}
+
+// Get fd the event loop should select on for completions
+int account_completion_fd(void) {
+    return wake_pipe[0];
+}
+
+// Queue request for the I/O thread
+// Returns 0 if the queue is full
+int account_submit(const AccountRequest *req) {
+    pthread_mutex_lock(&queue_lock);
+    
+    if (!running || in_flight >= ACCOUNT_QUEUE_SIZE) {
+        pthread_mutex_unlock(&queue_lock);
+        return 0;
+    }
+    
+    pending[(pending_head + pending_count) % ACCOUNT_QUEUE_SIZE] = *req;
+    pending_count++;
+    in_flight++;
+    pthread_cond_signal(&queue_cond);
+    
+    pthread_mutex_unlock(&queue_lock);
+    return 1;
+}
+
+// Deliver finished requests to their handlers (event loop thread)
+void account_dispatch_completions(Server *server) {
+    char drain[64];
+    while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {
+        // Just clearing wakeups
+    }
+    
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        if (completed_count == 0) {
+            pthread_mutex_unlock(&queue_lock);
+            break;
+        }
+        AccountRequest req = completed[completed_head];
+        completed_head = (completed_head + 1) % ACCOUNT_QUEUE_SIZE;
+        completed_count--;
+        in_flight--;
+        pthread_mutex_unlock(&queue_lock);
+        
+        if (req.op == ACCOUNT_OP_UPDATE_STATS) {
+            if (req.status != ACCOUNT_OK) {
+                log_write(LOG_ERROR, LOG_STORAGE, "Failed to persist %d player stats records, retrying next flush",
+                          req.stats_count);
+                stats_write_failed(req.stats, req.stats_count);
+            }
+            free(req.stats);
+        } else {
+            auth_complete(server, &req);
+        }
+    }
+}
+
+// Serialize stats (without username) as space-separated fields
+int account_format_stats(const PlayerStats *stats, char *buffer, int size) {
+    return snprintf(buffer, size, "%d %d %d %d %lld %d",
+                    stats->games_played, stats->games_won,
+                    stats->rounds_played, stats->rounds_won,
+                    stats->total_solve_ms, stats->score);
+}
+
+// Parse stats written by account_format_stats (missing fields stay 0)
+int account_parse_stats(const char *text, PlayerStats *stats) {
+    stats->games_played = 0;
+    stats->games_won = 0;
+    stats->rounds_played = 0;
+    stats->rounds_won = 0;
+    stats->total_solve_ms = 0;
+    stats->score = 0;
+    
+    int fields = sscanf(text, "%d %d %d %d %lld %d",
+                        &stats->games_played, &stats->games_won,
+                        &stats->rounds_played, &stats->rounds_won,
+                        &stats->total_solve_ms, &stats->score);
+    return fields > 0;
+}
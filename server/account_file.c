@@ -0,0 +1,194 @@
+#include "server.h"
+
+#define USERS_FILE "users.txt"
+#define STATS_FILE "stats.txt"
+#define STATS_TEMP_FILE "stats.txt.tmp"
+
+// Flat file backend: users.txt holds "username:password" lines,
+// stats.txt holds "username:games_played games_won rounds_played rounds_won total_solve_ms score" lines
+
+static int file_open(void) {
+    return 1;  // Files are opened per operation
+}
+
+static void file_close(void) {
+}
+
+// Call fn for every registered username
+static void file_for_each_user(void (*fn)(const char *username, void *ctx), void *ctx) {
+    FILE *file = fopen(USERS_FILE, "r");
+    if (!file) return;
+    
+    char line[256];
+    char stored_user[MAX_USERNAME];
+    
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%31[^:]:", stored_user) == 1) {
+            fn(stored_user, ctx);
+        }
+    }
+    fclose(file);
+}
+
+// Call fn for every stored stats record
+static void file_for_each_stats(void (*fn)(const PlayerStats *stats, void *ctx), void *ctx) {
+    FILE *file = fopen(STATS_FILE, "r");
+    if (!file) return;
+    
+    char line[256];
+    PlayerStats stats;
+    
+    while (fgets(line, sizeof(line), file)) {
+        char *sep = strchr(line, ':');
+        if (!sep) continue;
+        *sep = '\0';
+        
+        // Names longer than a username can't be a registered account
+        size_t length = strlen(line);
+        if (length >= sizeof(stats.username)) continue;
+        
+        memset(&stats, 0, sizeof(stats));
+        memcpy(stats.username, line, length + 1);
+        if (account_parse_stats(sep + 1, &stats)) {
+            fn(&stats, ctx);
+        }
+    }
+    fclose(file);
+}
+
+// Verify username/password
+static AccountStatus file_lookup(const char *username, const char *password) {
+    FILE *file = fopen(USERS_FILE, "r");
+    if (!file) {
+        return ACCOUNT_NOT_FOUND;
+    }
+    
+    char line[256];
+    char stored_user[MAX_USERNAME];
+    char stored_pass[MAX_PASSWORD];
+    
+    while (fgets(line, sizeof(line), file)) {
+        sscanf(line, "%31[^:]:%63s", stored_user, stored_pass);
+        
+        if (strcmp(stored_user, username) == 0 && strcmp(stored_pass, password) == 0) {
+            fclose(file);
+            return ACCOUNT_OK;
+        }
+    }
+    
+    fclose(file);
+    return ACCOUNT_NOT_FOUND;
+}
+
+// Check users file for username
+static AccountStatus file_exists(const char *username) {
+    FILE *file = fopen(USERS_FILE, "r");
+    if (!file) {
+        return ACCOUNT_NOT_FOUND;
+    }
+    
+    char line[256];
+    char stored_user[MAX_USERNAME];
+    
+    while (fgets(line, sizeof(line), file)) {
+        sscanf(line, "%31[^:]:", stored_user);
+        if (strcmp(stored_user, username) == 0) {
+            fclose(file);
+            return ACCOUNT_EXISTS;
+        }
+    }
+    
+    fclose(file);
+    return ACCOUNT_NOT_FOUND;
+}
+
+// Register new user
+static AccountStatus file_create(const char *username, const char *password, int known_absent) {
+    // Check if user already exists (skipped when the filter proved the name is free)
+    if (!known_absent && file_exists(username) == ACCOUNT_EXISTS) {
+        return ACCOUNT_EXISTS;
+    }
+    
+    FILE *file = fopen(USERS_FILE, "a");
+    if (!file) {
+        perror("fopen");
+        return ACCOUNT_IO_ERROR;
+    }
+    
+    fprintf(file, "%s:%s\n", username, password);
+    fclose(file);
+    
+    return ACCOUNT_OK;
+}
+
+// Collect existing stats records into a growable array
+typedef struct {
+    PlayerStats *items;
+    int count;
+    int capacity;
+} StatsList;
+
+static void stats_list_append(const PlayerStats *stats, void *ctx) {
+    StatsList *list = ctx;
+    if (list->count == list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 64;
+        PlayerStats *items = realloc(list->items, new_capacity * sizeof(PlayerStats));
+        if (!items) return;
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count++] = *stats;
+}
+
+// Merge batch into stats file (rewrite to temp file, then rename)
+static AccountStatus file_update_stats(const PlayerStats *stats, int count) {
+    StatsList list = {NULL, 0, 0};
+    file_for_each_stats(stats_list_append, &list);
+    
+    for (int b = 0; b < count; b++) {
+        int found = 0;
+        for (int i = 0; i < list.count; i++) {
+            if (strcmp(list.items[i].username, stats[b].username) == 0) {
+                list.items[i] = stats[b];
+                found = 1;
+                break;
+            }
+        }
+        if (!found) {
+            stats_list_append(&stats[b], &list);
+        }
+    }
+    
+    FILE *file = fopen(STATS_TEMP_FILE, "w");
+    if (!file) {
+        perror("fopen");
+        free(list.items);
+        return ACCOUNT_IO_ERROR;
+    }
+    
+    char fields[128];
+    for (int i = 0; i < list.count; i++) {
+        account_format_stats(&list.items[i], fields, sizeof(fields));
+        fprintf(file, "%s:%s\n", list.items[i].username, fields);
+    }
+    free(list.items);
+    
+    if (fclose(file) != 0 || rename(STATS_TEMP_FILE, STATS_FILE) != 0) {
+        perror("rename");
+        return ACCOUNT_IO_ERROR;
+    }
+    
+    return ACCOUNT_OK;
+}
+
+const AccountBackend account_file_backend = {
+    "file",
+    file_open,
+    file_close,
+    file_for_each_user,
+    file_for_each_stats,
+    file_lookup,
+    file_exists,
+    file_create,
+    file_update_stats
+};
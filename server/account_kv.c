@@ -0,0 +1,117 @@
+#include "server.h"
+
+#define ACCOUNT_DB_FILE "accounts.db"
+#define KEY_USER_PREFIX "user/"
+#define KEY_STATS_PREFIX "stats/"
+
+// Embedded key-value backend: "user/<name>" -> password,
+// "stats/<name>" -> serialized PlayerStats (see account_format_stats)
+
+static KVStore *store = NULL;
+
+static int kv_backend_open(void) {
+    store = kv_open(ACCOUNT_DB_FILE);
+    return store != NULL;
+}
+
+static void kv_backend_close(void) {
+    kv_close(store);
+    store = NULL;
+}
+
+static void make_key(char *key, int size, const char *prefix, const char *username) {
+    snprintf(key, size, "%s%s", prefix, username);
+}
+
+// Adapter state for kv_for_each callbacks
+typedef struct {
+    void (*user_fn)(const char *username, void *ctx);
+    void (*stats_fn)(const PlayerStats *stats, void *ctx);
+    void *ctx;
+} KVIterContext;
+
+static void kv_user_entry(const char *key, const char *value, void *ctx) {
+    (void)value;
+    KVIterContext *iter = ctx;
+    iter->user_fn(key + strlen(KEY_USER_PREFIX), iter->ctx);
+}
+
+static void kv_stats_entry(const char *key, const char *value, void *ctx) {
+    KVIterContext *iter = ctx;
+    PlayerStats stats;
+    
+    memset(&stats, 0, sizeof(stats));
+    snprintf(stats.username, sizeof(stats.username), "%s", key + strlen(KEY_STATS_PREFIX));
+    if (account_parse_stats(value, &stats)) {
+        iter->stats_fn(&stats, iter->ctx);
+    }
+}
+
+static void kv_backend_for_each_user(void (*fn)(const char *username, void *ctx), void *ctx) {
+    KVIterContext iter = {fn, NULL, ctx};
+    kv_for_each(store, KEY_USER_PREFIX, kv_user_entry, &iter);
+}
+
+static void kv_backend_for_each_stats(void (*fn)(const PlayerStats *stats, void *ctx), void *ctx) {
+    KVIterContext iter = {NULL, fn, ctx};
+    kv_for_each(store, KEY_STATS_PREFIX, kv_stats_entry, &iter);
+}
+
+static AccountStatus kv_backend_lookup(const char *username, const char *password) {
+    char key[MAX_USERNAME + 16];
+    make_key(key, sizeof(key), KEY_USER_PREFIX, username);
+    
+    const char *stored_pass = kv_get(store, key);
+    if (stored_pass && strcmp(stored_pass, password) == 0) {
+        return ACCOUNT_OK;
+    }
+    return ACCOUNT_NOT_FOUND;
+}
+
+static AccountStatus kv_backend_exists(const char *username) {
+    char key[MAX_USERNAME + 16];
+    make_key(key, sizeof(key), KEY_USER_PREFIX, username);
+    
+    return kv_get(store, key) ? ACCOUNT_EXISTS : ACCOUNT_NOT_FOUND;
+}
+
+static AccountStatus kv_backend_create(const char *username, const char *password, int known_absent) {
+    // Index lookup is in-memory, so always check even when the filter says absent
+    (void)known_absent;
+    
+    if (kv_backend_exists(username) == ACCOUNT_EXISTS) {
+        return ACCOUNT_EXISTS;
+    }
+    
+    char key[MAX_USERNAME + 16];
+    make_key(key, sizeof(key), KEY_USER_PREFIX, username);
+    
+    return kv_put(store, key, password) ? ACCOUNT_OK : ACCOUNT_IO_ERROR;
+}
+
+static AccountStatus kv_backend_update_stats(const PlayerStats *stats, int count) {
+    char key[MAX_USERNAME + 16];
+    char value[128];
+    AccountStatus status = ACCOUNT_OK;
+    
+    for (int i = 0; i < count; i++) {
+        make_key(key, sizeof(key), KEY_STATS_PREFIX, stats[i].username);
+        account_format_stats(&stats[i], value, sizeof(value));
+        if (!kv_put(store, key, value)) {
+            status = ACCOUNT_IO_ERROR;
+        }
+    }
+    return status;
+}
+
+const AccountBackend account_kv_backend = {
+    "kv",
+    kv_backend_open,
+    kv_backend_close,
+    kv_backend_for_each_user,
+    kv_backend_for_each_stats,
+    kv_backend_lookup,
+    kv_backend_exists,
+    kv_backend_create,
+    kv_backend_update_stats
+};
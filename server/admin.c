@@ -0,0 +1,513 @@
+#include "server.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <linux/sockios.h>
+
+// Admin control socket
+//
+// A Unix-domain stream socket (ADMIN_SOCKET in the working directory,
+// override with ADMIN_SOCKET env, empty disables; mode 0600) takes one
+// command per line and answers with zero or more lines followed by "OK"
+// or "ERROR <reason>". Try: socat - UNIX-CONNECT:admin.sock, then "help".
+//
+// Admin sockets are served by the event loop like game clients, but every
+// fd is non-blocking: commands only read and format server state, replies
+// go to a per-connection output buffer flushed as the socket drains, and a
+// reader that falls ADMIN_OUTPUT_MAX bytes behind is dropped. Game traffic
+// never waits on an admin peer.
+
+#define ADMIN_MAX_CONNECTIONS 4
+#define ADMIN_LINE_MAX 512
+#define ADMIN_METRICS_MAX 65536  // Prometheus text for the metrics query
+
+typedef struct {
+    int fd;               // -1 if the slot is free
+    char line[ADMIN_LINE_MAX];
+    int line_len;
+    char *out;            // Pending reply bytes [out_sent, out_len)
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    int overflow;         // Reply outgrew ADMIN_OUTPUT_MAX, close after this read
+} AdminConnection;
+
+static AdminConnection connections[ADMIN_MAX_CONNECTIONS];
+static int listen_fd = -1;
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static long long start_ms = 0;
+
+static const char *state_names[] = {
+    "CONNECTED", "AUTHENTICATED", "IN_LOBBY", "IN_ROOM", "READY", "IN_GAME", "DISCONNECTED"
+};
+
+static void admin_close(AdminConnection *conn) {
+    close(conn->fd);
+    free(conn->out);
+    memset(conn, 0, sizeof(AdminConnection));
+    conn->fd = -1;
+}
+
+// Append formatted text to the reply buffer (sets overflow when the reader is too far behind)
+static void admin_printf(AdminConnection *conn, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void admin_printf(AdminConnection *conn, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length < 0 || conn->overflow) return;
+    
+    size_t needed = conn->out_len + (size_t)length + 1;
+    if (needed - conn->out_sent > ADMIN_OUTPUT_MAX) {
+        conn->overflow = 1;
+        return;
+    }
+    if (needed > conn->out_cap) {
+        size_t capacity = conn->out_cap ? conn->out_cap : 4096;
+        while (capacity < needed) capacity *= 2;
+        char *out = realloc(conn->out, capacity);
+        if (!out) {
+            conn->overflow = 1;
+            return;
+        }
+        conn->out = out;
+        conn->out_cap = capacity;
+    }
+    
+    va_start(args, format);
+    vsnprintf(conn->out + conn->out_len, (size_t)length + 1, format, args);
+    va_end(args);
+    conn->out_len += (size_t)length;
+}
+
+// Send as much pending output as the socket takes (0 = peer gone)
+static int admin_flush(AdminConnection *conn) {
+    while (conn->out_sent < conn->out_len) {
+        ssize_t sent = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        conn->out_sent += (size_t)sent;
+    }
+    conn->out_len = conn->out_sent = 0;
+    return 1;
+}
+
+// Bytes queued in the kernel for a client that the peer hasn't acknowledged yet
+static int admin_send_queue(int fd) {
+    int queued = 0;
+    if (fd < 0 || ioctl(fd, SIOCOUTQ, &queued) < 0) return -1;
+    return queued;
+}
+
+// Resident set size in KB and open descriptors of this process (-1 if /proc is unavailable)
+static void admin_process_usage(long *rss_kb, int *fds) {
+    *rss_kb = -1;
+    *fds = -1;
+    
+    long pages_total, pages_resident;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%ld %ld", &pages_total, &pages_resident) == 2) {
+            *rss_kb = pages_resident * (sysconf(_SC_PAGESIZE) / 1024);
+        }
+        fclose(statm);
+    }
+    
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir) {
+        int count = 0;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] != '.') count++;
+        }
+        closedir(dir);
+        *fds = count - 1;  // Not the one opendir() holds
+    }
+}
+
+static void admin_status(Server *server, AdminConnection *conn) {
+    int clients = 0;
+    int disconnected = 0;
+    int rooms = 0;
+    int games = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!server->clients[i].active) continue;
+        clients++;
+        if (server->clients[i].state == STATE_DISCONNECTED) disconnected++;
+    }
+    for (int i = 0; i < MAX_ROOMS; i++) {
+        if (!server->rooms[i].active) continue;
+        rooms++;
+        if (server->rooms[i].game_started) games++;
+    }
+    
+    long rss_kb;
+    int fds;
+    admin_process_usage(&rss_kb, &fds);
+    
+    admin_printf(conn, "uptime_s=%lld clients=%d disconnected=%d rooms=%d games=%d draining=%d log_level=%s "
+                 "rss_kb=%ld fds=%d\n",
+                 (time_now_ms() - start_ms) / 1000, clients, disconnected, rooms, games, server->draining,
+                 log_level_name(log_get_level()), rss_kb, fds);
+}
+
+// One line per active client slot
+static void admin_clients(Server *server, AdminConnection *conn) {
+    time_t now = time(NULL);
+    
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Client *client = &server->clients[i];
+        if (!client->active) continue;
+        
+        admin_printf(conn, "client %d conn=%u user=%s state=%s room=%d slot=%d rtt_ms=%d sendq=%d idle_s=%ld auth_pending=%d\n",
+                     i, client->conn_id, client->username[0] ? client->username : "-", state_names[client->state],
+                     client->room_id, client->player_index, client->ping_ms, admin_send_queue(client->socket_fd),
+                     (long)(now - client->last_pong_time), client->auth_pending);
+    }
+}
+
+// One line per active room, players as slot:client_index (name last, it may hold spaces)
+static void admin_rooms(Server *server, AdminConnection *conn) {
+    for (int i = 0; i < MAX_ROOMS; i++) {
+        Room *room = &server->rooms[i];
+        if (!room->active) continue;
+        
+        char players[64];
+        int offset = 0;
+        players[0] = '\0';
+        for (int p = 0; p < PLAYERS_PER_ROOM; p++) {
+            if (room->player_ids[p] < 0) continue;
+            offset += snprintf(players + offset, sizeof(players) - offset, "%s%d:%d",
+                               offset ? "," : "", p, room->player_ids[p]);
+        }
+        
+        admin_printf(conn, "room %d players=%d host=%d started=%d round=%d/%d remaining_s=%d continue=%d slots=%s name=%s\n",
+                     i, room->player_count, room->host_index, room->game_started, room->current_round,
+                     room->total_rounds, room->game_started ? room->game_time_remaining : 0,
+                     room->waiting_for_continue, offset ? players : "-", room->name);
+    }
+}
+
+// Cross-check rooms against client slots, one "violation" line per broken link
+static void admin_check(Server *server, AdminConnection *conn) {
+    int violations = 0;
+    
+    for (int i = 0; i < MAX_ROOMS; i++) {
+        Room *room = &server->rooms[i];
+        if (!room->active) continue;
+        
+        int occupied = 0;
+        for (int p = 0; p < PLAYERS_PER_ROOM; p++) {
+            int client_idx = room->player_ids[p];
+            if (client_idx < 0) continue;
+            occupied++;
+            
+            if (client_idx >= MAX_CLIENTS || !server->clients[client_idx].active) {
+                admin_printf(conn, "violation room %d slot %d: client %d is not active\n", i, p, client_idx);
+                violations++;
+            } else if (server->clients[client_idx].room_id != i || server->clients[client_idx].player_index != p) {
+                admin_printf(conn, "violation room %d slot %d: client %d thinks it is in room %d slot %d\n", i, p,
+                             client_idx, server->clients[client_idx].room_id, server->clients[client_idx].player_index);
+                violations++;
+            }
+        }
+        
+        if (occupied != room->player_count) {
+            admin_printf(conn, "violation room %d: player_count %d but %d occupied slots\n", i, room->player_count, occupied);
+            violations++;
+        }
+        if (occupied > 0 && (room->host_index < 0 || room->host_index >= PLAYERS_PER_ROOM ||
+                             room->player_ids[room->host_index] < 0)) {
+            admin_printf(conn, "violation room %d: host slot %d is empty\n", i, room->host_index);
+            violations++;
+        }
+    }
+    
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Client *client = &server->clients[i];
+        if (!client->active) continue;
+        
+        if ((client->state == STATE_DISCONNECTED) != (client->socket_fd < 0)) {
+            admin_printf(conn, "violation client %d: state %s with socket %d\n", i, state_names[client->state],
+                         client->socket_fd);
+            violations++;
+        }
+        
+        int room_id = client->room_id;
+        if (room_id >= 0) {
+            if (room_id >= MAX_ROOMS || !server->rooms[room_id].active) {
+                admin_printf(conn, "violation client %d: in inactive room %d\n", i, room_id);
+                violations++;
+            } else if (client->player_index < 0 || client->player_index >= PLAYERS_PER_ROOM ||
+                       server->rooms[room_id].player_ids[client->player_index] != i) {
+                admin_printf(conn, "violation client %d: room %d slot %d does not hold it\n", i, room_id,
+                             client->player_index);
+                violations++;
+            }
+        }
+        
+        // A slot left active by a reconnect handoff shows up as a second session
+        if (client->username[0]) {
+            for (int j = i + 1; j < MAX_CLIENTS; j++) {
+                if (server->clients[j].active && strcmp(server->clients[j].username, client->username) == 0) {
+                    admin_printf(conn, "violation clients %d and %d: both logged in as %s\n", i, j, client->username);
+                    violations++;
+                }
+            }
+        }
+    }
+    
+    admin_printf(conn, "violations=%d\n", violations);
+}
+
+// Permanently disconnect a client by slot index or username
+static void admin_kick(Server *server, AdminConnection *conn, const char *target) {
+    int client_idx = -1;
+    
+    if (target[0] >= '0' && target[0] <= '9') {
+        client_idx = atoi(target);
+        if (client_idx >= MAX_CLIENTS || !server->clients[client_idx].active) client_idx = -1;
+    } else {
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (server->clients[i].active && strcmp(server->clients[i].username, target) == 0) {
+                client_idx = i;
+                break;
+            }
+        }
+    }
+    
+    if (client_idx < 0) {
+        admin_printf(conn, "ERROR no such client: %s\n", target);
+        return;
+    }
+    
+    log_write(LOG_WARN, LOG_SERVER, "Admin kicked client %d (%s)", client_idx,
+              server->clients[client_idx].username[0] ? server->clients[client_idx].username : "unknown");
+    client_send(&server->clients[client_idx], "ERROR|Disconnected by administrator\n");
+    client_disconnect(server, client_idx);
+    admin_printf(conn, "OK\n");
+}
+
+static void admin_command(Server *server, AdminConnection *conn, char *line) {
+    char command[32] = {0};
+    char arg[MAX_USERNAME + 32] = {0};
+    sscanf(line, "%31s %63s", command, arg);
+    
+    if (command[0] == '\0') {
+        return;
+    } else if (strcmp(command, "help") == 0) {
+        admin_printf(conn, "status                 uptime, client and room counts, drain state\n"
+                           "clients                client slots: state, room, RTT, send queue bytes\n"
+                           "rooms                  rooms: players, host, round, timer\n"
+                           "check                  room/client invariants, one violation line each\n"
+                           "metrics                Prometheus text, as served on METRICS_PORT\n"
+                           "kick <index|username>  disconnect a client for good\n"
+                           "drain                  refuse connections and new games, stop once games end\n"
+                           "log_level [level]      show or set ERROR/WARN/INFO/DEBUG/TRACE\n"
+                           "OK\n");
+    } else if (strcmp(command, "status") == 0) {
+        admin_status(server, conn);
+        admin_printf(conn, "OK\n");
+    } else if (strcmp(command, "clients") == 0) {
+        admin_clients(server, conn);
+        admin_printf(conn, "OK\n");
+    } else if (strcmp(command, "rooms") == 0) {
+        admin_rooms(server, conn);
+        admin_printf(conn, "OK\n");
+    } else if (strcmp(command, "check") == 0) {
+        admin_check(server, conn);
+        admin_printf(conn, "OK\n");
+    } else if (strcmp(command, "metrics") == 0) {
+        static char body[ADMIN_METRICS_MAX];
+        size_t length = metrics_render(body, sizeof(body));
+        admin_printf(conn, "%.*s", (int)length, body);
+        admin_printf(conn, "OK\n");
+    } else if (strcmp(command, "kick") == 0 && arg[0]) {
+        admin_kick(server, conn, arg);
+    } else if (strcmp(command, "drain") == 0) {
+        server_drain(server);
+        admin_printf(conn, "OK\n");
+    } else if (strcmp(command, "log_level") == 0) {
+        if (arg[0]) {
+            int level = log_parse_level(arg);
+            if (level < 0) {
+                admin_printf(conn, "ERROR unknown level: %s\n", arg);
+                return;
+            }
+            log_set_level((LogLevel)level);
+            log_write(LOG_WARN, LOG_SERVER, "Admin set log level to %s", log_level_name((LogLevel)level));
+        }
+        admin_printf(conn, "%s\nOK\n", log_level_name(log_get_level()));
+    } else {
+        admin_printf(conn, "ERROR unknown command, try help\n");
+    }
+}
+
+// Read what arrived and run every complete line (0 = close the connection)
+static int admin_read(Server *server, AdminConnection *conn) {
+    char buffer[ADMIN_LINE_MAX];
+    ssize_t got = recv(conn->fd, buffer, sizeof(buffer), 0);
+    if (got == 0) return 0;
+    if (got < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    
+    for (ssize_t i = 0; i < got; i++) {
+        char c = buffer[i];
+        if (c == '\n') {
+            conn->line[conn->line_len] = '\0';
+            if (conn->line_len > 0 && conn->line[conn->line_len - 1] == '\r') {
+                conn->line[conn->line_len - 1] = '\0';
+            }
+            conn->line_len = 0;
+            admin_command(server, conn, conn->line);
+        } else if (conn->line_len < ADMIN_LINE_MAX - 1) {
+            conn->line[conn->line_len++] = c;
+        } else {
+            admin_printf(conn, "ERROR line too long\n");
+            admin_flush(conn);
+            return 0;
+        }
+    }
+    return !conn->overflow;
+}
+
+// Listen on the admin socket (0 = disabled or unavailable)
+int admin_init(void) {
+    for (int i = 0; i < ADMIN_MAX_CONNECTIONS; i++) {
+        connections[i].fd = -1;
+    }
+    start_ms = time_now_ms();
+    
+    const char *path = getenv("ADMIN_SOCKET");
+    if (!path) path = ADMIN_SOCKET;
+    if (path[0] == '\0') {
+        log_write(LOG_INFO, LOG_SERVER, "Admin socket: off");
+        return 0;
+    }
+    if (strlen(path) >= sizeof(socket_path)) {
+        log_write(LOG_ERROR, LOG_SERVER, "Admin socket path too long: %s", path);
+        return 0;
+    }
+    
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 0;
+    }
+    
+    // A leftover socket file from a crashed server is replaced, a live one is not
+    if (connect(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        log_write(LOG_ERROR, LOG_SERVER, "Admin socket %s is in use by another server", path);
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    close(listen_fd);
+    unlink(path);
+    
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 0;
+    }
+    
+    // The socket file is created by bind() with the umask's mode, so it is
+    // owner-only from the start rather than chmod()ed after a window in
+    // which anyone could connect
+    mode_t old_umask = umask(0177);
+    int bound = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+    
+    if (bound < 0 || listen(listen_fd, ADMIN_MAX_CONNECTIONS) < 0) {
+        perror("admin bind");
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+    strcpy(socket_path, path);
+    
+    log_write(LOG_INFO, LOG_SERVER, "Admin socket: %s", path);
+    return 1;
+}
+
+void admin_shutdown(void) {
+    if (listen_fd < 0) return;
+    
+    for (int i = 0; i < ADMIN_MAX_CONNECTIONS; i++) {
+        if (connections[i].fd >= 0) {
+            admin_flush(&connections[i]);
+            admin_close(&connections[i]);
+        }
+    }
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path);
+}
+
+// Add admin sockets to the event loop's select sets, returns the new max fd
+int admin_fill_fds(fd_set *read_fds, fd_set *write_fds, int max_fd) {
+    if (listen_fd < 0) return max_fd;
+    
+    FD_SET(listen_fd, read_fds);
+    if (listen_fd > max_fd) max_fd = listen_fd;
+    
+    for (int i = 0; i < ADMIN_MAX_CONNECTIONS; i++) {
+        AdminConnection *conn = &connections[i];
+        if (conn->fd < 0) continue;
+        
+        FD_SET(conn->fd, read_fds);
+        if (conn->out_sent < conn->out_len) FD_SET(conn->fd, write_fds);
+        if (conn->fd > max_fd) max_fd = conn->fd;
+    }
+    return max_fd;
+}
+
+// Accept, read and answer admin connections that select() reported ready
+void admin_process(Server *server, const fd_set *read_fds, const fd_set *write_fds) {
+    if (listen_fd < 0) return;
+    
+    if (FD_ISSET(listen_fd, read_fds)) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            int slot = -1;
+            for (int i = 0; i < ADMIN_MAX_CONNECTIONS; i++) {
+                if (connections[i].fd < 0) {
+                    slot = i;
+                    break;
+                }
+            }
+            if (slot < 0) {
+                log_write(LOG_WARN, LOG_SERVER, "Admin socket: too many connections, rejecting");
+                close(fd);
+            } else {
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+                connections[slot].fd = fd;
+            }
+        }
+    }
+    
+    for (int i = 0; i < ADMIN_MAX_CONNECTIONS; i++) {
+        AdminConnection *conn = &connections[i];
+        if (conn->fd < 0) continue;
+        
+        int keep = 1;
+        if (FD_ISSET(conn->fd, read_fds)) {
+            keep = admin_read(server, conn);
+        }
+        if (keep && (conn->out_len > conn->out_sent || FD_ISSET(conn->fd, write_fds))) {
+            keep = admin_flush(conn);
+        }
+        if (!keep) {
+            admin_close(conn);
+        }
+    }
+}
@@ -1,61 +1,42 @@
 #include "server.h"
 
-#define USERS_FILE "users.txt"
+// In-memory filter of registered usernames (rebuilt from the account backend at startup)
+static BloomFilter user_filter;
 
-// Register new user
-int register_user(const char *username, const char *password) {
-    // Check if user already exists
-    FILE *file = fopen(USERS_FILE, "r");
-    if (file) {
-        char line[256];
-        char stored_user[MAX_USERNAME];
-        
-        while (fgets(line, sizeof(line), file)) {
-            sscanf(line, "%[^:]:", stored_user);
-            if (strcmp(stored_user, username) == 0) {
-                fclose(file);
-                return 0;  // User already exists
-            }
-        }
-        fclose(file);
-    }
-    
-    // Add new user
-    file = fopen(USERS_FILE, "a");
-    if (!file) {
-        perror("fopen");
-        return 0;
-    }
-    
-    fprintf(file, "%s:%s\n", username, password);
-    fclose(file);
-    
-    printf("New user registered: %s\n", username);
-    return 1;
+static void filter_add_user(const char *username, void *ctx) {
+    (void)ctx;
+    bloom_add(&user_filter, username);
 }
 
-// Authenticate user
-int authenticate_user(const char *username, const char *password) {
-    FILE *file = fopen(USERS_FILE, "r");
-    if (!file) {
-        return 0;
-    }
+// Build username filter from account backend
+void auth_init(void) {
+    bloom_init(&user_filter);
+    account_backend()->for_each_user(filter_add_user, NULL);
     
-    char line[256];
-    char stored_user[MAX_USERNAME];
-    char stored_pass[MAX_PASSWORD];
+    log_write(LOG_INFO, LOG_AUTH, "Loaded %d registered usernames into filter", user_filter.count);
+}
+
+// Queue account request for the client (result arrives in auth_complete)
+static int auth_submit(Server *server, int client_idx, AccountOp op,
+                       const char *username, const char *password, int known_absent) {
+    Client *client = &server->clients[client_idx];
+    AccountRequest req;
     
-    while (fgets(line, sizeof(line), file)) {
-        sscanf(line, "%[^:]:%s", stored_user, stored_pass);
-        
-        if (strcmp(stored_user, username) == 0 && strcmp(stored_pass, password) == 0) {
-            fclose(file);
-            return 1;
-        }
+    memset(&req, 0, sizeof(req));
+    req.op = op;
+    req.client_idx = client_idx;
+    req.conn_id = client->conn_id;
+    snprintf(req.username, sizeof(req.username), "%s", username);
+    if (password) {
+        snprintf(req.password, sizeof(req.password), "%s", password);
     }
+    req.known_absent = known_absent;
     
-    fclose(file);
-    return 0;
+    if (!account_submit(&req)) {
+        client_send(client, "ERROR|Server busy, try again\n");
+        return 0;
+    }
+    return 1;
 }
 
 // Handle registration request
@@ -67,11 +48,61 @@ void handle_register(Server *server, int client_idx, const char *username, const
         return;
     }
     
-    if (register_user(username, password)) {
+    if (client->auth_pending) {
+        client_send(client, "ERROR|Request already in progress\n");
+        return;
+    }
+    
+    // Filter miss means the name is definitely free, backend can skip its lookup
+    int known_absent = !bloom_maybe_contains(&user_filter, username);
+    
+    if (auth_submit(server, client_idx, ACCOUNT_OP_CREATE, username, password, known_absent)) {
+        client->auth_pending = 1;
+        
+        // Add now so a concurrent REGISTER for the same name takes the checked path
+        bloom_add(&user_filter, username);
+    }
+}
+
+// Registration finished
+static void register_complete(Client *client, const AccountRequest *req) {
+    if (req->status == ACCOUNT_OK) {
         client_send(client, "REGISTER_OK|Registration successful\n");
-    } else {
+        log_write(LOG_INFO, LOG_AUTH, "New user registered: %s", req->username);
+    } else if (req->status == ACCOUNT_EXISTS) {
         client_send(client, "ERROR|Username already exists\n");
+    } else {
+        client_send(client, "ERROR|Registration failed\n");
+    }
+}
+
+// Handle username availability query
+// Format: CHECK_NAME|username -> NAME_AVAILABLE|username or NAME_TAKEN|username
+void handle_check_name(Server *server, int client_idx, const char *username) {
+    Client *client = &server->clients[client_idx];
+    
+    if (strlen(username) == 0) {
+        client_send(client, "ERROR|Username required\n");
+        return;
     }
+    
+    // Definite filter miss is answered immediately, possible match goes to the backend
+    if (!bloom_maybe_contains(&user_filter, username)) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "NAME_AVAILABLE|%s\n", username);
+        client_send(client, msg);
+        return;
+    }
+    
+    auth_submit(server, client_idx, ACCOUNT_OP_EXISTS, username, NULL, 0);
+}
+
+// Name check finished
+static void check_name_complete(Client *client, const AccountRequest *req) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s|%s\n",
+             req->status == ACCOUNT_EXISTS ? "NAME_TAKEN" : "NAME_AVAILABLE", req->username);
+    client_send(client, msg);
 }
 
 // Handle login request
@@ -83,6 +114,21 @@ void handle_login(Server *server, int client_idx, const char *username, const ch
         return;
     }
     
+    if (client->auth_pending) {
+        client_send(client, "ERROR|Request already in progress\n");
+        return;
+    }
+    
+    if (auth_submit(server, client_idx, ACCOUNT_OP_LOOKUP, username, password, 0)) {
+        client->auth_pending = 1;
+    }
+}
+
+// Credentials checked, finish login (session state may have changed while waiting)
+static void login_complete(Server *server, int client_idx, const AccountRequest *req) {
+    Client *client = &server->clients[client_idx];
+    const char *username = req->username;
+    
     // Check if user is disconnected and can reconnect
     int disconnected_idx = -1;
     for (int i = 0; i < MAX_CLIENTS; i++) {
@@ -102,7 +148,7 @@ void handle_login(Server *server, int client_idx, const char *username, const ch
         }
     }
     
-    if (!authenticate_user(username, password)) {
+    if (req->status != ACCOUNT_OK) {
         client_send(client, "ERROR|Invalid username or password\n");
         return;
     }
@@ -111,7 +157,7 @@ void handle_login(Server *server, int client_idx, const char *username, const ch
     if (disconnected_idx >= 0) {
         Client *old_client = &server->clients[disconnected_idx];
         
-        printf("User %s reconnecting! Restoring session...\n", username);
+        log_write(LOG_INFO, LOG_AUTH, "User %s reconnecting! Restoring session...", username);
         
         // Transfer state to new connection
         int old_room_id = old_client->room_id;
@@ -119,7 +165,7 @@ void handle_login(Server *server, int client_idx, const char *username, const ch
         ClientState old_state = old_client->saved_state;
         
         // Copy username and restore state to new client
-        strncpy(client->username, username, MAX_USERNAME - 1);
+        snprintf(client->username, sizeof(client->username), "%s", username);
         client->state = old_state;
         client->room_id = old_room_id;
         client->player_index = old_player_index;
@@ -151,7 +197,7 @@ void handle_login(Server *server, int client_idx, const char *username, const ch
             
             // If game is in progress, resend game data
             if (old_state == STATE_IN_GAME && room->game_started) {
-                printf("Reconnecting player to active game...\n");
+                log_write(LOG_INFO, LOG_AUTH, "Reconnecting player to active game...");
                 
                 // Send GAME_START with current puzzle (same as puzzle_send_to_clients but for one player)
                 Puzzle *puzzle = &room->puzzle;
@@ -160,27 +206,7 @@ void handle_login(Server *server, int client_idx, const char *username, const ch
                 
                 // Build equation string
                 char equation[128];
-                switch (puzzle->format) {
-                    case FORMAT_P1_P2_P3_EQ_P4:
-                        snprintf(equation, sizeof(equation), "P1%sP2%sP3=P4",
-                                get_operator_string(puzzle->op1),
-                                get_operator_string(puzzle->op2));
-                        break;
-                    case FORMAT_P1_EQ_P2_P3_P4:
-                        snprintf(equation, sizeof(equation), "P1=P2%sP3%sP4",
-                                get_operator_string(puzzle->op1),
-                                get_operator_string(puzzle->op2));
-                        break;
-                    case FORMAT_P1_P2_EQ_P3_P4:
-                        snprintf(equation, sizeof(equation), "P1%sP2=P3%sP4",
-                                get_operator_string(puzzle->op1),
-                                get_operator_string(puzzle->op2));
-                        break;
-                    default:
-                        snprintf(equation, sizeof(equation), "P1%sP2%sP3=P4",
-                                get_operator_string(puzzle->op1),
-                                get_operator_string(puzzle->op2));
-                }
+                expr_format(&puzzle->equation, NULL, NULL, NULL, equation, sizeof(equation));
                 
                 offset += snprintf(buffer + offset, sizeof(buffer) - offset,
                                  "GAME_START|%s", equation);
@@ -243,16 +269,42 @@ void handle_login(Server *server, int client_idx, const char *username, const ch
     }
     
     // Normal login
-    strncpy(client->username, username, MAX_USERNAME - 1);
+    snprintf(client->username, sizeof(client->username), "%s", username);
     client->state = STATE_IN_LOBBY;
     
     char msg[128];
     snprintf(msg, sizeof(msg), "LOGIN_OK|%s\n", username);
     client_send(client, msg);
     
-    printf("User logged in: %s\n", username);
+    log_write(LOG_INFO, LOG_AUTH, "User logged in: %s", username);
     
     // Send room list
     send_room_list(server, client_idx);
 }
 
+// Deliver account backend result to the requesting client
+void auth_complete(Server *server, const AccountRequest *req) {
+    if (req->client_idx < 0 || req->client_idx >= MAX_CLIENTS) return;
+    
+    Client *client = &server->clients[req->client_idx];
+    
+    // Client went away (or slot was reused) while the request was in flight;
+    // socket fds are reused right away, connection numbers never are
+    if (!client->active || client->conn_id != req->conn_id) return;
+    
+    switch (req->op) {
+        case ACCOUNT_OP_CREATE:
+            client->auth_pending = 0;
+            register_complete(client, req);
+            break;
+        case ACCOUNT_OP_LOOKUP:
+            client->auth_pending = 0;
+            login_complete(server, req->client_idx, req);
+            break;
+        case ACCOUNT_OP_EXISTS:
+            check_name_complete(client, req);
+            break;
+        default:
+            break;
+    }
+}
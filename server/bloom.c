@@ -0,0 +1,46 @@
+#include "server.h"
+
+// FNV-1a 64-bit hash
+static unsigned long long bloom_hash(const char *key) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Reset filter to empty
+void bloom_init(BloomFilter *filter) {
+    memset(filter, 0, sizeof(BloomFilter));
+}
+
+// Add key to filter
+// Bit positions use double hashing: h1 + i * h2 (Kirsch-Mitzenmacher)
+void bloom_add(BloomFilter *filter, const char *key) {
+    unsigned long long hash = bloom_hash(key);
+    unsigned int h1 = (unsigned int)hash;
+    unsigned int h2 = (unsigned int)(hash >> 32) | 1;  // Odd step so probes never repeat
+    
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        unsigned int bit = (h1 + i * h2) % BLOOM_BITS;
+        filter->bits[bit / 8] |= (unsigned char)(1 << (bit % 8));
+    }
+    filter->count++;
+}
+
+// Check key against filter
+// Returns 0 if key was definitely never added, 1 if it may have been
+int bloom_maybe_contains(const BloomFilter *filter, const char *key) {
+    unsigned long long hash = bloom_hash(key);
+    unsigned int h1 = (unsigned int)hash;
+    unsigned int h2 = (unsigned int)(hash >> 32) | 1;
+    
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        unsigned int bit = (h1 + i * h2) % BLOOM_BITS;
+        if (!(filter->bits[bit / 8] & (1 << (bit % 8)))) {
+            return 0;  // Definite miss
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,281 @@
+#include "server.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Traffic capture
+//
+// With CAPTURE_FILE set, every connection open and close, inbound protocol
+// line and outbound message is appended to a binary trace that
+// tools/replay.c plays back against another server build. On-disk format:
+// 32-byte header (magic, version, puzzle seed), then CaptureRecord headers,
+// each followed by its payload padded to 8 bytes so every header stays
+// aligned in the mapped file. Times are monotonic nanoseconds since capture
+// start; connections are numbered in accept order.
+//
+// The event loop copies records into a byte ring under a mutex and a writer
+// thread drains it with one fwrite + fflush per batch, as the match log
+// does. Records that don't fit are dropped and counted, which makes the
+// trace incomplete, so size CAPTURE_BUFFER_SIZE for the expected burst.
+// The password of REGISTER and LOGIN lines is replaced with
+// CAPTURE_REDACTED before it reaches the ring, and the file is created
+// owner-only, but traces still hold usernames and chat.
+
+#define CAPTURE_MAGIC "MPTRACE1"
+#define CAPTURE_MAGIC_LEN 8
+#define CAPTURE_VERSION 1
+#define CAPTURE_FLAG_FIXED_SEED 1  // Server ran with PUZZLE_SEED, puzzles replay identically
+#define CAPTURE_REDACTED "*"       // Recorded in place of passwords
+
+typedef struct {
+    char magic[CAPTURE_MAGIC_LEN];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t puzzle_seed;
+    uint32_t generator_version;  // PUZZLE_GENERATOR_VERSION of the capturing server
+    uint32_t reserved;
+} CaptureHeader;
+
+_Static_assert(sizeof(CaptureHeader) == 32, "capture header layout");
+_Static_assert(sizeof(CaptureRecord) == 16, "capture record layout");
+_Static_assert((CAPTURE_BUFFER_SIZE & (CAPTURE_BUFFER_SIZE - 1)) == 0, "ring offsets wrap, size must be a power of two");
+
+// Writer thread and byte ring (guarded by ring_lock)
+static pthread_t writer_thread;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
+static char ring[CAPTURE_BUFFER_SIZE];
+static size_t ring_head = 0;  // Bytes ever written (offset = head % size)
+static size_t ring_tail = 0;  // Bytes ever drained
+static int running = 0;
+static long dropped = 0;      // Records lost because the ring was full
+static long long start_ns = 0;
+static FILE *capture_file = NULL;
+
+static size_t capture_padded(size_t length) {
+    return (length + 7) & ~(size_t)7;
+}
+
+// Copy into the ring at byte position pos, wrapping at the end
+static void capture_ring_put(size_t pos, const void *data, size_t length) {
+    if (length == 0) return;
+    
+    size_t offset = pos % CAPTURE_BUFFER_SIZE;
+    size_t first = length < CAPTURE_BUFFER_SIZE - offset ? length : CAPTURE_BUFFER_SIZE - offset;
+    
+    memcpy(ring + offset, data, first);
+    memcpy(ring, (const char *)data + first, length - first);
+}
+
+// Writer thread main loop: drain contiguous spans of the ring
+static void *capture_writer_main(void *arg) {
+    (void)arg;
+    
+    pthread_mutex_lock(&ring_lock);
+    while (1) {
+        while (ring_head == ring_tail && running) {
+            pthread_cond_wait(&ring_cond, &ring_lock);
+        }
+        
+        // Drain remaining bytes before exiting on shutdown
+        if (ring_head == ring_tail) break;
+        
+        size_t tail = ring_tail;
+        size_t count = ring_head - ring_tail;
+        pthread_mutex_unlock(&ring_lock);
+        
+        // The producer never overwrites [tail, head), so the copy-out needs no lock
+        while (count > 0) {
+            size_t offset = tail % CAPTURE_BUFFER_SIZE;
+            size_t span = count < CAPTURE_BUFFER_SIZE - offset ? count : CAPTURE_BUFFER_SIZE - offset;
+            if (fwrite(ring + offset, 1, span, capture_file) != span) {
+                perror("capture write");
+            }
+            tail += span;
+            count -= span;
+        }
+        if (fflush(capture_file) != 0) {
+            perror("capture flush");
+        }
+        
+        pthread_mutex_lock(&ring_lock);
+        ring_tail = tail;
+    }
+    pthread_mutex_unlock(&ring_lock);
+    
+    return NULL;
+}
+
+// Create trace file and start writer thread (0 = capture disabled)
+int capture_init(const char *path, uint64_t puzzle_seed, int fixed_seed) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        perror("open");
+        return 0;
+    }
+    capture_file = fdopen(fd, "wb");
+    if (!capture_file) {
+        perror("fdopen");
+        close(fd);
+        return 0;
+    }
+    
+    CaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN);
+    header.version = CAPTURE_VERSION;
+    header.flags = fixed_seed ? CAPTURE_FLAG_FIXED_SEED : 0;
+    header.puzzle_seed = puzzle_seed;
+    header.generator_version = PUZZLE_GENERATOR_VERSION;
+    if (fwrite(&header, sizeof(header), 1, capture_file) != 1 || fflush(capture_file) != 0) {
+        perror("capture header");
+        fclose(capture_file);
+        capture_file = NULL;
+        return 0;
+    }
+    
+    start_ns = time_now_ns();
+    running = 1;
+    if (pthread_create(&writer_thread, NULL, capture_writer_main, NULL) != 0) {
+        perror("pthread_create");
+        running = 0;
+        fclose(capture_file);
+        capture_file = NULL;
+        return 0;
+    }
+    
+    log_write(LOG_INFO, LOG_SERVER, "Capturing traffic to %s%s", path, fixed_seed ? "" : " (no PUZZLE_SEED, puzzles won't replay)");
+    return 1;
+}
+
+// Stop writer thread after it drains the ring, then close the trace
+void capture_shutdown(void) {
+    if (!running) return;
+    
+    pthread_mutex_lock(&ring_lock);
+    running = 0;
+    pthread_cond_signal(&ring_cond);
+    pthread_mutex_unlock(&ring_lock);
+    
+    pthread_join(writer_thread, NULL);
+    fclose(capture_file);
+    capture_file = NULL;
+    
+    if (dropped > 0) {
+        log_write(LOG_WARN, LOG_SERVER, "Capture: %ld records dropped (buffer full), trace is incomplete", dropped);
+    }
+}
+
+// Length of a REGISTER or LOGIN line up to its password field (the separator included),
+// 0 for other lines
+size_t capture_credential_prefix(const char *line, size_t length) {
+    static const char *const commands[] = {"REGISTER|", "LOGIN|"};
+    
+    for (int i = 0; i < 2; i++) {
+        size_t command_length = strlen(commands[i]);
+        if (length < command_length || memcmp(line, commands[i], command_length) != 0) continue;
+        
+        const char *separator = memchr(line + command_length, '|', length - command_length);
+        return separator ? (size_t)(separator - line) + 1 : 0;
+    }
+    return 0;
+}
+
+// Queue one record (event loop, never blocks on I/O)
+void capture_record(CaptureKind kind, uint32_t conn, const char *data, size_t length) {
+    if (!running) return;
+    
+    // Keep passwords out of the trace
+    char redacted[BUFFER_SIZE + sizeof(CAPTURE_REDACTED)];
+    size_t prefix = kind == CAPTURE_IN ? capture_credential_prefix(data, length) : 0;
+    if (prefix > 0 && prefix <= BUFFER_SIZE) {
+        memcpy(redacted, data, prefix);
+        memcpy(redacted + prefix, CAPTURE_REDACTED, sizeof(CAPTURE_REDACTED) - 1);
+        data = redacted;
+        length = prefix + sizeof(CAPTURE_REDACTED) - 1;
+    }
+    
+    if (length > UINT16_MAX) length = UINT16_MAX;
+    CaptureRecord record;
+    record.time_ns = time_now_ns() - start_ns;
+    record.conn = conn;
+    record.length = (uint16_t)length;
+    record.kind = (uint8_t)kind;
+    record.reserved = 0;
+    
+    static const char padding[8] = {0};
+    size_t size = sizeof(record) + capture_padded(length);
+    
+    pthread_mutex_lock(&ring_lock);
+    if (size > CAPTURE_BUFFER_SIZE - (ring_head - ring_tail)) {
+        dropped++;
+    } else {
+        capture_ring_put(ring_head, &record, sizeof(record));
+        capture_ring_put(ring_head + sizeof(record), data, length);
+        capture_ring_put(ring_head + sizeof(record) + length, padding, capture_padded(length) - length);
+        ring_head += size;
+        pthread_cond_signal(&ring_cond);
+    }
+    pthread_mutex_unlock(&ring_lock);
+}
+
+// Map trace read-only (records stay valid until capture_unmap)
+int capture_map(const char *path, CaptureView *view) {
+    memset(view, 0, sizeof(CaptureView));
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return 0;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(CaptureHeader)) {
+        log_write(LOG_ERROR, LOG_STORAGE, "Capture %s: too short", path);
+        close(fd);
+        return 0;
+    }
+    
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+    
+    const CaptureHeader *header = base;
+    if (memcmp(header->magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0 || header->version != CAPTURE_VERSION) {
+        log_write(LOG_ERROR, LOG_STORAGE, "Capture %s: bad header", path);
+        munmap(base, st.st_size);
+        return 0;
+    }
+    
+    view->base = base;
+    view->size = st.st_size;
+    view->puzzle_seed = header->puzzle_seed;
+    view->fixed_seed = (header->flags & CAPTURE_FLAG_FIXED_SEED) != 0;
+    view->generator_version = header->generator_version;
+    return 1;
+}
+
+void capture_unmap(CaptureView *view) {
+    if (view->base) {
+        munmap(view->base, view->size);
+    }
+    memset(view, 0, sizeof(CaptureView));
+}
+
+// Record at *offset (0 = first) and advance past it, NULL at the end or a torn tail;
+// the payload follows the returned header
+const CaptureRecord *capture_next(const CaptureView *view, size_t *offset) {
+    size_t pos = *offset ? *offset : sizeof(CaptureHeader);
+    
+    if (pos + sizeof(CaptureRecord) > view->size) return NULL;
+    const CaptureRecord *record = (const CaptureRecord *)((const char *)view->base + pos);
+    size_t next = pos + sizeof(CaptureRecord) + capture_padded(record->length);
+    if (next > view->size) return NULL;
+    
+    *offset = next;
+    return record;
+}
@@ -0,0 +1,99 @@
+#include "server.h"
+
+// Difficulty calibration
+//
+// A round's case block in puzzle_generate() only fixes the operators and the
+// value range, so difficulty inside a round varies widely: a round 1 puzzle
+// with 40 answers among many almost-right combinations is harder than a
+// round 4 one with 200 answers. puzzle_difficulty() scores a generated puzzle
+// from solver metrics, and the pool producer draws seeds until a puzzle lands
+// in its round's band, so the extra candidates cost background time only.
+// Puzzles generated inline (pool empty) are not calibrated.
+//
+// All terms are log2 in quarter steps (log2_q2), so the score needs no libm:
+//   search      64 - log2(answers), fewer answers to stumble on
+//   traps       log2(1 + near misses per answer), sides off by 1..2
+//   operators   per-operator weights (ADD < SUB < MUL < DIV)
+//   magnitude   log2(1 + largest operand or intermediate result)
+
+#define NEAR_MISS_DELTA 2
+
+// Accepted score range per round (1..PUZZLE_POOL_ROUNDS). Contiguous and
+// rising, each cut from the round's own score distribution so 30-60% of
+// candidates pass (raw deciles overlap: many round 1 puzzles outscore round 4)
+static const int band_min[PUZZLE_POOL_ROUNDS] = {0, 59, 63, 71, 81};
+static const int band_max[PUZZLE_POOL_ROUNDS] = {58, 62, 70, 80, 110};
+
+static const int operator_weight[] = {2, 3, 5, 7};  // Indexed by Operator
+
+// 4 * log2(v) for v >= 1, whole part plus two fraction bits
+static int log2_q2(unsigned int v) {
+    int whole = 31 - __builtin_clz(v);
+    int frac = whole >= 2 ? (int)(v >> (whole - 2)) & 3 : (int)(v << (2 - whole)) & 3;
+    return whole * 4 + frac;
+}
+
+// Largest |value| the planted answer passes through: every operand, every
+// intermediate result of the compiled equation and the value of each side
+static int intermediate_max(const Puzzle *puzzle) {
+    long long largest = 0;
+    long long value;
+    
+    for (int side = 0; side < 2; side++) {
+        expr_eval(&puzzle->equation.sides[side], puzzle->solution_values, &value, &largest);
+    }
+    return largest < INT32_MAX ? (int)largest : INT32_MAX;
+}
+
+// Difficulty score of a generated puzzle (higher is harder, always >= 1)
+int puzzle_difficulty(const Puzzle *puzzle) {
+    int solutions = puzzle->solution_count > 0 ? puzzle->solution_count : 1;
+    int near_misses = puzzle_near_misses(puzzle, NEAR_MISS_DELTA);
+    
+    int search = 64 - log2_q2((unsigned int)solutions);
+    int traps = log2_q2(1 + (unsigned int)(near_misses / solutions));
+    int operators = operator_weight[puzzle->op1 & 3] + operator_weight[puzzle->op2 & 3];
+    int size = log2_q2(1 + (unsigned int)intermediate_max(puzzle));
+    
+    int score = search + traps / 2 + operators * 2 + size / 2;
+    return score > 0 ? score : 1;
+}
+
+// Generate a puzzle for round whose difficulty is inside the round's band,
+// drawing seeds from seed_rng. After CALIBRATION_ATTEMPTS candidates the one
+// closest to the band is kept. Returns the number of candidates generated.
+int puzzle_generate_calibrated(Puzzle *puzzle, int round, Rng *seed_rng) {
+    if (round < 1 || round > PUZZLE_POOL_ROUNDS) {
+        puzzle_generate(puzzle, round, rng_next(seed_rng));
+        return 1;
+    }
+    
+    int low = band_min[round - 1];
+    int high = band_max[round - 1];
+    unsigned int best_seed = 0;
+    int best_distance = -1;
+    int best_score = 0;
+    
+    for (int attempt = 1; attempt <= CALIBRATION_ATTEMPTS; attempt++) {
+        unsigned int seed = rng_next(seed_rng);
+        puzzle_generate(puzzle, round, seed);
+        int score = puzzle_difficulty(puzzle);
+        
+        if (score >= low && score <= high) {
+            puzzle->difficulty = score;
+            return attempt;
+        }
+        
+        int distance = score < low ? low - score : score - high;
+        if (best_distance < 0 || distance < best_distance) {
+            best_seed = seed;
+            best_distance = distance;
+            best_score = score;
+        }
+    }
+    
+    // Nothing landed in the band: regenerate the closest candidate from its seed
+    puzzle_generate(puzzle, round, best_seed);
+    puzzle->difficulty = best_score;
+    return CALIBRATION_ATTEMPTS;
+}
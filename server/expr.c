@@ -0,0 +1,156 @@
+#include "server.h"
+
+// Equation engine
+//
+// A puzzle equation is operand_count operands P1..Pn joined by operators,
+// with '=' after operand split: P1 op P2 ... op P(split) = P(split+1) ... Pn.
+// expr_compile() turns each side into a postfix program once per puzzle
+// (shunting-yard: MUL/DIV bind tighter, equal precedence goes left to right),
+// so evaluating, verifying and solving all run the same flat code instead of
+// switching on a fixed format. Division only counts when it is exact and a
+// value outside int range makes the side invalid, so a player never wins
+// on a rounded or overflowed result.
+
+static int expr_precedence(Operator op) {
+    return (op == OP_MUL || op == OP_DIV) ? 2 : 1;
+}
+
+static void expr_emit_operator(ExprProgram *program, Operator op) {
+    program->code[program->length++] = (int8_t)-(op + 1);
+}
+
+// Postfix program for operands [first, last) joined by ops[first .. last - 2]
+static void expr_compile_side(ExprProgram *program, int first, int last, const Operator *ops) {
+    Operator pending[EXPR_MAX_OPERANDS];
+    int depth = 0;
+    
+    program->length = 0;
+    program->code[program->length++] = (int8_t)first;
+    for (int i = first + 1; i < last; i++) {
+        Operator op = ops[i - 1];
+        while (depth > 0 && expr_precedence(pending[depth - 1]) >= expr_precedence(op)) {
+            expr_emit_operator(program, pending[--depth]);
+        }
+        pending[depth++] = op;
+        program->code[program->length++] = (int8_t)i;
+    }
+    while (depth > 0) {
+        expr_emit_operator(program, pending[--depth]);
+    }
+}
+
+// Compile count operands joined by ops[0 .. count - 2], '=' after operand
+// split (ops[split - 1] is the '=' and is ignored). Returns 0 if count or
+// split is out of range or an operator is unknown.
+int expr_compile(Equation *equation, int count, int split, const Operator *ops) {
+    if (count < 2 || count > EXPR_MAX_OPERANDS || split < 1 || split >= count) return 0;
+    
+    for (int i = 0; i < count - 1; i++) {
+        if (i == split - 1) {
+            equation->ops[i] = OP_ADD;
+            continue;
+        }
+        if (ops[i] < OP_ADD || ops[i] > OP_DIV) return 0;
+        equation->ops[i] = ops[i];
+    }
+    
+    equation->operand_count = (uint8_t)count;
+    equation->split = (uint8_t)split;
+    expr_compile_side(&equation->sides[0], 0, split, equation->ops);
+    expr_compile_side(&equation->sides[1], split, count, equation->ops);
+    return 1;
+}
+
+// Compile one of the classic four-operand formats
+int expr_compile_format(Equation *equation, EquationFormat format, Operator op1, Operator op2) {
+    Operator ops[3];
+    int split;
+    
+    switch (format) {
+        case FORMAT_P1_P2_P3_EQ_P4:
+            ops[0] = op1; ops[1] = op2; split = 3;
+            break;
+        case FORMAT_P1_EQ_P2_P3_P4:
+            ops[1] = op1; ops[2] = op2; split = 1;
+            break;
+        case FORMAT_P1_P2_EQ_P3_P4:
+            ops[0] = op1; ops[2] = op2; split = 2;
+            break;
+        default:
+            return 0;
+    }
+    ops[split - 1] = OP_ADD;
+    return expr_compile(equation, 4, split, ops);
+}
+
+// a op b, returns 0 for an inexact division or a result outside [EXPR_VALUE_MIN, INT32_MAX]
+int expr_apply(long long a, Operator op, long long b, long long *out) {
+    switch (op) {
+        case OP_ADD: *out = a + b; break;
+        case OP_SUB: *out = a - b; break;
+        case OP_MUL: *out = a * b; break;
+        case OP_DIV:
+            if (b == 0 || a % b != 0) return 0;
+            *out = a / b;
+            break;
+        default: return 0;
+    }
+    return *out >= EXPR_VALUE_MIN && *out <= INT32_MAX;
+}
+
+// Run program over values (indexed by operand), returns 0 if a step is invalid.
+// If largest is non-NULL it is raised to the largest |value| pushed or computed.
+int expr_eval(const ExprProgram *program, const int *values, long long *out, long long *largest) {
+    long long stack[EXPR_MAX_OPERANDS];
+    int depth = 0;
+    
+    for (int k = 0; k < program->length; k++) {
+        int code = program->code[k];
+        long long value;
+        
+        if (code >= 0) {
+            value = values[code];
+        } else {
+            depth -= 2;
+            if (!expr_apply(stack[depth], (Operator)(-code - 1), stack[depth + 1], &value)) return 0;
+        }
+        
+        if (largest && llabs(value) > *largest) *largest = llabs(value);
+        stack[depth++] = value;
+    }
+    
+    *out = stack[0];
+    return depth == 1;
+}
+
+// 1 if values (P1..Pn) satisfy the equation exactly
+int expr_check(const Equation *equation, const int *values) {
+    long long left, right;
+    return expr_eval(&equation->sides[0], values, &left, NULL) &&
+           expr_eval(&equation->sides[1], values, &right, NULL) &&
+           left == right;
+}
+
+// Write the equation as the protocol sends it ("P1*P2=P3+P4"), with values
+// as the server logs it ("P1[6] * P2[4] = P3[20] + P4[4]"), or with values
+// and each operand's cell as a revealed solution ("P1[0,2]=6 * P2[3,1]=4 = ...")
+void expr_format(const Equation *equation, const int *values, const int *rows, const int *cols,
+                 char *buffer, size_t size) {
+    size_t offset = 0;
+    
+    buffer[0] = '\0';
+    for (int i = 0; i < equation->operand_count && offset < size; i++) {
+        if (i > 0) {
+            const char *op = (i == equation->split) ? "=" : get_operator_string(equation->ops[i - 1]);
+            offset += snprintf(buffer + offset, size - offset, values ? " %s " : "%s", op);
+            if (offset >= size) break;
+        }
+        if (values && rows && cols) {
+            offset += snprintf(buffer + offset, size - offset, "P%d[%d,%d]=%d", i + 1, rows[i], cols[i], values[i]);
+        } else if (values) {
+            offset += snprintf(buffer + offset, size - offset, "P%d[%d]", i + 1, values[i]);
+        } else {
+            offset += snprintf(buffer + offset, size - offset, "P%d", i + 1);
+        }
+    }
+}
@@ -1,14 +1,56 @@
 #include "server.h"
+#include <pthread.h>
+
+#define VALUE_POOL_MAX 1000  // Largest value range puzzle_fill_matrices samples from
+#define PARTIAL_SHUFFLE_MIN_POOL (2 * MATRIX_SIZE * MATRIX_SIZE)  // Smaller pools are shuffled whole per matrix
+#define DIVISOR_TABLE_SIZE (40 * 40 + 1)  // Covers every |P3 op P4| with round 4 operands (2..40)
+#define DIVISOR_BITS 64                   // Divisors 1..63 are tracked per entry
+#define PUZZLE_EQUATION_ATTEMPTS 16       // Redraws before accepting an equation that doesn't hold exactly
+#define PUZZLE_REPAIR_STEPS 48            // Decoy redraws per fill before the puzzle is redrawn
+#define PUZZLE_GENERATE_ATTEMPTS 4        // Whole puzzles drawn before keeping one over its bound
+
+// Most cell tuples a round's puzzles may ship with (rounds past the table use
+// the last). Uniqueness is out of reach: fills with few answers are the ones
+// short of small values (x1, /1, +-1 make answers), so below these bounds
+// the decoys of 1 and 2 fall 25-60% under a uniform draw and give the
+// planted cell away. These are about the tightest bounds that keep every decoy
+// value within 20% of uniform (tools/puzzle_bench checks both).
+static const int solution_bounds[PUZZLE_POOL_ROUNDS] = {256, 144, 192, 128, 56};
+
+// divisor_masks[n]: bit d set if d divides n (1 <= d < DIVISOR_BITS)
+static uint64_t divisor_masks[DIVISOR_TABLE_SIZE];
+static pthread_once_t divisor_masks_once = PTHREAD_ONCE_INIT;
+
+// Sieve the divisor table (once, from whichever thread generates first)
+static void divisor_masks_init(void) {
+    for (int d = 1; d < DIVISOR_BITS; d++) {
+        for (int n = d; n < DIVISOR_TABLE_SIZE; n += d) {
+            divisor_masks[n] |= 1ULL << d;
+        }
+    }
+}
 
 // Helper function to generate random number in range, excluding 0
-int rand_non_zero(int min_val, int max_val) {
+int rand_non_zero(Rng *rng, int min_val, int max_val) {
     int value;
     do {
-        value = (rand() % (max_val - min_val + 1)) + min_val;
+        value = rng_range(rng, min_val, max_val);
     } while (value == 0);
     return value;
 }
 
+// Random positive divisor of n (n != 0) up to max_val, so dividing n by it is exact
+static int rand_divisor(Rng *rng, int n, int max_val) {
+    int divisors[DIVISOR_BITS];
+    int count = 0;
+    int magnitude = abs(n);
+    
+    for (int d = 1; d <= magnitude && d <= max_val && count < DIVISOR_BITS; d++) {
+        if (magnitude % d == 0) divisors[count++] = d;
+    }
+    return count > 0 ? divisors[rng_below(rng, count)] : 1;
+}
+
 // Get operator string
 char* get_operator_string(Operator op) {
     switch (op) {
@@ -20,53 +62,33 @@ char* get_operator_string(Operator op) {
     }
 }
 
-// Apply operator
-int apply_operator(int a, Operator op, int b) {
-    switch (op) {
-        case OP_ADD: return a + b;
-        case OP_SUB: return a - b;
-        case OP_MUL: return a * b;
-        case OP_DIV: return (b != 0) ? a / b : a;
-        default: return a;
+// Draw the operands of a three-operand side "a op1 b op2 c" into v[0..2],
+// non-zero from [min_val, max_val], so that every division in it is exact
+static void puzzle_draw_side(Rng *rng, Operator op1, Operator op2, int min_val, int max_val, int v[3]) {
+    if (op1 == OP_DIV) {
+        // a / b op2 c: generate b and make a a multiple of it
+        v[1] = rand_non_zero(rng, min_val, max_val);
+        int quotient = rand_non_zero(rng, min_val, max_val);
+        v[0] = quotient * v[1];  // Ensures a / b = quotient (exact)
+        // (a / b) / c also needs c to divide the quotient
+        v[2] = (op2 == OP_DIV) ? rand_divisor(rng, quotient, max_val) : rand_non_zero(rng, min_val, max_val);
+    } else if (op2 == OP_DIV) {
+        // a op1 b / c: generate c and make b a multiple of it
+        v[0] = rand_non_zero(rng, min_val, max_val);
+        v[2] = rand_non_zero(rng, min_val, max_val);
+        int quotient = rand_non_zero(rng, min_val, max_val);
+        v[1] = quotient * v[2];  // Ensures b / c = quotient (exact)
+    } else {
+        // No division, can use simple random
+        v[0] = rand_non_zero(rng, min_val, max_val);
+        v[1] = rand_non_zero(rng, min_val, max_val);
+        v[2] = rand_non_zero(rng, min_val, max_val);
     }
 }
 
-// Calculate result based on operators
-// Format: P1 op1 P2 op2 P3 = result
-// Example: P1 - P2 * P3 = result (with proper precedence)
-int calculate_result(int p1, Operator op1, int p2, Operator op2, int p3) {
-    // Handle operator precedence: MUL and DIV have higher precedence
-    if (op2 == OP_MUL || op2 == OP_DIV) {
-        // Do op2 first (higher precedence)
-        int temp = (op2 == OP_MUL) ? (p2 * p3) : ((p3 != 0) ? (p2 / p3) : p2);
-        
-        // Then apply op1
-        if (op1 == OP_ADD) return p1 + temp;
-        else if (op1 == OP_SUB) return p1 - temp;
-        else if (op1 == OP_MUL) return p1 * temp;
-        else if (op1 == OP_DIV) return (temp != 0) ? (p1 / temp) : p1;
-        else return p1 + temp;
-    }
-    
-    // Otherwise, left to right evaluation
-    int temp;
-    if (op1 == OP_ADD) temp = p1 + p2;
-    else if (op1 == OP_SUB) temp = p1 - p2;
-    else if (op1 == OP_MUL) temp = p1 * p2;
-    else if (op1 == OP_DIV) temp = (p2 != 0) ? (p1 / p2) : p1;
-    else temp = p1 + p2;
-    
-    if (op2 == OP_ADD) return temp + p3;
-    else if (op2 == OP_SUB) return temp - p3;
-    else if (op2 == OP_MUL) return temp * p3;
-    else if (op2 == OP_DIV) return (p3 != 0) ? (temp / p3) : temp;
-    else return temp + p3;
-}
-
-// Generate random puzzle based on round difficulty
-void puzzle_generate(Puzzle *puzzle, int round) {
-    puzzle->round = round;
-    int p1, p2, p3, p4;
+// Pick operators and solution values for round; fill_low/fill_high get the
+// range puzzle_fill_matrices should draw decoys from
+static void puzzle_generate_equation(Puzzle *puzzle, int round, Rng *rng, int *fill_low, int *fill_high) {
     int min_val, max_val;
     int allow_negative = 0;
     
@@ -74,236 +96,326 @@ void puzzle_generate(Puzzle *puzzle, int round) {
     switch (round) {
         case 1: // Easy: Addition/Subtraction, format P1 ± P2 ± P3 = P4
             puzzle->format = FORMAT_P1_P2_P3_EQ_P4;
-            puzzle->op1 = rand() % 2;  // Only ADD or SUB
-            puzzle->op2 = rand() % 2;
+            puzzle->op1 = rng_below(rng, 2);  // Only ADD or SUB
+            puzzle->op2 = rng_below(rng, 2);
             min_val = 1; max_val = 50;
             break;
             
         case 2: // Medium: Add/Sub with larger numbers, format P1 ± P2 = P3 ± P4
             puzzle->format = FORMAT_P1_P2_EQ_P3_P4;
-            puzzle->op1 = rand() % 2;
-            puzzle->op2 = rand() % 2;
+            puzzle->op1 = rng_below(rng, 2);
+            puzzle->op2 = rng_below(rng, 2);
             min_val = 10; max_val = 80;
             break;
             
         case 3: // Hard: Include multiplication, format P1 = P2 * P3 ± P4
             puzzle->format = FORMAT_P1_EQ_P2_P3_P4;
             puzzle->op1 = OP_MUL;
-            puzzle->op2 = rand() % 2;  // ADD or SUB
+            puzzle->op2 = rng_below(rng, 2);  // ADD or SUB
             min_val = 2; max_val = 30;
             break;
             
         case 4: // Very Hard: Mixed operations, format P1 * P2 = P3 ± P4
             puzzle->format = FORMAT_P1_P2_EQ_P3_P4;
             puzzle->op1 = OP_MUL;
-            puzzle->op2 = rand() % 3;  // ADD, SUB, or MUL
+            puzzle->op2 = rng_below(rng, 3);  // ADD, SUB, or MUL
             min_val = 2; max_val = 40;
             break;
             
         case 5: // Expert: All operations including division, format P1 op1 P2 op2 P3 = P4
             puzzle->format = FORMAT_P1_P2_P3_EQ_P4;
-            puzzle->op1 = (rand() % 2) ? OP_MUL : OP_DIV;  // MUL or DIV
-            puzzle->op2 = rand() % 4;  // ADD, SUB, MUL, or DIV (0-3)
+            puzzle->op1 = rng_below(rng, 2) ? OP_MUL : OP_DIV;  // MUL or DIV
+            puzzle->op2 = rng_below(rng, 4);  // ADD, SUB, MUL, or DIV (0-3)
             min_val = -20; max_val = 50;
             allow_negative = 1;
             break;
             
         default:
             puzzle->format = FORMAT_P1_P2_P3_EQ_P4;
-            puzzle->op1 = rand() % 2;
-            puzzle->op2 = rand() % 2;
+            puzzle->op1 = rng_below(rng, 2);
+            puzzle->op2 = rng_below(rng, 2);
             min_val = 1; max_val = 50;
     }
     
-    // Generate values based on equation format
-    switch (puzzle->format) {
-        case FORMAT_P1_P2_P3_EQ_P4: // P1 op1 P2 op2 P3 = P4
-            // For division, need to ensure integer results
-            if (puzzle->op1 == OP_DIV) {
-                // P1 / P2 op2 P3 = P4
-                // Generate P2 and make P1 a multiple of P2
-                p2 = rand_non_zero(min_val, max_val);
-                int quotient = rand_non_zero(min_val, max_val);
-                p1 = quotient * p2;  // Ensures P1 / P2 = quotient (exact)
-                p3 = rand_non_zero(min_val, max_val);
-            } else if (puzzle->op2 == OP_DIV) {
-                // P1 op1 P2 / P3 = P4
-                // Generate P3 and make P2 a multiple of P3
-                p1 = rand_non_zero(min_val, max_val);
-                p3 = rand_non_zero(min_val, max_val);
-                int quotient = rand_non_zero(min_val, max_val);
-                p2 = quotient * p3;  // Ensures P2 / P3 = quotient (exact)
-            } else {
-                // No division, can use simple random
-                p1 = rand_non_zero(min_val, max_val);
-                p2 = rand_non_zero(min_val, max_val);
-                p3 = rand_non_zero(min_val, max_val);
-            }
-            // Use calculate_result to handle operator precedence correctly
-            p4 = calculate_result(p1, puzzle->op1, p2, puzzle->op2, p3);
-            break;
-            
-        case FORMAT_P1_EQ_P2_P3_P4: // P1 = P2 op1 P3 op2 P4
-            // For division, need to ensure integer results
-            if (puzzle->op1 == OP_DIV) {
-                // P1 = P2 / P3 op2 P4
-                // Generate P3 and make P2 a multiple of P3
-                p3 = rand_non_zero(min_val, max_val);
-                int quotient = rand_non_zero(min_val, max_val);
-                p2 = quotient * p3;  // Ensures P2 / P3 = quotient (exact)
-                p4 = rand_non_zero(min_val, max_val);
-            } else if (puzzle->op2 == OP_DIV) {
-                // P1 = P2 op1 P3 / P4
-                // Generate P4 and make P3 a multiple of P4
-                p2 = rand_non_zero(min_val, max_val);
-                p4 = rand_non_zero(min_val, max_val);
-                int quotient = rand_non_zero(min_val, max_val);
-                p3 = quotient * p4;  // Ensures P3 / P4 = quotient (exact)
+    // Generate values through the compiled equation: draw the operands one
+    // side is computed from, then evaluate it for the rest
+    expr_compile_format(&puzzle->equation, puzzle->format, puzzle->op1, puzzle->op2);
+    const Equation *equation = &puzzle->equation;
+    int *values = puzzle->solution_values;
+    int count = equation->operand_count;
+    long long side_value;
+    
+    if (equation->split == 1 || equation->split == count - 1) {
+        // P1 op1 P2 op2 P3 = P4 or P1 = P2 op1 P3 op2 P4: the operand alone on
+        // its side is the value of the other side
+        int first = equation->split == 1 ? 1 : 0;
+        int lone = first ? 0 : count - 1;
+        puzzle_draw_side(rng, equation->ops[first], equation->ops[first + 1], min_val, max_val, values + first);
+        values[lone] = expr_eval(&equation->sides[first], values, &side_value, NULL) ? (int)side_value : 0;
+    } else {
+        // P1 op1 P2 = P3 op2 P4: evaluate the right side, then solve the left for P2
+        values[2] = rand_non_zero(rng, min_val, max_val);
+        values[3] = rand_non_zero(rng, min_val, max_val);
+        int right_side = expr_eval(&equation->sides[1], values, &side_value, NULL) ? (int)side_value : 0;
+        
+        if (puzzle->op1 == OP_ADD) {
+            // P1 + P2 = right_side
+            values[0] = rand_non_zero(rng, min_val, max_val);
+            values[1] = right_side - values[0];
+        } else if (puzzle->op1 == OP_SUB) {
+            // P1 - P2 = right_side => P2 = P1 - right_side
+            values[0] = rand_non_zero(rng, min_val, max_val);
+            values[1] = values[0] - right_side;
+        } else if (puzzle->op1 == OP_MUL) {
+            // P1 * P2 = right_side
+            // Generate P1 first, then calculate P2 = right_side / P1
+            // To ensure integer division, make sure right_side is divisible by P1
+            if (right_side == 0) {
+                values[0] = 1;
+                values[1] = 0;
             } else {
-                // No division, can use simple random
-                p2 = rand_non_zero(min_val, max_val);
-                p3 = rand_non_zero(min_val, max_val);
-                p4 = rand_non_zero(min_val, max_val);
-            }
-            // Use calculate_result to handle operator precedence correctly
-            p1 = calculate_result(p2, puzzle->op1, p3, puzzle->op2, p4);
-            break;
-            
-        case FORMAT_P1_P2_EQ_P3_P4: // P1 op1 P2 = P3 op2 P4
-            p3 = rand_non_zero(min_val, max_val);
-            p4 = rand_non_zero(min_val, max_val);
-            
-            // Calculate right side: P3 op2 P4
-            int right_side = apply_operator(p3, puzzle->op2, p4);
-            
-            // Generate P1 and P2 to ensure equation has integer solution
-            if (puzzle->op1 == OP_ADD) {
-                // P1 + P2 = right_side
-                p1 = rand_non_zero(min_val, max_val);
-                p2 = right_side - p1;  // P2 = right_side - P1
-            } else if (puzzle->op1 == OP_SUB) {
-                // P1 - P2 = right_side => P2 = P1 - right_side
-                p1 = rand_non_zero(min_val, max_val);
-                p2 = p1 - right_side;
-            } else if (puzzle->op1 == OP_MUL) {
-                // P1 * P2 = right_side
-                // Generate P1 first, then calculate P2 = right_side / P1
-                // To ensure integer division, make sure right_side is divisible by P1
-                if (right_side == 0) {
-                    p1 = 1;
-                    p2 = 0;
+                // Find a divisor of right_side as P1
+                int divisors[100];
+                int div_count = 0;
+                int magnitude = abs(right_side);
+                if (magnitude < DIVISOR_TABLE_SIZE && min_val >= 1 && max_val < DIVISOR_BITS) {
+                    // Table lookup, masked to [min_val, max_val] (ascending, same order as the scan)
+                    pthread_once(&divisor_masks_once, divisor_masks_init);
+                    uint64_t in_range = ((2ULL << max_val) - 1) & ~((1ULL << min_val) - 1);
+                    uint64_t mask = divisor_masks[magnitude] & in_range;
+                    while (mask) {
+                        divisors[div_count++] = __builtin_ctzll(mask);
+                        mask &= mask - 1;
+                    }
                 } else {
-                    // Find a divisor of right_side as P1
-                    int divisors[100];
-                    int div_count = 0;
-                    for (int d = 1; d <= abs(right_side) && div_count < 100; d++) {
+                    for (int d = 1; d <= magnitude && div_count < 100; d++) {
                         if (right_side % d == 0) {
                             if (d >= min_val && d <= max_val) {
                                 divisors[div_count++] = d;
                             }
                         }
                     }
-                    if (div_count > 0) {
-                        p1 = divisors[rand() % div_count];
-                        p2 = right_side / p1;
-                    } else {
-                        // Fallback: just pick random (non-zero)
-                        p1 = rand_non_zero(min_val, max_val);
-                        p2 = right_side / p1;
-                    }
                 }
-            } else { // OP_DIV
-                // P1 / P2 = right_side => P1 = right_side * P2
-                // Generate P2 first, then calculate P1
-                p2 = rand_non_zero(min_val, max_val);
-                p1 = right_side * p2;  // This ensures P1 / P2 = right_side exactly
+                if (div_count > 0) {
+                    values[0] = divisors[rng_below(rng, div_count)];
+                } else {
+                    // Fallback: just pick random (non-zero), the check in puzzle_generate redraws if inexact
+                    values[0] = rand_non_zero(rng, min_val, max_val);
+                }
+                values[1] = right_side / values[0];
             }
-            break;
+        } else { // OP_DIV
+            // P1 / P2 = right_side => P1 = right_side * P2
+            values[1] = rand_non_zero(rng, min_val, max_val);
+            values[0] = right_side * values[1];  // This ensures P1 / P2 = right_side exactly
+        }
     }
     
-    // Ensure no solution value is 0 (adjust if needed)
-    if (p1 == 0) p1 = 1;
-    if (p2 == 0) p2 = 1;
-    if (p3 == 0) p3 = 1;
-    if (p4 == 0) p4 = 1;
-    
-    // Store solution values
-    puzzle->solution_values[0] = p1;
-    puzzle->solution_values[1] = p2;
-    puzzle->solution_values[2] = p3;
-    puzzle->solution_values[3] = p4;
-    puzzle->result = (puzzle->format == FORMAT_P1_EQ_P2_P3_P4) ? p1 : p4;
+    // Ensure no solution value is 0 (a clamped equation no longer holds and is redrawn)
+    for (int i = 0; i < count; i++) {
+        if (values[i] == 0) values[i] = 1;
+    }
+    puzzle->result = values[equation->split == 1 ? 0 : count - 1];
     
     // Generate matrices with UNIQUE random numbers (no duplicates, no zero)
+    // Non-negative rounds draw decoys from 1..max_val, not just the operand range
+    *fill_low = allow_negative ? min_val : 1;
+    *fill_high = max_val;
+}
+
+// Most cell tuples a round's puzzles are repaired down to (>= 1)
+int puzzle_solution_bound(int round) {
+    if (round < 1) round = 1;
+    if (round > PUZZLE_POOL_ROUNDS) round = PUZZLE_POOL_ROUNDS;
+    return solution_bounds[round - 1];
+}
+
+// Redraw the decoy that takes part in the most alternate answers, one cell
+// per step, until at most bound tuples solve the puzzle or the step budget
+// runs out. The new value is uniform over [low, high] minus the values
+// already in that matrix. tuples is the puzzle's answer set from
+// puzzle_solve(), kept up to date. Returns 1 if the puzzle is within bound.
+static int puzzle_repair(Puzzle *puzzle, uint64_t tuples[PUZZLE_TUPLE_WORDS], Rng *rng,
+                         int low, int high, int bound) {
+    if (high - low + 1 - (low <= 0 && high >= 0) <= MATRIX_SIZE * MATRIX_SIZE) {
+        return puzzle->solution_count <= bound;  // No value left to redraw a decoy to
+    }
+    
+    for (int step = 0; step < PUZZLE_REPAIR_STEPS && puzzle->solution_count > bound; step++) {
+        int uses[PLAYERS_PER_ROOM][MATRIX_SIZE * MATRIX_SIZE] = {{0}};
+        for (int w = 0; w < PUZZLE_TUPLE_WORDS; w++) {
+            for (uint64_t bits = tuples[w]; bits; bits &= bits - 1) {
+                int index = w * 64 + __builtin_ctzll(bits);
+                for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+                    uses[m][(index >> (4 * (PLAYERS_PER_ROOM - 1 - m))) & 15]++;
+                }
+            }
+        }
+        
+        int matrix = -1, cell = 0, most = 0;
+        for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+            int planted = puzzle->solution_row[m] * MATRIX_SIZE + puzzle->solution_col[m];
+            for (int c = 0; c < MATRIX_SIZE * MATRIX_SIZE; c++) {
+                if (c != planted && uses[m][c] > most) {
+                    most = uses[m][c];
+                    matrix = m;
+                    cell = c;
+                }
+            }
+        }
+        if (matrix < 0) break;  // Only the planted cells are left in play
+        
+        const int *cells = &puzzle->matrices[matrix].data[0][0];
+        int value;
+        int used;
+        do {
+            value = rand_non_zero(rng, low, high);
+            used = 0;
+            for (int c = 0; c < MATRIX_SIZE * MATRIX_SIZE; c++) {
+                used |= cells[c] == value;
+            }
+        } while (used);
+        puzzle->matrices[matrix].data[cell / MATRIX_SIZE][cell % MATRIX_SIZE] = value;
+        puzzle->solution_count = puzzle_solve(puzzle, tuples);
+    }
+    return puzzle->solution_count <= bound;
+}
+
+// Generate random puzzle based on round difficulty
+// Uses only its own generator seeded from seed, so it is thread-safe and the
+// puzzle can be regenerated from (round, seed) on replay.
+// The solver vets each candidate: an equation whose planted values don't hold
+// exactly (inexact division, zero clamp) is redrawn, and a fill with more
+// answers than the round's bound is repaired decoy by decoy. A puzzle the
+// repair can't bring within bound is redrawn whole; after
+// PUZZLE_GENERATE_ATTEMPTS the last one is kept, whatever its count, so the
+// fill is never chosen by its number of answers.
+void puzzle_generate(Puzzle *puzzle, int round, unsigned int seed) {
+    Rng rng;
+    rng_seed(&rng, seed, 0);
+    puzzle->seed = seed;
+    puzzle->round = round;
+    puzzle->difficulty = 0;
+    int bound = puzzle_solution_bound(round);
+    uint64_t tuples[PUZZLE_TUPLE_WORDS];  // Answer set, only the repair needs it
+    
+    for (int attempt = 0; attempt < PUZZLE_GENERATE_ATTEMPTS; attempt++) {
+        int fill_low, fill_high;
+        for (int draw = 0; draw < PUZZLE_EQUATION_ATTEMPTS; draw++) {
+            puzzle_generate_equation(puzzle, round, &rng, &fill_low, &fill_high);
+            if (puzzle_check_values(puzzle, puzzle->solution_values)) break;
+        }
+        
+        puzzle_fill_matrices(puzzle, &rng, fill_low, fill_high);
+        puzzle->solution_count = puzzle_solve(puzzle, tuples);
+        if (puzzle_repair(puzzle, tuples, &rng, fill_low, fill_high, bound)) break;
+    }
+}
+
+// Small pools: build and shuffle the whole pool for every matrix and overwrite
+// a random cell with the solution, as the original generator did
+static void puzzle_fill_shuffled(Puzzle *puzzle, Rng *rng, int low, int high) {
     for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
         int solution_value = puzzle->solution_values[m];
-        int available_numbers[1000];  // Pool of available numbers
+        int pool[VALUE_POOL_MAX];
         int pool_size = 0;
         
-        // Create pool of numbers (excluding the solution value and zero to avoid duplicates)
-        if (allow_negative) {
-            for (int n = min_val; n <= max_val; n++) {
-                if (n != solution_value && n != 0) {  // Exclude 0
-                    available_numbers[pool_size++] = n;
-                }
-            }
-        } else {
-            for (int n = 1; n <= max_val; n++) {  // Already starts from 1, no 0
-                if (n != solution_value) {
-                    available_numbers[pool_size++] = n;
-                }
+        for (int n = low; n <= high && pool_size < VALUE_POOL_MAX; n++) {
+            if (n != solution_value && n != 0) {
+                pool[pool_size++] = n;
             }
         }
         
-        // Shuffle the pool using Fisher-Yates algorithm
         for (int i = pool_size - 1; i > 0; i--) {
-            int j = rand() % (i + 1);
-            int temp = available_numbers[i];
-            available_numbers[i] = available_numbers[j];
-            available_numbers[j] = temp;
+            int j = rng_below(rng, i + 1);
+            int temp = pool[i];
+            pool[i] = pool[j];
+            pool[j] = temp;
         }
         
-        // Fill matrix with unique numbers from shuffled pool
-        int pool_idx = 0;
-        for (int i = 0; i < MATRIX_SIZE; i++) {
-            for (int j = 0; j < MATRIX_SIZE; j++) {
-                if (pool_idx < pool_size) {
-                    puzzle->matrices[m].data[i][j] = available_numbers[pool_idx++];
-                } else {
-                    // Fallback if pool exhausted (shouldn't happen with large enough pool)
-                    puzzle->matrices[m].data[i][j] = (rand() % (max_val - min_val + 1)) + min_val;
-                }
-            }
+        // Fallback if pool exhausted (range smaller than a matrix)
+        while (pool_size < MATRIX_SIZE * MATRIX_SIZE) {
+            pool[pool_size++] = rand_non_zero(rng, low, high);
         }
+        memcpy(puzzle->matrices[m].data, pool, sizeof(puzzle->matrices[m].data));
         
-        // Place solution value at random position (overwrite one number)
-        puzzle->solution_row[m] = rand() % MATRIX_SIZE;
-        puzzle->solution_col[m] = rand() % MATRIX_SIZE;
+        puzzle->solution_row[m] = rng_below(rng, MATRIX_SIZE);
+        puzzle->solution_col[m] = rng_below(rng, MATRIX_SIZE);
         puzzle->matrices[m].data[puzzle->solution_row[m]][puzzle->solution_col[m]] = solution_value;
     }
+}
+
+// Fill each matrix with distinct non-zero values from [low, high] and put the
+// player's solution value at a random cell. The candidate pool is built once
+// and shared by all four matrices (it stays a permutation of the range); each
+// matrix then runs a partial Fisher-Yates over just the 15 cells it needs.
+// A drawn solution value is swapped out past the sampled range instead.
+// Cost is O(range + 4 * 16) rather than O(4 * range), but a partial draw
+// costs about twice a full-shuffle step, so pools under
+// PARTIAL_SHUFFLE_MIN_POOL (round 3) keep the full shuffle, which is no slower there.
+void puzzle_fill_matrices(Puzzle *puzzle, Rng *rng, int low, int high) {
+    if (high - low + 1 - (low <= 0 && high >= 0) < PARTIAL_SHUFFLE_MIN_POOL) {
+        puzzle_fill_shuffled(puzzle, rng, low, high);
+        return;
+    }
     
-    // Print puzzle based on actual format
-    printf("Round %d puzzle generated (format %d): ", round, puzzle->format);
-    switch (puzzle->format) {
-        case FORMAT_P1_P2_P3_EQ_P4:
-            printf("P1[%d] %s P2[%d] %s P3[%d] = P4[%d]\n",
-                   puzzle->solution_values[0], get_operator_string(puzzle->op1),
-                   puzzle->solution_values[1], get_operator_string(puzzle->op2),
-                   puzzle->solution_values[2], puzzle->solution_values[3]);
-            break;
-        case FORMAT_P1_EQ_P2_P3_P4:
-            printf("P1[%d] = P2[%d] %s P3[%d] %s P4[%d]\n",
-                   puzzle->solution_values[0], puzzle->solution_values[1],
-                   get_operator_string(puzzle->op1), puzzle->solution_values[2],
-                   get_operator_string(puzzle->op2), puzzle->solution_values[3]);
-            break;
-        case FORMAT_P1_P2_EQ_P3_P4:
-            printf("P1[%d] %s P2[%d] = P3[%d] %s P4[%d]\n",
-                   puzzle->solution_values[0], get_operator_string(puzzle->op1),
-                   puzzle->solution_values[1], puzzle->solution_values[2],
-                   get_operator_string(puzzle->op2), puzzle->solution_values[3]);
-            break;
+    int pool[VALUE_POOL_MAX];
+    int pool_size = 0;
+    
+    for (int n = low; n <= high && pool_size < VALUE_POOL_MAX; n++) {
+        if (n != 0) {
+            pool[pool_size++] = n;
+        }
     }
+    
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        int solution_value = puzzle->solution_values[m];
+        int limit = pool_size;
+        
+        int cell = rng_below(rng, MATRIX_SIZE * MATRIX_SIZE);
+        int row = cell / MATRIX_SIZE;
+        int col = cell % MATRIX_SIZE;
+        puzzle->solution_row[m] = row;
+        puzzle->solution_col[m] = col;
+        
+        int taken = 0;
+        for (int i = 0; i < MATRIX_SIZE; i++) {
+            for (int j = 0; j < MATRIX_SIZE; j++) {
+                if (i == row && j == col) {
+                    puzzle->matrices[m].data[i][j] = solution_value;
+                    continue;
+                }
+                
+                int value = 0;
+                while (taken < limit) {
+                    int pick = taken + rng_below(rng, limit - taken);
+                    value = pool[pick];
+                    if (value != solution_value) {
+                        pool[pick] = pool[taken];
+                        pool[taken++] = value;
+                        break;
+                    }
+                    
+                    // Park the solution value at the end, out of this matrix's draws
+                    limit--;
+                    pool[pick] = pool[limit];
+                    pool[limit] = value;
+                    value = 0;
+                }
+                
+                // Fallback if pool exhausted (range smaller than a matrix)
+                puzzle->matrices[m].data[i][j] = value ? value : rand_non_zero(rng, low, high);
+            }
+        }
+    }
+}
+
+// Print puzzle solution to server log
+void puzzle_print(const Puzzle *puzzle) {
+    char equation[256];
+    expr_format(&puzzle->equation, puzzle->solution_values, NULL, NULL, equation, sizeof(equation));
+    log_write(LOG_INFO, LOG_PUZZLE, "Round %d puzzle generated (format %d): %s, %d valid cell combinations, difficulty %d",
+              puzzle->round, puzzle->format, equation, puzzle->solution_count, puzzle->difficulty);
 }
 
 // Send puzzle to clients (asymmetric information)
@@ -324,29 +436,9 @@ void puzzle_send_to_clients(Server *server, int room_id) {
         // Format: GAME_START|equation|matrix0|matrix1|matrix2|matrix3
         // matrix format: 16 numbers separated by commas (or HIDDEN)
         
-        // Build equation string based on format
+        // Build equation string from the compiled equation
         char equation[128];
-        switch (puzzle->format) {
-            case FORMAT_P1_P2_P3_EQ_P4:
-                snprintf(equation, sizeof(equation), "P1%sP2%sP3=P4",
-                        get_operator_string(puzzle->op1),
-                        get_operator_string(puzzle->op2));
-                break;
-            case FORMAT_P1_EQ_P2_P3_P4:
-                snprintf(equation, sizeof(equation), "P1=P2%sP3%sP4",
-                        get_operator_string(puzzle->op1),
-                        get_operator_string(puzzle->op2));
-                break;
-            case FORMAT_P1_P2_EQ_P3_P4:
-                snprintf(equation, sizeof(equation), "P1%sP2=P3%sP4",
-                        get_operator_string(puzzle->op1),
-                        get_operator_string(puzzle->op2));
-                break;
-            default:
-                snprintf(equation, sizeof(equation), "P1%sP2%sP3=P4",
-                        get_operator_string(puzzle->op1),
-                        get_operator_string(puzzle->op2));
-        }
+        expr_format(&puzzle->equation, NULL, NULL, NULL, equation, sizeof(equation));
         
         offset += snprintf(buffer + offset, sizeof(buffer) - offset,
                          "GAME_START|%s", equation);
@@ -379,28 +471,74 @@ void puzzle_send_to_clients(Server *server, int room_id) {
                          room->current_round, room->total_rounds);
         
         client_send(client, buffer);
-        printf("Sent puzzle to player %d (hiding matrix %d)\n", player, player);
+        log_write(LOG_DEBUG, LOG_GAME, "Sent puzzle to player %d (hiding matrix %d)", player, player);
     }
 }
 
+// Move a seated player to state; one waiting to reconnect gets it as the state it resumes in
+static void room_set_player_state(Client *client, ClientState state) {
+    if (client->state == STATE_DISCONNECTED) {
+        client->saved_state = state;
+    } else {
+        client->state = state;
+    }
+}
+
+// Ask the pool thread to build the puzzle of room's next round (1..total)
+// now, from a seed drawn off the room's generator, so round start collects it
+// instead of generating on the event loop. Not needed when the bank will
+// serve the round. A newer request replaces an older one.
+void room_request_puzzle(Room *room, int round) {
+    room->next_round = 0;
+    room->next_ticket = 0;
+    if (puzzle_bank_available(round, &room->bank_cursor)) return;
+    
+    room->next_round = round;
+    room->next_seed = rng_next(&room->rng);
+    room->next_ticket = puzzle_pool_request(room->id, round, room->next_seed);
+}
+
 // Start game in room
 void room_start_game(Server *server, int room_id) {
     Room *room = &server->rooms[room_id];
+    long long start_ns = time_now_ns();
     
     // Initialize round system on first start
     if (!room->game_started) {
         room->current_round = 1;
         room->total_rounds = 5;
+        trace_begin_game(room, start_ns);
     }
+    room->trace_round_ns = start_ns;
     
-    printf("Starting game in room %d, round %d/%d\n", room_id, room->current_round, room->total_rounds);
+    log_write(LOG_INFO, LOG_GAME, "Starting game in room %d, round %d/%d", room_id, room->current_round, room->total_rounds);
     
     // Generate puzzle for current round
-    puzzle_generate(&room->puzzle, room->current_round);
+    // Prefer the offline bank, then the puzzle requested for this round, then a
+    // pooled one; generate synchronously only if none is ready. The requested
+    // seed is used either way, so a fixed PUZZLE_SEED gives the same puzzle
+    // whether or not the pool thread finished it in time.
+    long long puzzle_ns = time_now_ns();
+    int requested = room->next_round == room->current_round;
+    const char *source = "puzzle_bank_take";
+    if (!puzzle_bank_take(room->current_round, &room->bank_cursor, &room->puzzle)) {
+        source = "puzzle_pool_collect";
+        if (!requested || !puzzle_pool_collect(room_id, room->next_ticket, &room->puzzle)) {
+            source = "puzzle_pool_take";
+            if (!puzzle_pool_take(room->current_round, &room->puzzle)) {
+                source = "puzzle_generate";
+                puzzle_generate(&room->puzzle, room->current_round, requested ? room->next_seed : rng_next(&room->rng));
+            }
+        }
+    }
+    trace_span(room, source, puzzle_ns, NULL, 0);
+    room_request_puzzle(room, room->current_round < room->total_rounds ? room->current_round + 1 : 1);
+    puzzle_print(&room->puzzle);
     
     // Initialize game state
     room->game_started = 1;
     room->game_start_time = time(NULL);
+    room->round_start_ms = time_now_ms();
     room->game_time_remaining = GAME_DURATION;
     room->all_submitted = 0;
     room->waiting_for_continue = 0;  // Reset waiting state when starting new round
@@ -410,19 +548,42 @@ void room_start_game(Server *server, int room_id) {
         room->round_continue_ready[i] = 0;  // Reset continue ready flags
         int client_idx = room->player_ids[i];
         if (client_idx >= 0) {
-            server->clients[client_idx].state = STATE_IN_GAME;
+            room_set_player_state(&server->clients[client_idx], STATE_IN_GAME);
         }
     }
     
     // Send puzzle to all players
+    long long send_ns = time_now_ns();
     puzzle_send_to_clients(server, room_id);
+    trace_span(room, "puzzle_send_to_clients", send_ns, NULL, 0);
+    trace_span(room, "room_start_game", start_ns, NULL, 0);
+    metrics_latency_since(METRIC_LATENCY_ROOM_START_GAME, start_ns);
 }
 
 // End game in room
 void room_end_game(Server *server, int room_id, int won, int timeout) {
     Room *room = &server->rooms[room_id];
+    long long start_ns = time_now_ns();
+    
+    log_write(LOG_INFO, LOG_GAME, "Ending round %d in room %d, result: %s", room->current_round, room_id, won ? "WIN" : "LOSE");
     
-    printf("Ending round %d in room %d, result: %s\n", room->current_round, room_id, won ? "WIN" : "LOSE");
+    matchlog_record_round(server, room_id, won, timeout);
+    metrics_count(won ? METRIC_ROUNDS_WON : timeout ? METRIC_ROUNDS_TIMED_OUT : METRIC_ROUNDS_LOST, 1);
+    metrics_observe(METRIC_ROUND_DURATION, time_now_ms() - room->round_start_ms);
+    
+    // Update player statistics (game is over on a loss or after the last round)
+    int game_over = !won || room->current_round >= room->total_rounds;
+    for (int i = 0; i < PLAYERS_PER_ROOM; i++) {
+        int client_idx = room->player_ids[i];
+        if (client_idx < 0) continue;
+        
+        const char *username = server->clients[client_idx].username;
+        long long solve_ms = room->answer_submitted[i] ? room->submit_ms[i] - room->round_start_ms : 0;
+        stats_record_round(username, room->current_round, won, solve_ms);
+        if (game_over) {
+            stats_record_game(username, won);
+        }
+    }
     
     char msg[512];
     if (won) {
@@ -439,7 +600,10 @@ void room_end_game(Server *server, int room_id, int won, int timeout) {
                 room->round_continue_ready[i] = 0;
             }
             
-            printf("Waiting for all players to continue to round %d\n", room->current_round + 1);
+            log_write(LOG_INFO, LOG_GAME, "Waiting for all players to continue to round %d", room->current_round + 1);
+            trace_span(room, "room_end_game", start_ns, "won", won);
+            trace_async(room, "round", room->trace_round_ns);
+            room->trace_wait_ns = time_now_ns();
             return;  // Don't start next round yet, wait for READY_NEXT_ROUND from all players
         } else {
             // All rounds completed - player wins!
@@ -447,58 +611,31 @@ void room_end_game(Server *server, int room_id, int won, int timeout) {
                     room->total_rounds);
         }
     } else {
-        // Show the correct solution with reason based on equation format
+        // Show the correct solution (planted cells, from the compiled equation) with the reason
         const char *reason = timeout ? "Time's up!" : "Wrong answer!";
         char solution[256];
-        
-        switch (room->puzzle.format) {
-            case FORMAT_P1_P2_P3_EQ_P4:
-                snprintf(solution, sizeof(solution),
-                        "P1[%d,%d]=%d %s P2[%d,%d]=%d %s P3[%d,%d]=%d = P4[%d,%d]=%d",
-                        room->puzzle.solution_row[0], room->puzzle.solution_col[0], room->puzzle.solution_values[0],
-                        get_operator_string(room->puzzle.op1),
-                        room->puzzle.solution_row[1], room->puzzle.solution_col[1], room->puzzle.solution_values[1],
-                        get_operator_string(room->puzzle.op2),
-                        room->puzzle.solution_row[2], room->puzzle.solution_col[2], room->puzzle.solution_values[2],
-                        room->puzzle.solution_row[3], room->puzzle.solution_col[3], room->puzzle.solution_values[3]);
-                break;
-                
-            case FORMAT_P1_EQ_P2_P3_P4:
-                snprintf(solution, sizeof(solution),
-                        "P1[%d,%d]=%d = P2[%d,%d]=%d %s P3[%d,%d]=%d %s P4[%d,%d]=%d",
-                        room->puzzle.solution_row[0], room->puzzle.solution_col[0], room->puzzle.solution_values[0],
-                        room->puzzle.solution_row[1], room->puzzle.solution_col[1], room->puzzle.solution_values[1],
-                        get_operator_string(room->puzzle.op1),
-                        room->puzzle.solution_row[2], room->puzzle.solution_col[2], room->puzzle.solution_values[2],
-                        get_operator_string(room->puzzle.op2),
-                        room->puzzle.solution_row[3], room->puzzle.solution_col[3], room->puzzle.solution_values[3]);
-                break;
-                
-            case FORMAT_P1_P2_EQ_P3_P4:
-                snprintf(solution, sizeof(solution),
-                        "P1[%d,%d]=%d %s P2[%d,%d]=%d = P3[%d,%d]=%d %s P4[%d,%d]=%d",
-                        room->puzzle.solution_row[0], room->puzzle.solution_col[0], room->puzzle.solution_values[0],
-                        get_operator_string(room->puzzle.op1),
-                        room->puzzle.solution_row[1], room->puzzle.solution_col[1], room->puzzle.solution_values[1],
-                        room->puzzle.solution_row[2], room->puzzle.solution_col[2], room->puzzle.solution_values[2],
-                        get_operator_string(room->puzzle.op2),
-                        room->puzzle.solution_row[3], room->puzzle.solution_col[3], room->puzzle.solution_values[3]);
-                break;
-        }
+        expr_format(&room->puzzle.equation, room->puzzle.solution_values, room->puzzle.solution_row,
+                    room->puzzle.solution_col, solution, sizeof(solution));
         
         snprintf(msg, sizeof(msg), "GAME_END|LOSE|%s|%s\n", reason, solution);
     }
     
     room_broadcast(server, room_id, msg, -1);
+    trace_span(room, "room_end_game", start_ns, "won", won);
+    trace_async(room, "round", room->trace_round_ns);
+    trace_async(room, "game", room->trace_game_ns);
     
     // Reset room state
     room->game_started = 0;
     room->current_round = 0;
+    if (room->next_round != 1) {
+        room_request_puzzle(room, 1);
+    }
     for (int i = 0; i < PLAYERS_PER_ROOM; i++) {
         room->player_ready[i] = 0;
         int client_idx = room->player_ids[i];
         if (client_idx >= 0) {
-            server->clients[client_idx].state = STATE_IN_ROOM;
+            room_set_player_state(&server->clients[client_idx], STATE_IN_ROOM);
         }
     }
     
@@ -507,23 +644,28 @@ void room_end_game(Server *server, int room_id, int won, int timeout) {
 }
 
 // Verify solution
-int puzzle_verify_solution(Puzzle *puzzle, int submitted[PLAYERS_PER_ROOM][2]) {
-    // Check if submitted coordinates match solution
+int puzzle_verify_solution(const Puzzle *puzzle, int submitted[PLAYERS_PER_ROOM][2]) {
+    // Any cells whose values satisfy the equation are correct, not just the
+    // planted ones. The compiled equation is what the solver runs too, so
+    // this accepts exactly the tuples it counted
+    int values[PLAYERS_PER_ROOM];
     for (int i = 0; i < PLAYERS_PER_ROOM; i++) {
         int row = submitted[i][0];
         int col = submitted[i][1];
         
-        if (row != puzzle->solution_row[i] || col != puzzle->solution_col[i]) {
+        if (row < 0 || row >= MATRIX_SIZE || col < 0 || col >= MATRIX_SIZE) {
             return 0;  // Wrong answer
         }
+        values[i] = puzzle->matrices[i].data[row][col];
     }
     
-    return 1;  // Correct!
+    return puzzle_check_values(puzzle, values);
 }
 
 // Handle submit answer
 void handle_submit(Server *server, int client_idx, int row, int col) {
     Client *client = &server->clients[client_idx];
+    long long start_ns = time_now_ns();
     
     if (client->state != STATE_IN_GAME) {
         client_send(client, "ERROR|Not in game\n");
@@ -544,8 +686,9 @@ void handle_submit(Server *server, int client_idx, int row, int col) {
     room->submitted_answers[player_idx][0] = row;
     room->submitted_answers[player_idx][1] = col;
     room->answer_submitted[player_idx] = 1;
+    room->submit_ms[player_idx] = time_now_ms();
     
-    printf("Player %s submitted answer: [%d,%d]\n", client->username, row, col);
+    log_write(LOG_INFO, LOG_GAME, "Player %s submitted answer: [%d,%d]", client->username, row, col);
     
     // Notify all players
     char msg[128];
@@ -567,6 +710,7 @@ void handle_submit(Server *server, int client_idx, int row, int col) {
         int correct = puzzle_verify_solution(&room->puzzle, room->submitted_answers);
         room_end_game(server, room_id, correct, 0);  // 0 = not timeout
     }
+    trace_span(room, "handle_submit", start_ns, "slot", player_idx);
 }
 
 // Broadcast timer update
@@ -578,9 +722,27 @@ void broadcast_timer_update(Server *server, int room_id) {
     room_broadcast(server, room_id, msg, -1);
 }
 
+// Send the player its planted answer cell: DEBUG_ANSWER|row|col (debug hooks only)
+void handle_debug_answer(Server *server, int client_idx) {
+    Client *client = &server->clients[client_idx];
+    
+    if (client->state != STATE_IN_GAME || client->room_id < 0) {
+        client_send(client, "ERROR|Not in game\n");
+        return;
+    }
+    
+    Puzzle *puzzle = &server->rooms[client->room_id].puzzle;
+    int player = client->player_index;
+    
+    char msg[64];
+    snprintf(msg, sizeof(msg), "DEBUG_ANSWER|%d|%d\n", puzzle->solution_row[player], puzzle->solution_col[player]);
+    client_send(client, msg);
+}
+
 // Handle player ready for next round
 void handle_ready_next_round(Server *server, int client_idx) {
     Client *client = &server->clients[client_idx];
+    long long start_ns = time_now_ns();
     
     if (client->state != STATE_IN_GAME && client->state != STATE_IN_ROOM) {
         client_send(client, "ERROR|Not in a game\n");
@@ -603,13 +765,13 @@ void handle_ready_next_round(Server *server, int client_idx) {
     
     // Mark player as ready for next round
     if (room->round_continue_ready[player_index]) {
-        printf("Player %s already ready for next round\n", client->username);
+        log_write(LOG_DEBUG, LOG_GAME, "Player %s already ready for next round", client->username);
         return;
     }
     
     room->round_continue_ready[player_index] = 1;
-    printf("Player %s ready for next round (%d/%d)\n", 
-           client->username, player_index + 1, room->player_count);
+    log_write(LOG_INFO, LOG_GAME, "Player %s ready for next round (%d/%d)",
+              client->username, player_index + 1, room->player_count);
     
     // Check if all players are ready
     int all_ready = 1;
@@ -621,14 +783,16 @@ void handle_ready_next_round(Server *server, int client_idx) {
     }
     
     if (all_ready) {
-        printf("All players ready! Starting round %d\n", room->current_round + 1);
+        log_write(LOG_INFO, LOG_GAME, "All players ready! Starting round %d", room->current_round + 1);
         
         // Reset waiting state
         room->waiting_for_continue = 0;
         
         // Increment round and start next round
+        trace_async(room, "continue_wait", room->trace_wait_ns);
         room->current_round++;
         room_start_game(server, room_id);
+        trace_span(room, "handle_ready_next_round", start_ns, "slot", player_index);
     } else {
         // Notify this player that they're ready
         char msg[128];
@@ -0,0 +1,296 @@
+#include "server.h"
+
+// Embedded key-value store
+//
+// On-disk format: 8-byte magic, then a log of records
+//   [u16 key_len][u32 value_len][key bytes][value bytes]
+// Later records for the same key replace earlier ones. The whole log is
+// replayed into an in-memory hash table on open; every put is appended and
+// flushed. When dead records outweigh live ones the log is compacted by
+// rewriting live entries to a temp file and renaming it over the log.
+
+#define KV_MAGIC "MPKVLOG1"
+#define KV_MAGIC_LEN 8
+#define KV_MAX_KEY 255
+#define KV_MAX_VALUE 4096
+#define KV_COMPACT_MIN_BYTES (64 * 1024)
+
+typedef struct {
+    char *key;    // NULL if slot empty
+    char *value;
+} KVEntry;
+
+struct KVStore {
+    char path[256];
+    FILE *log;
+    KVEntry *entries;   // Open addressing, linear probing
+    int capacity;       // Power of two
+    int count;
+    long log_bytes;     // Bytes of records in log
+    long live_bytes;    // Bytes the live entries would take
+};
+
+// FNV-1a 32-bit hash
+static unsigned int kv_hash(const char *key) {
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static long kv_record_size(const char *key, const char *value) {
+    return 2 + 4 + (long)strlen(key) + (long)strlen(value);
+}
+
+// Find slot for key (existing entry or empty slot to insert into)
+static KVEntry *kv_find_slot(KVStore *store, const char *key) {
+    unsigned int mask = store->capacity - 1;
+    unsigned int idx = kv_hash(key) & mask;
+    
+    while (store->entries[idx].key && strcmp(store->entries[idx].key, key) != 0) {
+        idx = (idx + 1) & mask;
+    }
+    return &store->entries[idx];
+}
+
+// Double table size when more than half full
+static int kv_grow(KVStore *store) {
+    KVEntry *old_entries = store->entries;
+    int old_capacity = store->capacity;
+    
+    KVEntry *entries = calloc(old_capacity * 2, sizeof(KVEntry));
+    if (!entries) return 0;
+    
+    store->entries = entries;
+    store->capacity = old_capacity * 2;
+    
+    for (int i = 0; i < old_capacity; i++) {
+        if (old_entries[i].key) {
+            *kv_find_slot(store, old_entries[i].key) = old_entries[i];
+        }
+    }
+    free(old_entries);
+    return 1;
+}
+
+// Insert or replace value in memory (takes ownership of key/value on success)
+static int kv_set_memory(KVStore *store, char *key, char *value) {
+    if ((store->count + 1) * 2 > store->capacity && !kv_grow(store)) {
+        return 0;
+    }
+    
+    KVEntry *slot = kv_find_slot(store, key);
+    if (slot->key) {
+        store->live_bytes -= kv_record_size(slot->key, slot->value);
+        free(slot->value);
+        free(key);
+        slot->value = value;
+    } else {
+        slot->key = key;
+        slot->value = value;
+        store->count++;
+    }
+    store->live_bytes += kv_record_size(slot->key, slot->value);
+    return 1;
+}
+
+static int kv_write_record(FILE *file, const char *key, const char *value) {
+    unsigned short key_len = (unsigned short)strlen(key);
+    unsigned int value_len = (unsigned int)strlen(value);
+    
+    if (fwrite(&key_len, sizeof(key_len), 1, file) != 1 ||
+        fwrite(&value_len, sizeof(value_len), 1, file) != 1 ||
+        fwrite(key, 1, key_len, file) != key_len ||
+        fwrite(value, 1, value_len, file) != value_len) {
+        return 0;
+    }
+    return 1;
+}
+
+// Replay log into memory, truncating a torn record at the tail
+static int kv_replay(KVStore *store) {
+    char magic[KV_MAGIC_LEN];
+    if (fread(magic, 1, KV_MAGIC_LEN, store->log) != KV_MAGIC_LEN ||
+        memcmp(magic, KV_MAGIC, KV_MAGIC_LEN) != 0) {
+        log_write(LOG_ERROR, LOG_STORAGE, "KV store %s: bad header", store->path);
+        return 0;
+    }
+    
+    long good_offset = KV_MAGIC_LEN;
+    unsigned short key_len;
+    unsigned int value_len;
+    
+    while (fread(&key_len, sizeof(key_len), 1, store->log) == 1 &&
+           fread(&value_len, sizeof(value_len), 1, store->log) == 1) {
+        if (key_len == 0 || key_len > KV_MAX_KEY || value_len > KV_MAX_VALUE) break;
+        
+        char *key = malloc(key_len + 1);
+        char *value = malloc(value_len + 1);
+        if (!key || !value ||
+            fread(key, 1, key_len, store->log) != key_len ||
+            fread(value, 1, value_len, store->log) != value_len) {
+            free(key);
+            free(value);
+            break;
+        }
+        key[key_len] = '\0';
+        value[value_len] = '\0';
+        
+        if (!kv_set_memory(store, key, value)) {
+            free(key);
+            free(value);
+            return 0;
+        }
+        good_offset = ftell(store->log);
+    }
+    
+    store->log_bytes = good_offset - KV_MAGIC_LEN;
+    
+    // Drop any partial record left by a crash mid-append
+    fseek(store->log, 0, SEEK_END);
+    if (ftell(store->log) != good_offset) {
+        log_write(LOG_WARN, LOG_STORAGE, "KV store %s: truncating torn tail at offset %ld", store->path, good_offset);
+        if (ftruncate(fileno(store->log), good_offset) < 0) {
+            perror("ftruncate");
+        }
+    }
+    fseek(store->log, good_offset, SEEK_SET);
+    return 1;
+}
+
+// Open (or create) store at path
+KVStore *kv_open(const char *path) {
+    KVStore *store = calloc(1, sizeof(KVStore));
+    if (!store) return NULL;
+    
+    strncpy(store->path, path, sizeof(store->path) - 1);
+    store->capacity = 64;
+    store->entries = calloc(store->capacity, sizeof(KVEntry));
+    if (!store->entries) {
+        free(store);
+        return NULL;
+    }
+    
+    store->log = fopen(path, "r+b");
+    if (!store->log) {
+        // New store: write header
+        store->log = fopen(path, "w+b");
+        if (!store->log || fwrite(KV_MAGIC, 1, KV_MAGIC_LEN, store->log) != KV_MAGIC_LEN) {
+            perror("fopen");
+            kv_close(store);
+            return NULL;
+        }
+        fflush(store->log);
+    } else if (!kv_replay(store)) {
+        kv_close(store);
+        return NULL;
+    }
+    
+    return store;
+}
+
+// Close store and free memory
+void kv_close(KVStore *store) {
+    if (!store) return;
+    
+    if (store->log) {
+        fclose(store->log);
+    }
+    for (int i = 0; i < store->capacity; i++) {
+        free(store->entries[i].key);
+        free(store->entries[i].value);
+    }
+    free(store->entries);
+    free(store);
+}
+
+// Look up value (pointer valid until the next put of the same key)
+const char *kv_get(KVStore *store, const char *key) {
+    KVEntry *slot = kv_find_slot(store, key);
+    return slot->key ? slot->value : NULL;
+}
+
+// Rewrite live entries into a fresh log
+static void kv_compact(KVStore *store) {
+    char temp_path[300];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", store->path);
+    
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        perror("fopen");
+        return;
+    }
+    
+    int ok = fwrite(KV_MAGIC, 1, KV_MAGIC_LEN, file) == KV_MAGIC_LEN;
+    for (int i = 0; ok && i < store->capacity; i++) {
+        if (store->entries[i].key) {
+            ok = kv_write_record(file, store->entries[i].key, store->entries[i].value);
+        }
+    }
+    
+    if (fclose(file) != 0 || !ok || rename(temp_path, store->path) != 0) {
+        perror("kv compact");
+        remove(temp_path);
+        return;
+    }
+    
+    fclose(store->log);
+    store->log = fopen(store->path, "r+b");
+    if (!store->log) {
+        perror("fopen");
+        return;
+    }
+    fseek(store->log, 0, SEEK_END);
+    store->log_bytes = store->live_bytes;
+}
+
+// Store value for key (appended to log and flushed)
+int kv_put(KVStore *store, const char *key, const char *value) {
+    size_t key_len = strlen(key);
+    size_t value_len = strlen(value);
+    if (key_len == 0 || key_len > KV_MAX_KEY || value_len > KV_MAX_VALUE || !store->log) {
+        return 0;
+    }
+    
+    if (!kv_write_record(store->log, key, value) || fflush(store->log) != 0) {
+        perror("kv_put");
+        return 0;
+    }
+    store->log_bytes += kv_record_size(key, value);
+    
+    char *key_copy = malloc(key_len + 1);
+    char *value_copy = malloc(value_len + 1);
+    if (!key_copy || !value_copy) {
+        free(key_copy);
+        free(value_copy);
+        return 0;
+    }
+    memcpy(key_copy, key, key_len + 1);
+    memcpy(value_copy, value, value_len + 1);
+    
+    if (!kv_set_memory(store, key_copy, value_copy)) {
+        free(key_copy);
+        free(value_copy);
+        return 0;
+    }
+    
+    if (store->log_bytes > KV_COMPACT_MIN_BYTES && store->log_bytes > store->live_bytes * 2) {
+        kv_compact(store);
+    }
+    return 1;
+}
+
+// Call fn for every entry whose key starts with prefix
+void kv_for_each(KVStore *store, const char *prefix,
+                 void (*fn)(const char *key, const char *value, void *ctx), void *ctx) {
+    size_t prefix_len = strlen(prefix);
+    
+    for (int i = 0; i < store->capacity; i++) {
+        KVEntry *entry = &store->entries[i];
+        if (entry->key && strncmp(entry->key, prefix, prefix_len) == 0) {
+            fn(entry->key, entry->value, ctx);
+        }
+    }
+}
@@ -0,0 +1,227 @@
+#include "server.h"
+
+// Leaderboard
+//
+// Indexable skip list ordered by score (descending), ties broken by username.
+// Each forward link stores its span (number of level-0 nodes it skips), so
+// insert, remove and rank are O(log n) and top-K is O(log n + K). Updated
+// incrementally by the stats store whenever a player's score changes.
+
+#define LB_MAX_LEVEL 32
+
+typedef struct LBNode LBNode;
+
+typedef struct {
+    LBNode *next;
+    int span;
+} LBLink;
+
+struct LBNode {
+    char username[MAX_USERNAME];
+    int score;
+    LBLink links[];  // One per level
+};
+
+static LBNode *head = NULL;
+static int list_level = 1;
+static int length = 0;
+static unsigned int level_seed = 2463534242u;
+
+// Does (score_a, name_a) rank above (score_b, name_b)?
+static int lb_before(int score_a, const char *name_a, int score_b, const char *name_b) {
+    if (score_a != score_b) return score_a > score_b;
+    return strcmp(name_a, name_b) < 0;
+}
+
+// Level with P = 1/4 per extra level (xorshift32, independent of game RNG)
+static int lb_random_level(void) {
+    int level = 1;
+    while (level < LB_MAX_LEVEL) {
+        level_seed ^= level_seed << 13;
+        level_seed ^= level_seed >> 17;
+        level_seed ^= level_seed << 5;
+        if (level_seed & 3) break;
+        level++;
+    }
+    return level;
+}
+
+static LBNode *lb_node_new(int level, const char *username, int score) {
+    LBNode *node = calloc(1, sizeof(LBNode) + level * sizeof(LBLink));
+    if (!node) return NULL;
+    
+    strncpy(node->username, username, MAX_USERNAME - 1);
+    node->score = score;
+    return node;
+}
+
+static int lb_init(void) {
+    if (!head) {
+        head = lb_node_new(LB_MAX_LEVEL, "", 0);
+    }
+    return head != NULL;
+}
+
+static void lb_insert(const char *username, int score) {
+    LBNode *update[LB_MAX_LEVEL];
+    int rank[LB_MAX_LEVEL];
+    
+    // Find predecessor at each level and its rank
+    LBNode *x = head;
+    for (int i = list_level - 1; i >= 0; i--) {
+        rank[i] = (i == list_level - 1) ? 0 : rank[i + 1];
+        while (x->links[i].next &&
+               lb_before(x->links[i].next->score, x->links[i].next->username, score, username)) {
+            rank[i] += x->links[i].span;
+            x = x->links[i].next;
+        }
+        update[i] = x;
+    }
+    
+    int level = lb_random_level();
+    if (level > list_level) {
+        for (int i = list_level; i < level; i++) {
+            rank[i] = 0;
+            update[i] = head;
+            update[i]->links[i].span = length;
+        }
+        list_level = level;
+    }
+    
+    x = lb_node_new(level, username, score);
+    if (!x) return;
+    
+    for (int i = 0; i < level; i++) {
+        x->links[i].next = update[i]->links[i].next;
+        update[i]->links[i].next = x;
+        
+        x->links[i].span = update[i]->links[i].span - (rank[0] - rank[i]);
+        update[i]->links[i].span = (rank[0] - rank[i]) + 1;
+    }
+    
+    // Links above the new node now skip one more element
+    for (int i = level; i < list_level; i++) {
+        update[i]->links[i].span++;
+    }
+    
+    length++;
+}
+
+static void lb_remove(const char *username, int score) {
+    LBNode *update[LB_MAX_LEVEL];
+    
+    LBNode *x = head;
+    for (int i = list_level - 1; i >= 0; i--) {
+        while (x->links[i].next &&
+               lb_before(x->links[i].next->score, x->links[i].next->username, score, username)) {
+            x = x->links[i].next;
+        }
+        update[i] = x;
+    }
+    
+    x = x->links[0].next;
+    if (!x || x->score != score || strcmp(x->username, username) != 0) {
+        return;  // Not on the leaderboard
+    }
+    
+    for (int i = 0; i < list_level; i++) {
+        if (update[i]->links[i].next == x) {
+            update[i]->links[i].span += x->links[i].span - 1;
+            update[i]->links[i].next = x->links[i].next;
+        } else {
+            update[i]->links[i].span--;
+        }
+    }
+    
+    while (list_level > 1 && head->links[list_level - 1].next == NULL) {
+        list_level--;
+    }
+    
+    length--;
+    free(x);
+}
+
+// Move player from old_score to new_score (old_score < 0 inserts a new player)
+void leaderboard_update(const char *username, int old_score, int new_score) {
+    if (!lb_init()) return;
+    
+    if (old_score >= 0) {
+        if (old_score == new_score) return;
+        lb_remove(username, old_score);
+    }
+    lb_insert(username, new_score);
+}
+
+// 1-based rank of player with given score (0 if not on the leaderboard)
+int leaderboard_rank(const char *username, int score) {
+    if (!head) return 0;
+    
+    int rank = 0;
+    LBNode *x = head;
+    for (int i = list_level - 1; i >= 0; i--) {
+        while (x->links[i].next &&
+               (lb_before(x->links[i].next->score, x->links[i].next->username, score, username) ||
+                (x->links[i].next->score == score && strcmp(x->links[i].next->username, username) == 0))) {
+            rank += x->links[i].span;
+            x = x->links[i].next;
+        }
+        
+        if (x != head && x->score == score && strcmp(x->username, username) == 0) {
+            return rank;
+        }
+    }
+    return 0;
+}
+
+// Number of ranked players
+int leaderboard_size(void) {
+    return length;
+}
+
+// Fill up to k top entries (pointers valid until the next update), returns count
+int leaderboard_top(int k, const char *usernames[], int scores[]) {
+    if (!head) return 0;
+    
+    int count = 0;
+    for (LBNode *x = head->links[0].next; x && count < k; x = x->links[0].next) {
+        usernames[count] = x->username;
+        scores[count] = x->score;
+        count++;
+    }
+    return count;
+}
+
+// Handle leaderboard request
+// Format: LEADERBOARD|k -> LEADERBOARD|total|my_rank|my_score|name:score|...
+void handle_leaderboard(Server *server, int client_idx, int k) {
+    Client *client = &server->clients[client_idx];
+    
+    if (client->state == STATE_CONNECTED) {
+        client_send(client, "ERROR|Must be logged in\n");
+        return;
+    }
+    
+    if (k <= 0) k = LEADERBOARD_DEFAULT_K;
+    if (k > LEADERBOARD_MAX_K) k = LEADERBOARD_MAX_K;
+    
+    const char *usernames[LEADERBOARD_MAX_K];
+    int scores[LEADERBOARD_MAX_K];
+    int count = leaderboard_top(k, usernames, scores);
+    
+    const PlayerStats *mine = stats_get(client->username);
+    int my_score = mine ? mine->score : 0;
+    int my_rank = mine ? leaderboard_rank(client->username, my_score) : 0;
+    
+    char buffer[BUFFER_SIZE];
+    int offset = 0;
+    
+    offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "LEADERBOARD|%d|%d|%d",
+                       leaderboard_size(), my_rank, my_score);
+    
+    for (int i = 0; i < count; i++) {
+        offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "|%s:%d", usernames[i], scores[i]);
+    }
+    
+    offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "\n");
+    client_send(client, buffer);
+}
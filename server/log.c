@@ -0,0 +1,570 @@
+#include "server.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <strings.h>
+
+// Logger
+//
+// log_write() never formats or touches stdout on the calling thread. It
+// checks the runtime level and category filter (two relaxed loads), then
+// copies the format pointer and the raw argument values into a fixed-size
+// binary record in the calling thread's own ring (single producer, single
+// consumer, no lock). The writer thread drains every ring, renders the
+// records with the original format and writes them out in one batch per
+// pass. A full ring drops the record and counts it; the writer reports drops.
+//
+// Formats must be string literals (the record keeps the pointer) using
+// d i u x X o c s p and f e g a conversions; '*' widths are not supported.
+// Strings are copied into the record, long ones are cut short.
+//
+// Before log_init(), after log_shutdown() and in threads beyond
+// LOG_MAX_THREADS, records are rendered and written synchronously, so
+// offline tools that link the server modules keep their output.
+//
+// LOG_LEVEL (error, warn, info, debug, trace) and LOG_CATEGORIES (comma
+// list of category names, or "all") set the filter at startup.
+
+#define LOG_PAYLOAD_SIZE (LOG_RECORD_SIZE - 24)
+#define LOG_LINE_MAX 1024
+
+_Static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "ring indices wrap, size must be a power of two");
+
+typedef struct {
+    int64_t time_ns;  // CLOCK_REALTIME
+    const char *format;
+    uint8_t level;
+    uint8_t category_bit;
+    uint8_t args;       // Arguments stored in payload
+    uint8_t truncated;  // Ran out of payload before the last argument
+    uint32_t reserved;
+    char payload[LOG_PAYLOAD_SIZE];  // 8-byte integers and doubles, NUL-terminated strings
+} LogRecord;
+
+_Static_assert(sizeof(LogRecord) == LOG_RECORD_SIZE, "log record layout");
+
+typedef struct {
+    LogRecord slots[LOG_RING_SIZE];
+    atomic_uint head;  // Next slot to fill (written by the owning thread)
+    atomic_uint tail;  // Next slot to render (written by the writer)
+    atomic_long dropped;
+    long reported;     // Writer only
+} LogRing;
+
+// Parsed conversion: start is just past '%', end at the conversion character
+typedef struct {
+    const char *start;
+    const char *length;  // First length modifier character (== end if none)
+    const char *end;
+    int size;            // 0 default, 1 h/hh, 2 l, 3 ll, 4 z/j/t, 5 L
+} LogSpec;
+
+static const char *level_names[] = {"ERROR", "WARN", "INFO", "DEBUG", "TRACE"};
+static const char *category_names[] = {"server", "net", "msg", "auth", "room", "game", "chat", "puzzle", "storage"};
+
+static atomic_int log_level = LOG_INFO;
+static atomic_uint log_categories = LOG_ALL_CATEGORIES;
+
+static LogRing *_Atomic rings[LOG_MAX_THREADS];
+static atomic_int ring_count = 0;
+static _Thread_local LogRing *thread_ring = NULL;
+static _Thread_local int thread_ring_failed = 0;
+
+static pthread_t writer_thread;
+static sem_t wake_sem;
+static atomic_int running = 0;
+static atomic_int writer_idle = 0;  // Writer is (about to be) asleep on wake_sem
+static pthread_mutex_t sync_lock = PTHREAD_MUTEX_INITIALIZER;  // Synchronous fallback writes
+
+// Parse the conversion after '%' at p
+static void log_parse_spec(const char *p, LogSpec *spec) {
+    spec->start = p;
+    while (*p && strchr("-+ #0", *p)) p++;
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    
+    spec->length = p;
+    spec->size = 0;
+    if (*p == 'h') {
+        spec->size = 1;
+        p += (p[1] == 'h') ? 2 : 1;
+    } else if (*p == 'l') {
+        spec->size = (p[1] == 'l') ? 3 : 2;
+        p += spec->size - 1;
+    } else if (*p == 'z' || *p == 'j' || *p == 't') {
+        spec->size = 4;
+        p++;
+    } else if (*p == 'L') {
+        spec->size = 5;
+        p++;
+    }
+    spec->end = p;
+}
+
+// Append len bytes at *out if they fit in the payload
+static int log_put(char **out, const char *end, const void *data, size_t len) {
+    if ((size_t)(end - *out) < len) return 0;
+    memcpy(*out, data, len);
+    *out += len;
+    return 1;
+}
+
+// Copy the arguments format consumes into record's payload
+static void log_encode(LogRecord *record, const char *format, va_list args) {
+    char *out = record->payload;
+    const char *end = record->payload + LOG_PAYLOAD_SIZE;
+    LogSpec spec;
+    
+    record->args = 0;
+    record->truncated = 0;
+    for (const char *p = format; *p; p++) {
+        if (*p != '%') continue;
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+        
+        log_parse_spec(p + 1, &spec);
+        p = spec.end;
+        int stored;
+        switch (*p) {
+            case 'd': case 'i': {
+                long long v;
+                if (spec.size == 2) v = va_arg(args, long);
+                else if (spec.size == 3) v = va_arg(args, long long);
+                else if (spec.size == 4) v = va_arg(args, ssize_t);
+                else v = va_arg(args, int);
+                stored = log_put(&out, end, &v, sizeof(v));
+                break;
+            }
+            case 'u': case 'x': case 'X': case 'o': {
+                unsigned long long v;
+                if (spec.size == 2) v = va_arg(args, unsigned long);
+                else if (spec.size == 3) v = va_arg(args, unsigned long long);
+                else if (spec.size == 4) v = va_arg(args, size_t);
+                else v = va_arg(args, unsigned int);
+                stored = log_put(&out, end, &v, sizeof(v));
+                break;
+            }
+            case 'c': {
+                long long v = va_arg(args, int);
+                stored = log_put(&out, end, &v, sizeof(v));
+                break;
+            }
+            case 'p': {
+                unsigned long long v = (uintptr_t)va_arg(args, void *);
+                stored = log_put(&out, end, &v, sizeof(v));
+                break;
+            }
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                double v = (spec.size == 5) ? (double)va_arg(args, long double) : va_arg(args, double);
+                stored = log_put(&out, end, &v, sizeof(v));
+                break;
+            }
+            case 's': {
+                const char *s = va_arg(args, const char *);
+                if (!s) s = "(null)";
+                size_t len = strlen(s);
+                size_t room = (size_t)(end - out);
+                stored = room > 0;
+                if (stored) {
+                    if (len >= room) {
+                        len = room - 1;
+                        record->truncated = 1;
+                    }
+                    memcpy(out, s, len);
+                    out[len] = '\0';
+                    out += len + 1;
+                }
+                break;
+            }
+            default:
+                stored = 0;
+        }
+        
+        if (!stored) {
+            record->truncated = 1;
+            return;
+        }
+        record->args++;
+    }
+}
+
+// Render record's message into out (no prefix, no newline), returns its length
+static int log_render_message(const LogRecord *record, char *out, int size) {
+    const char *in = record->payload;
+    int length = 0;
+    int arg = 0;
+    int cut = 0;
+    LogSpec spec;
+    
+    for (const char *p = record->format; *p && length < size - 1; p++) {
+        if (*p != '%') {
+            out[length++] = *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[length++] = '%';
+            p++;
+            continue;
+        }
+        if (arg >= record->args) {
+            length += snprintf(out + length, size - length, "...");
+            cut = 1;
+            break;
+        }
+        
+        // Flags, width and precision as written, length modifier to match the stored type
+        log_parse_spec(p + 1, &spec);
+        char conversion[32];
+        int prefix = (int)(spec.length - spec.start);
+        if (prefix > 24) prefix = 24;
+        conversion[0] = '%';
+        memcpy(conversion + 1, spec.start, prefix);
+        int c = 1 + prefix;
+        p = spec.end;
+        
+        int written = 0;
+        switch (*p) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': {
+                long long v;
+                memcpy(&v, in, sizeof(v));
+                in += sizeof(v);
+                conversion[c++] = 'l';
+                conversion[c++] = 'l';
+                conversion[c++] = *p;
+                conversion[c] = '\0';
+                written = snprintf(out + length, size - length, conversion, v);
+                break;
+            }
+            case 'c': case 'p': {
+                long long v;
+                memcpy(&v, in, sizeof(v));
+                in += sizeof(v);
+                conversion[c++] = *p;
+                conversion[c] = '\0';
+                if (*p == 'c') {
+                    written = snprintf(out + length, size - length, conversion, (int)v);
+                } else {
+                    written = snprintf(out + length, size - length, conversion, (void *)(uintptr_t)v);
+                }
+                break;
+            }
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                double v;
+                memcpy(&v, in, sizeof(v));
+                in += sizeof(v);
+                conversion[c++] = *p;
+                conversion[c] = '\0';
+                written = snprintf(out + length, size - length, conversion, v);
+                break;
+            }
+            case 's':
+                conversion[c++] = 's';
+                conversion[c] = '\0';
+                written = snprintf(out + length, size - length, conversion, in);
+                in += strlen(in) + 1;
+                break;
+        }
+        
+        length += written;
+        if (length >= size) return size - 1;
+        arg++;
+    }
+    
+    if (length >= size) length = size - 1;
+    if (record->truncated && !cut && length + 3 < size) {
+        length += snprintf(out + length, size - length, "...");
+    }
+    out[length] = '\0';
+    return length;
+}
+
+// Render record as one output line: "HH:MM:SS.mmm LEVEL category: message\n"
+static int log_render(const LogRecord *record, char *out, int size) {
+    time_t seconds = (time_t)(record->time_ns / 1000000000);
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+    
+    int length = snprintf(out, size, "%02d:%02d:%02d.%03d %-5s %s: ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+                          (int)(record->time_ns / 1000000 % 1000), level_names[record->level],
+                          category_names[record->category_bit]);
+    length += log_render_message(record, out + length, size - length - 1);
+    out[length++] = '\n';
+    return length;
+}
+
+// Stamp record and store format's arguments in it
+static void log_fill(LogRecord *record, LogLevel level, LogCategory category, const char *format, va_list args) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    record->time_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    record->format = format;
+    record->level = (uint8_t)level;
+    record->category_bit = (uint8_t)__builtin_ctz((unsigned int)category);
+    log_encode(record, format, args);
+}
+
+// Render a record made on the spot into out (writer-side messages)
+static int log_render_now(char *out, int size, LogLevel level, LogCategory category, const char *format, ...) {
+    LogRecord record;
+    va_list args;
+    va_start(args, format);
+    log_fill(&record, level, category, format, args);
+    va_end(args);
+    return log_render(&record, out, size);
+}
+
+// Ring of the calling thread, claimed on first use (NULL if every ring is taken)
+static LogRing *log_thread_ring(void) {
+    if (thread_ring || thread_ring_failed) return thread_ring;
+    
+    int index = atomic_fetch_add(&ring_count, 1);
+    LogRing *ring = index < LOG_MAX_THREADS ? calloc(1, sizeof(LogRing)) : NULL;
+    if (!ring) {
+        if (index < LOG_MAX_THREADS) atomic_store(&rings[index], NULL);
+        thread_ring_failed = 1;
+        return NULL;
+    }
+    
+    atomic_store_explicit(&rings[index], ring, memory_order_release);
+    thread_ring = ring;
+    return ring;
+}
+
+// 1 if records of level and category pass the filter
+int log_enabled(LogLevel level, LogCategory category) {
+    return (int)level <= atomic_load_explicit(&log_level, memory_order_relaxed) &&
+           (category & atomic_load_explicit(&log_categories, memory_order_relaxed)) != 0;
+}
+
+void log_write(LogLevel level, LogCategory category, const char *format, ...) {
+    if (!log_enabled(level, category)) return;
+    
+    LogRing *ring = atomic_load_explicit(&running, memory_order_relaxed) ? log_thread_ring() : NULL;
+    va_list args;
+    
+    // No writer (or no ring for this thread): render and write right here
+    if (!ring) {
+        LogRecord record;
+        char line[LOG_LINE_MAX];
+        va_start(args, format);
+        log_fill(&record, level, category, format, args);
+        va_end(args);
+        
+        int length = log_render(&record, line, sizeof(line));
+        pthread_mutex_lock(&sync_lock);
+        fwrite(line, 1, length, stdout);
+        fflush(stdout);
+        pthread_mutex_unlock(&sync_lock);
+        return;
+    }
+    
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    
+    va_start(args, format);
+    log_fill(&ring->slots[head % LOG_RING_SIZE], level, category, format, args);
+    va_end(args);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    
+    // Wake the writer only if it went to sleep, most records cost no syscall.
+    // The fence pairs with the writer's: one side always sees the other's store.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&writer_idle, memory_order_relaxed) && atomic_exchange(&writer_idle, 0)) {
+        sem_post(&wake_sem);
+    }
+}
+
+// Render every pending record of every ring into stdout, returns how many there were
+static int log_drain(void) {
+    static char batch[LOG_RING_SIZE * 2 * 128];
+    char line[LOG_LINE_MAX];
+    size_t used = 0;
+    int drained = 0;
+    int count = atomic_load(&ring_count);
+    if (count > LOG_MAX_THREADS) count = LOG_MAX_THREADS;
+    
+    for (int i = 0; i < count; i++) {
+        LogRing *ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        if (!ring) continue;
+        
+        unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            int length = log_render(&ring->slots[tail % LOG_RING_SIZE], line, sizeof(line));
+            if (used + length > sizeof(batch)) {
+                fwrite(batch, 1, used, stdout);
+                used = 0;
+            }
+            memcpy(batch + used, line, length);
+            used += length;
+            drained++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        
+        long dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped != ring->reported) {
+            int length = log_render_now(line, sizeof(line), LOG_WARN, LOG_SERVER,
+                                        "Logger: %ld records dropped, thread ring %d was full",
+                                        dropped - ring->reported, i);
+            if (used + length > sizeof(batch)) {
+                fwrite(batch, 1, used, stdout);
+                used = 0;
+            }
+            memcpy(batch + used, line, length);
+            used += length;
+            ring->reported = dropped;
+        }
+    }
+    
+    if (used > 0) {
+        fwrite(batch, 1, used, stdout);
+        fflush(stdout);
+    }
+    return drained;
+}
+
+// 1 if any ring has records waiting
+static int log_pending(void) {
+    int count = atomic_load(&ring_count);
+    if (count > LOG_MAX_THREADS) count = LOG_MAX_THREADS;
+    
+    for (int i = 0; i < count; i++) {
+        LogRing *ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        if (ring && atomic_load_explicit(&ring->head, memory_order_acquire) !=
+                    atomic_load_explicit(&ring->tail, memory_order_relaxed)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Writer thread: drain, and sleep on wake_sem once every ring is empty
+static void *log_writer_main(void *arg) {
+    (void)arg;
+    
+    while (atomic_load(&running)) {
+        if (log_drain() > 0) continue;
+        
+        // Announce the sleep before the last check so a record pushed in
+        // between either is seen here or posts wake_sem
+        atomic_store(&writer_idle, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (log_pending() || !atomic_load(&running)) {
+            atomic_store(&writer_idle, 0);
+            continue;
+        }
+        sem_wait(&wake_sem);
+    }
+    
+    log_drain();
+    return NULL;
+}
+
+// Level from a name or number, -1 if unknown
+int log_parse_level(const char *name) {
+    for (int i = 0; i <= LOG_TRACE; i++) {
+        if (strcasecmp(name, level_names[i]) == 0) return i;
+    }
+    if (name[0] >= '0' && name[0] <= '9' && atoi(name) <= LOG_TRACE) return atoi(name);
+    return -1;
+}
+
+// Category mask from "all" or a comma list of names, 0 if nothing matched
+static unsigned int log_parse_categories(const char *list) {
+    unsigned int mask = 0;
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", list);
+    
+    char *save = NULL;
+    for (char *name = strtok_r(copy, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        while (*name == ' ') name++;
+        if (strcasecmp(name, "all") == 0) mask |= LOG_ALL_CATEGORIES;
+        for (int i = 0; i < (int)(sizeof(category_names) / sizeof(category_names[0])); i++) {
+            if (strcasecmp(name, category_names[i]) == 0) mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+void log_set_level(LogLevel level) {
+    atomic_store(&log_level, (int)level);
+}
+
+void log_set_categories(unsigned int mask) {
+    atomic_store(&log_categories, mask & LOG_ALL_CATEGORIES);
+}
+
+LogLevel log_get_level(void) {
+    return (LogLevel)atomic_load(&log_level);
+}
+
+const char *log_level_name(LogLevel level) {
+    return level >= LOG_ERROR && level <= LOG_TRACE ? level_names[level] : "?";
+}
+
+unsigned int log_get_categories(void) {
+    return atomic_load(&log_categories);
+}
+
+// Records dropped so far because a thread's ring was full
+long log_dropped(void) {
+    long total = 0;
+    int count = atomic_load(&ring_count);
+    if (count > LOG_MAX_THREADS) count = LOG_MAX_THREADS;
+    
+    for (int i = 0; i < count; i++) {
+        LogRing *ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        if (ring) total += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+    return total;
+}
+
+// Apply LOG_LEVEL / LOG_CATEGORIES and start the writer thread (0 = synchronous logging)
+int log_init(void) {
+    const char *level = getenv("LOG_LEVEL");
+    if (level && log_parse_level(level) >= 0) {
+        log_set_level((LogLevel)log_parse_level(level));
+    }
+    const char *categories = getenv("LOG_CATEGORIES");
+    if (categories && log_parse_categories(categories) != 0) {
+        log_set_categories(log_parse_categories(categories));
+    }
+    
+    if (sem_init(&wake_sem, 0, 0) < 0) {
+        perror("sem_init");
+        return 0;
+    }
+    
+    atomic_store(&running, 1);
+    if (pthread_create(&writer_thread, NULL, log_writer_main, NULL) != 0) {
+        perror("pthread_create");
+        atomic_store(&running, 0);
+        sem_destroy(&wake_sem);
+        return 0;
+    }
+    
+    log_write(LOG_INFO, LOG_SERVER, "Logger: level %s, categories 0x%x, %d-record rings",
+              level_names[log_get_level()], log_get_categories(), LOG_RING_SIZE);
+    return 1;
+}
+
+// Stop the writer after it renders everything queued; later records are written synchronously
+void log_shutdown(void) {
+    if (!atomic_load(&running)) return;
+    
+    atomic_store(&running, 0);
+    sem_post(&wake_sem);
+    pthread_join(writer_thread, NULL);
+    sem_destroy(&wake_sem);
+    fflush(stdout);
+}
@@ -0,0 +1,42 @@
+#include "server.h"
+#include <signal.h>
+
+// Entry point lives apart from server.c so offline tools (tools/) can link
+// every other server module without a second main().
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    server_request_stop();
+}
+
+static void handle_dump_signal(int sig) {
+    (void)sig;
+    server_request_latency_dump();
+}
+
+// Main function
+int main() {
+    // Stop cleanly on Ctrl+C / kill so stats are flushed, ignore writes to closed sockets
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    // kill -USR1 logs the latency report
+    sa.sa_handler = handle_dump_signal;
+    sigaction(SIGUSR1, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    Server server;
+    server_init(&server);
+    
+    log_write(LOG_INFO, LOG_SERVER, "Math Puzzle Game Server running...");
+    log_write(LOG_INFO, LOG_SERVER, "Waiting for players...");
+    
+    server_run(&server);
+    server_shutdown(&server);
+    
+    return 0;
+}
+
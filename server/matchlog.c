@@ -0,0 +1,307 @@
+#include "server.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Match history log
+//
+// On-disk format: 16-byte header (magic, version, record size), then fixed-size
+// MatchRecord entries appended one per finished round. The event loop only
+// copies a record into an in-memory queue; a writer thread drains the queue in
+// batches with one fwrite + fflush, so disk latency never reaches the game.
+// Readers mmap the file and index records directly. A log written by another
+// generator version is renamed to <path>.v<version> at startup and a new
+// one is started, so old records stay replayable with their own build.
+
+#define MATCHLOG_MAGIC "MPMATCH1"
+#define MATCHLOG_MAGIC_LEN 8
+#define MATCHLOG_VERSION PUZZLE_GENERATOR_VERSION  // Records only replay through the generator that made them
+
+typedef struct {
+    char magic[MATCHLOG_MAGIC_LEN];
+    uint32_t version;
+    uint32_t record_size;
+} MatchLogHeader;
+
+_Static_assert(sizeof(MatchLogHeader) == 16, "match log header layout");
+_Static_assert(sizeof(MatchRecord) % 8 == 0, "match log records must stay 8-byte aligned");
+
+// Writer thread and record queue (ring buffer guarded by queue_lock)
+static pthread_t writer_thread;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static MatchRecord queue[MATCHLOG_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static int running = 0;
+static long dropped = 0;  // Records lost because the queue was full
+static MatchRecord batch[MATCHLOG_QUEUE_SIZE];  // Writer-owned copy of the queue
+static FILE *log_file = NULL;
+
+// Check header of an existing log (or write one to an empty file), drop a torn tail;
+// returns -1 for a match log of another version (its version in *old_version)
+static int matchlog_prepare(FILE *file, const char *path, uint32_t *old_version) {
+    MatchLogHeader header;
+    
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    
+    if (size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MATCHLOG_MAGIC, MATCHLOG_MAGIC_LEN);
+        header.version = MATCHLOG_VERSION;
+        header.record_size = sizeof(MatchRecord);
+        return fwrite(&header, sizeof(header), 1, file) == 1 && fflush(file) == 0;
+    }
+    
+    fseek(file, 0, SEEK_SET);
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, MATCHLOG_MAGIC, MATCHLOG_MAGIC_LEN) != 0) {
+        log_write(LOG_ERROR, LOG_STORAGE, "Match log %s: bad header", path);
+        return 0;
+    }
+    if (header.version != MATCHLOG_VERSION || header.record_size != sizeof(MatchRecord)) {
+        *old_version = header.version;
+        return -1;
+    }
+    
+    // Drop any partial record left by a crash mid-write
+    long body = size - (long)sizeof(header);
+    long good_size = (long)sizeof(header) + body - body % (long)sizeof(MatchRecord);
+    if (good_size != size) {
+        log_write(LOG_WARN, LOG_STORAGE, "Match log %s: truncating torn tail at offset %ld", path, good_size);
+        if (ftruncate(fileno(file), good_size) < 0) {
+            perror("ftruncate");
+            return 0;
+        }
+    }
+    fseek(file, 0, SEEK_END);
+    return 1;
+}
+
+// Writer thread main loop
+static void *matchlog_writer_main(void *arg) {
+    (void)arg;
+    
+    pthread_mutex_lock(&queue_lock);
+    while (1) {
+        while (queue_count == 0 && running) {
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        }
+        
+        // Drain remaining records before exiting on shutdown
+        if (queue_count == 0) break;
+        
+        int count = queue_count;
+        for (int i = 0; i < count; i++) {
+            batch[i] = queue[(queue_head + i) % MATCHLOG_QUEUE_SIZE];
+        }
+        queue_head = (queue_head + count) % MATCHLOG_QUEUE_SIZE;
+        queue_count = 0;
+        pthread_mutex_unlock(&queue_lock);
+        
+        if (fwrite(batch, sizeof(MatchRecord), count, log_file) != (size_t)count ||
+            fflush(log_file) != 0) {
+            perror("match log write");
+        }
+        
+        pthread_mutex_lock(&queue_lock);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    
+    return NULL;
+}
+
+// Move a log of another version out of the way as <path>.v<version> (never overwriting an archive)
+static int matchlog_archive(const char *path, uint32_t version) {
+    char archive[512];
+    snprintf(archive, sizeof(archive), "%s.v%u", path, version);
+    for (int n = 2; access(archive, F_OK) == 0; n++) {
+        snprintf(archive, sizeof(archive), "%s.v%u.%d", path, version, n);
+    }
+    
+    if (rename(path, archive) < 0) {
+        perror("rename");
+        return 0;
+    }
+    log_write(LOG_WARN, LOG_STORAGE, "Match log %s: version %u, moved to %s, starting version %d",
+              path, version, archive, MATCHLOG_VERSION);
+    return 1;
+}
+
+// Open log for appending and start writer thread (0 = logging disabled)
+int matchlog_init(const char *path) {
+    log_file = fopen(path, "r+b");
+    if (!log_file) {
+        log_file = fopen(path, "w+b");
+    }
+    if (!log_file) {
+        perror("fopen");
+        return 0;
+    }
+    
+    uint32_t old_version = 0;
+    int prepared = matchlog_prepare(log_file, path, &old_version);
+    if (prepared < 0) {
+        fclose(log_file);
+        log_file = NULL;
+        if (matchlog_archive(path, old_version)) {
+            log_file = fopen(path, "w+b");
+            if (!log_file) perror("fopen");
+        }
+        prepared = log_file ? matchlog_prepare(log_file, path, &old_version) : 0;
+    }
+    if (prepared <= 0) {
+        if (log_file) fclose(log_file);
+        log_file = NULL;
+        return 0;
+    }
+    
+    running = 1;
+    if (pthread_create(&writer_thread, NULL, matchlog_writer_main, NULL) != 0) {
+        perror("pthread_create");
+        running = 0;
+        fclose(log_file);
+        log_file = NULL;
+        return 0;
+    }
+    
+    log_write(LOG_INFO, LOG_STORAGE, "Match log: %s", path);
+    return 1;
+}
+
+// Stop writer thread after it drains queued records, then close log
+void matchlog_shutdown(void) {
+    if (!running) return;
+    
+    pthread_mutex_lock(&queue_lock);
+    running = 0;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    
+    pthread_join(writer_thread, NULL);
+    fclose(log_file);
+    log_file = NULL;
+    
+    if (dropped > 0) {
+        log_write(LOG_WARN, LOG_STORAGE, "Match log: %ld records dropped (queue full)", dropped);
+    }
+}
+
+// Queue a record of the round that just ended in room (event loop, never blocks on I/O)
+void matchlog_record_round(Server *server, int room_id, int won, int timeout) {
+    if (!running) return;
+    
+    Room *room = &server->rooms[room_id];
+    MatchRecord record;
+    memset(&record, 0, sizeof(record));
+    
+    record.start_time = (int64_t)room->game_start_time;
+    record.seed = room->puzzle.seed;
+    record.room_id = room_id;
+    record.round = room->puzzle.round;
+    record.format = room->puzzle.format;
+    record.ops[0] = room->puzzle.op1;
+    record.ops[1] = room->puzzle.op2;
+    record.ops[2] = room->puzzle.op3;
+    record.result = room->puzzle.result;
+    record.won = won;
+    record.timeout = timeout;
+    
+    for (int i = 0; i < PLAYERS_PER_ROOM; i++) {
+        record.solution[i][0] = room->puzzle.solution_row[i];
+        record.solution[i][1] = room->puzzle.solution_col[i];
+        record.submitted[i][0] = room->submitted_answers[i][0];
+        record.submitted[i][1] = room->submitted_answers[i][1];
+        record.solve_ms[i] = room->answer_submitted[i] ? (int32_t)(room->submit_ms[i] - room->round_start_ms) : -1;
+        
+        int client_idx = room->player_ids[i];
+        if (client_idx >= 0) {
+            strncpy(record.players[i], server->clients[client_idx].username, MAX_USERNAME - 1);
+        }
+    }
+    
+    pthread_mutex_lock(&queue_lock);
+    if (queue_count == MATCHLOG_QUEUE_SIZE) {
+        dropped++;
+    } else {
+        queue[(queue_head + queue_count) % MATCHLOG_QUEUE_SIZE] = record;
+        queue_count++;
+        pthread_cond_signal(&queue_cond);
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
+
+// Map log read-only (records stay valid until matchlog_unmap)
+int matchlog_map(const char *path, MatchLogView *view) {
+    memset(view, 0, sizeof(MatchLogView));
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return 0;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(MatchLogHeader)) {
+        log_write(LOG_ERROR, LOG_STORAGE, "Match log %s: too short", path);
+        close(fd);
+        return 0;
+    }
+    
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+    
+    const MatchLogHeader *header = base;
+    if (memcmp(header->magic, MATCHLOG_MAGIC, MATCHLOG_MAGIC_LEN) != 0 ||
+        header->version != MATCHLOG_VERSION || header->record_size != sizeof(MatchRecord)) {
+        log_write(LOG_ERROR, LOG_STORAGE, "Match log %s: bad header or record layout", path);
+        munmap(base, st.st_size);
+        return 0;
+    }
+    
+    view->base = base;
+    view->size = st.st_size;
+    view->records = (const MatchRecord *)((const char *)base + sizeof(MatchLogHeader));
+    view->count = (int)((st.st_size - sizeof(MatchLogHeader)) / sizeof(MatchRecord));  // Ignores a torn tail
+    return 1;
+}
+
+void matchlog_unmap(MatchLogView *view) {
+    if (view->base) {
+        munmap(view->base, view->size);
+    }
+    memset(view, 0, sizeof(MatchLogView));
+}
+
+// Regenerate the round's puzzle from its seed and re-judge the submissions
+// Returns 1 if puzzle and outcome match the record
+int matchlog_replay(const MatchRecord *record, Puzzle *puzzle) {
+    memset(puzzle, 0, sizeof(Puzzle));
+    puzzle_generate(puzzle, record->round, record->seed);
+    
+    if ((int)puzzle->format != record->format || (int)puzzle->op1 != record->ops[0] ||
+        (int)puzzle->op2 != record->ops[1] || (int)puzzle->op3 != record->ops[2] ||
+        puzzle->result != record->result) {
+        return 0;
+    }
+    
+    int submitted[PLAYERS_PER_ROOM][2];
+    for (int i = 0; i < PLAYERS_PER_ROOM; i++) {
+        if (puzzle->solution_row[i] != record->solution[i][0] ||
+            puzzle->solution_col[i] != record->solution[i][1]) {
+            return 0;
+        }
+        submitted[i][0] = record->submitted[i][0];
+        submitted[i][1] = record->submitted[i][1];
+    }
+    
+    // Timed-out rounds are lost regardless of what was submitted
+    int won = record->timeout ? 0 : puzzle_verify_solution(puzzle, submitted);
+    return won == record->won;
+}
@@ -0,0 +1,508 @@
+#include "server.h"
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+
+// Metrics registry
+//
+// Counters and histogram buckets live in per-thread slots, one cache-line
+// aligned MetricSlot per thread that records (claimed on first use), so the
+// event loop and the background threads never write the same line. A slot
+// has a single writer, which updates it with a relaxed load and store, no
+// locked instruction; threads beyond METRICS_MAX_THREADS share one overflow
+// slot through atomic adds. Gauges are sampled from the server state once a
+// tick by the event loop.
+//
+// A scrape thread serves GET /metrics on 127.0.0.1:METRICS_PORT (override
+// with METRICS_PORT env, 0 disables) in Prometheus text format 0.0.4. It
+// sums every slot at scrape time; totals are exact once writers are quiet
+// and never go backwards.
+//
+// Latency series (one per protocol command, periodic task and a few hot
+// functions) use log-linear buckets in the HdrHistogram style: exact below
+// 16 ns, then 8 sub-buckets per power of two, so any recorded value is
+// within 12.5% of its bucket bound from nanoseconds up to minutes in 304
+// counters. Scrapes report p50/p99/p99.9 as a summary, and SIGUSR1 logs
+// the same figures (metrics_log_latency()).
+
+#define METRICS_PREFIX "mathpuzzle_"
+#define METRICS_REQUEST_MAX 2048
+#define METRICS_BODY_MAX 65536
+#define LATENCY_SUB_BITS 3  // 8 sub-buckets per power of two
+#define LATENCY_SUB_COUNT (1 << LATENCY_SUB_BITS)
+
+typedef struct {
+    _Alignas(64) atomic_ullong counters[METRIC_COUNTER_COUNT];
+    atomic_ullong commands[METRIC_COMMAND_COUNT];
+    atomic_ullong buckets[METRIC_HISTOGRAM_COUNT][METRIC_MAX_BUCKETS + 1];  // Last is +Inf
+    atomic_ullong sums[METRIC_HISTOGRAM_COUNT];
+    atomic_ullong latency[METRIC_LATENCY_COUNT][METRIC_LATENCY_BUCKETS];
+    atomic_ullong latency_sum[METRIC_LATENCY_COUNT];  // Nanoseconds
+    atomic_ullong latency_max[METRIC_LATENCY_COUNT];
+} MetricSlot;
+
+// One latency series summed over every slot
+typedef struct {
+    unsigned long long buckets[METRIC_LATENCY_BUCKETS];
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long max;
+} LatencySnapshot;
+
+typedef struct {
+    const char *name;
+    const char *help;
+} MetricInfo;
+
+typedef struct {
+    const char *name;
+    const char *help;
+    double scale;  // Observed units per exported unit
+    int bucket_count;
+    long long bounds[METRIC_MAX_BUCKETS];  // Inclusive upper bounds, observed units
+} HistogramInfo;
+
+static const MetricInfo counter_info[METRIC_COUNTER_COUNT] = {
+    {"connections_accepted_total", "Client connections accepted"},
+    {"connections_rejected_total", "Client connections refused because every slot was taken"},
+    {"bytes_received_total", "Protocol bytes read from clients"},
+    {"bytes_sent_total", "Protocol bytes written to clients"},
+    {"send_failures_total", "Sends that failed or were cut short"},
+    {"rounds_won_total", "Rounds ended with a correct answer"},
+    {"rounds_lost_total", "Rounds ended with a wrong answer"},
+    {"rounds_timed_out_total", "Rounds ended by the game timer"},
+    {"loop_stalls_total", "Event loop iterations over the stall budget"},
+};
+
+static const MetricInfo gauge_info[METRIC_GAUGE_COUNT] = {
+    {"clients_connected", "Clients with an open socket"},
+    {"clients_authenticated", "Connected clients that are logged in"},
+    {"rooms_active", "Open rooms"},
+    {"games_in_progress", "Rooms with a game running"},
+};
+
+static const HistogramInfo histogram_info[METRIC_HISTOGRAM_COUNT] = {
+    {"message_bytes", "Size of inbound protocol messages", 1.0,
+     9, {8, 16, 32, 64, 128, 256, 512, 1024, 4096}},
+    {"round_duration_seconds", "Time from round start to its end", 1000.0,
+     8, {5000, 10000, 20000, 30000, 60000, 90000, 120000, 180000}},
+};
+
+// Protocol command names, indexed by MetricCommand
+static const char *command_names[METRIC_COMMAND_COUNT] = {
+    "REGISTER", "LOGIN", "CHECK_NAME", "CREATE_ROOM", "JOIN_ROOM", "LEAVE_ROOM", "LIST_ROOMS",
+    "READY", "START_GAME", "SUBMIT", "PONG", "CHAT", "READY_NEXT_ROUND", "LEADERBOARD", "DEBUG_ANSWER",
+    "UNKNOWN"
+};
+
+// Latency series past the commands, indexed by MetricLatency - METRIC_COMMAND_COUNT
+static const char *latency_names[METRIC_LATENCY_COUNT - METRIC_COMMAND_COUNT] = {
+    "tick_game_timers", "tick_room_status", "tick_ping_timeouts", "tick_reconnect_timeouts",
+    "tick_pings", "tick_stats_flush", "tick_metrics_sample", "room_start_game", "send_room_status",
+    "loop_iteration", "loop_phase_io", "loop_phase_timers", "loop_phase_broadcasts", "loop_phase_housekeeping"
+};
+
+static MetricSlot slots[METRICS_MAX_THREADS + 1];  // Last is the shared overflow slot
+static atomic_int slot_count = 0;
+static _Thread_local MetricSlot *thread_slot = NULL;
+static _Thread_local int thread_slot_shared = 0;
+
+static atomic_llong gauges[METRIC_GAUGE_COUNT];
+
+static pthread_t scrape_thread;
+static int listen_fd = -1;
+static atomic_int running = 0;
+
+// Slot of the calling thread, claimed on first use
+static MetricSlot *metrics_thread_slot(void) {
+    if (thread_slot) return thread_slot;
+    
+    int index = atomic_fetch_add(&slot_count, 1);
+    if (index >= METRICS_MAX_THREADS) {
+        index = METRICS_MAX_THREADS;
+        thread_slot_shared = 1;
+    }
+    thread_slot = &slots[index];
+    return thread_slot;
+}
+
+static void metrics_add(atomic_ullong *value, unsigned long long delta) {
+    if (thread_slot_shared) {
+        atomic_fetch_add_explicit(value, delta, memory_order_relaxed);
+    } else {
+        atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + delta,
+                              memory_order_relaxed);
+    }
+}
+
+void metrics_count(MetricCounter counter, unsigned long long delta) {
+    metrics_add(&metrics_thread_slot()->counters[counter], delta);
+}
+
+void metrics_count_command(MetricCommand command) {
+    metrics_add(&metrics_thread_slot()->commands[command], 1);
+}
+
+void metrics_observe(MetricHistogram histogram, long long value) {
+    const HistogramInfo *info = &histogram_info[histogram];
+    MetricSlot *slot = metrics_thread_slot();
+    
+    int bucket = 0;
+    while (bucket < info->bucket_count && value > info->bounds[bucket]) {
+        bucket++;
+    }
+    metrics_add(&slot->buckets[histogram][bucket], 1);
+    metrics_add(&slot->sums[histogram], (unsigned long long)value);
+}
+
+// Bucket of a latency in nanoseconds: the value itself below 2 * LATENCY_SUB_COUNT,
+// then the top LATENCY_SUB_BITS bits after the leading one pick the sub-bucket
+int metrics_latency_bucket(unsigned long long ns) {
+    if (ns < 2 * LATENCY_SUB_COUNT) return (int)ns;
+    
+    int shift = 63 - __builtin_clzll(ns) - LATENCY_SUB_BITS;
+    int bucket = shift * LATENCY_SUB_COUNT + (int)(ns >> shift);
+    return bucket < METRIC_LATENCY_BUCKETS ? bucket : METRIC_LATENCY_BUCKETS - 1;
+}
+
+// Largest latency that falls in bucket
+unsigned long long metrics_latency_bound(int bucket) {
+    if (bucket < 2 * LATENCY_SUB_COUNT) return (unsigned long long)bucket;
+    
+    int shift = bucket / LATENCY_SUB_COUNT - 1;
+    unsigned long long mantissa = (unsigned long long)(bucket % LATENCY_SUB_COUNT + LATENCY_SUB_COUNT);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void metrics_record_latency(MetricLatency series, long long ns) {
+    MetricSlot *slot = metrics_thread_slot();
+    unsigned long long value = ns > 0 ? (unsigned long long)ns : 0;
+    
+    metrics_add(&slot->latency[series][metrics_latency_bucket(value)], 1);
+    metrics_add(&slot->latency_sum[series], value);
+    if (value > atomic_load_explicit(&slot->latency_max[series], memory_order_relaxed)) {
+        atomic_store_explicit(&slot->latency_max[series], value, memory_order_relaxed);
+    }
+}
+
+// Record the time since start_ns, returns now so consecutive tasks can chain
+long long metrics_latency_since(MetricLatency series, long long start_ns) {
+    long long now = time_now_ns();
+    metrics_record_latency(series, now - start_ns);
+    return now;
+}
+
+void metrics_set_gauge(MetricGauge gauge, long long value) {
+    atomic_store_explicit(&gauges[gauge], value, memory_order_relaxed);
+}
+
+// Command for a protocol verb (METRIC_COMMAND_UNKNOWN if it isn't one)
+MetricCommand metrics_command(const char *name) {
+    for (int i = 0; i < METRIC_COMMAND_UNKNOWN; i++) {
+        if (strcmp(name, command_names[i]) == 0) return (MetricCommand)i;
+    }
+    return METRIC_COMMAND_UNKNOWN;
+}
+
+const char *metrics_command_name(MetricCommand command) {
+    return command_names[command];
+}
+
+// Refresh gauges from the server state (event loop, once a tick)
+void metrics_sample(const Server *server) {
+    long long connected = 0, authenticated = 0, rooms = 0, games = 0;
+    
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        const Client *client = &server->clients[i];
+        if (!client->active || client->socket_fd < 0) continue;
+        connected++;
+        if (client->state != STATE_CONNECTED) authenticated++;
+    }
+    for (int i = 0; i < MAX_ROOMS; i++) {
+        if (!server->rooms[i].active) continue;
+        rooms++;
+        if (server->rooms[i].game_started) games++;
+    }
+    
+    metrics_set_gauge(METRIC_CLIENTS_CONNECTED, connected);
+    metrics_set_gauge(METRIC_CLIENTS_AUTHENTICATED, authenticated);
+    metrics_set_gauge(METRIC_ROOMS_ACTIVE, rooms);
+    metrics_set_gauge(METRIC_GAMES_IN_PROGRESS, games);
+}
+
+// Sum of one field over every slot (first is the field in slots[0], slots are evenly spaced)
+static unsigned long long metrics_sum(const atomic_ullong *first) {
+    unsigned long long total = 0;
+    for (int i = 0; i <= METRICS_MAX_THREADS; i++) {
+        const atomic_ullong *value = (const atomic_ullong *)((const char *)first + i * sizeof(MetricSlot));
+        total += atomic_load_explicit(value, memory_order_relaxed);
+    }
+    return total;
+}
+
+static const char *metrics_latency_name(MetricLatency series) {
+    return (int)series < METRIC_COMMAND_COUNT ? metrics_command_name((MetricCommand)series) : latency_names[series - METRIC_COMMAND_COUNT];
+}
+
+static void metrics_latency_snapshot(MetricLatency series, LatencySnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(LatencySnapshot));
+    for (int i = 0; i <= METRICS_MAX_THREADS; i++) {
+        const MetricSlot *slot = &slots[i];
+        unsigned long long max = atomic_load_explicit(&slot->latency_max[series], memory_order_relaxed);
+        
+        for (int b = 0; b < METRIC_LATENCY_BUCKETS; b++) {
+            unsigned long long count = atomic_load_explicit(&slot->latency[series][b], memory_order_relaxed);
+            snapshot->buckets[b] += count;
+            snapshot->count += count;
+        }
+        snapshot->sum += atomic_load_explicit(&slot->latency_sum[series], memory_order_relaxed);
+        if (max > snapshot->max) snapshot->max = max;
+    }
+}
+
+// Upper bound of the bucket holding the q-th quantile, never above the recorded max
+static unsigned long long metrics_latency_quantile(const LatencySnapshot *snapshot, double q) {
+    if (snapshot->count == 0) return 0;
+    
+    unsigned long long rank = (unsigned long long)(q * snapshot->count + 0.999999);
+    unsigned long long seen = 0;
+    if (rank < 1) rank = 1;
+    for (int b = 0; b < METRIC_LATENCY_BUCKETS; b++) {
+        seen += snapshot->buckets[b];
+        if (seen >= rank) {
+            unsigned long long bound = metrics_latency_bound(b);
+            return bound < snapshot->max ? bound : snapshot->max;
+        }
+    }
+    return snapshot->max;
+}
+
+// Log p50/p99/p99.9/max of every latency series that has samples (SIGUSR1)
+void metrics_log_latency(void) {
+    LatencySnapshot snapshot;
+    
+    log_write(LOG_INFO, LOG_SERVER, "Latency report (microseconds):");
+    for (int s = 0; s < METRIC_LATENCY_COUNT; s++) {
+        metrics_latency_snapshot((MetricLatency)s, &snapshot);
+        if (snapshot.count == 0) continue;
+        log_write(LOG_INFO, LOG_SERVER, "  %-24s %8llu calls  p50 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f",
+                  metrics_latency_name((MetricLatency)s), snapshot.count,
+                  metrics_latency_quantile(&snapshot, 0.5) / 1e3, metrics_latency_quantile(&snapshot, 0.99) / 1e3,
+                  metrics_latency_quantile(&snapshot, 0.999) / 1e3, snapshot.max / 1e3);
+    }
+}
+
+// Append to out, returns the new length (capped at size - 1)
+static size_t metrics_append(char *out, size_t size, size_t length, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static size_t metrics_append(char *out, size_t size, size_t length, const char *format, ...) {
+    if (length >= size - 1) return length;
+    
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(out + length, size - length, format, args);
+    va_end(args);
+    
+    if (written < 0) return length;
+    return (length + written < size) ? length + written : size - 1;
+}
+
+// Render every metric in Prometheus text format, returns the length
+size_t metrics_render(char *out, size_t size) {
+    size_t n = 0;
+    
+    out[0] = '\0';
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        n = metrics_append(out, size, n, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s counter\n"
+                           METRICS_PREFIX "%s %llu\n", counter_info[c].name, counter_info[c].help,
+                           counter_info[c].name, counter_info[c].name, metrics_sum(&slots[0].counters[c]));
+    }
+    
+    n = metrics_append(out, size, n, "# HELP " METRICS_PREFIX "messages_total Inbound protocol messages by command\n"
+                       "# TYPE " METRICS_PREFIX "messages_total counter\n");
+    for (int c = 0; c < METRIC_COMMAND_COUNT; c++) {
+        n = metrics_append(out, size, n, METRICS_PREFIX "messages_total{command=\"%s\"} %llu\n",
+                           command_names[c], metrics_sum(&slots[0].commands[c]));
+    }
+    
+    n = metrics_append(out, size, n, "# HELP " METRICS_PREFIX "log_dropped_total Log records dropped on full rings\n"
+                       "# TYPE " METRICS_PREFIX "log_dropped_total counter\n" METRICS_PREFIX "log_dropped_total %ld\n",
+                       log_dropped());
+    
+    for (int g = 0; g < METRIC_GAUGE_COUNT; g++) {
+        n = metrics_append(out, size, n, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s gauge\n"
+                           METRICS_PREFIX "%s %lld\n", gauge_info[g].name, gauge_info[g].help,
+                           gauge_info[g].name, gauge_info[g].name,
+                           atomic_load_explicit(&gauges[g], memory_order_relaxed));
+    }
+    
+    for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+        const HistogramInfo *info = &histogram_info[h];
+        unsigned long long cumulative = 0;
+        
+        n = metrics_append(out, size, n, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s histogram\n",
+                           info->name, info->help, info->name);
+        for (int b = 0; b <= info->bucket_count; b++) {
+            cumulative += metrics_sum(&slots[0].buckets[h][b]);
+            if (b < info->bucket_count) {
+                n = metrics_append(out, size, n, METRICS_PREFIX "%s_bucket{le=\"%g\"} %llu\n",
+                                   info->name, info->bounds[b] / info->scale, cumulative);
+            } else {
+                n = metrics_append(out, size, n, METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %llu\n",
+                                   info->name, cumulative);
+            }
+        }
+        n = metrics_append(out, size, n, METRICS_PREFIX "%s_sum %g\n" METRICS_PREFIX "%s_count %llu\n",
+                           info->name, metrics_sum(&slots[0].sums[h]) / info->scale, info->name, cumulative);
+    }
+    
+    static const double quantiles[] = {0.5, 0.99, 0.999};
+    LatencySnapshot snapshot;
+    
+    n = metrics_append(out, size, n, "# HELP " METRICS_PREFIX "latency_seconds Handler and periodic task latency\n"
+                       "# TYPE " METRICS_PREFIX "latency_seconds summary\n");
+    for (int s = 0; s < METRIC_LATENCY_COUNT; s++) {
+        const char *name = metrics_latency_name((MetricLatency)s);
+        
+        metrics_latency_snapshot((MetricLatency)s, &snapshot);
+        if (snapshot.count == 0) continue;
+        for (int q = 0; q < 3; q++) {
+            n = metrics_append(out, size, n, METRICS_PREFIX "latency_seconds{op=\"%s\",quantile=\"%g\"} %.9f\n",
+                               name, quantiles[q], metrics_latency_quantile(&snapshot, quantiles[q]) / 1e9);
+        }
+        n = metrics_append(out, size, n, METRICS_PREFIX "latency_seconds_sum{op=\"%s\"} %.9f\n"
+                           METRICS_PREFIX "latency_seconds_count{op=\"%s\"} %llu\n",
+                           name, snapshot.sum / 1e9, name, snapshot.count);
+    }
+    
+    n = metrics_append(out, size, n, "# HELP " METRICS_PREFIX "latency_max_seconds Slowest call since startup\n"
+                       "# TYPE " METRICS_PREFIX "latency_max_seconds gauge\n");
+    for (int s = 0; s < METRIC_LATENCY_COUNT; s++) {
+        metrics_latency_snapshot((MetricLatency)s, &snapshot);
+        if (snapshot.count == 0) continue;
+        n = metrics_append(out, size, n, METRICS_PREFIX "latency_max_seconds{op=\"%s\"} %.9f\n",
+                           metrics_latency_name((MetricLatency)s), snapshot.max / 1e9);
+    }
+    return n;
+}
+
+static void metrics_send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) return;
+        data += sent;
+        length -= sent;
+    }
+}
+
+// Read one request (headers only) and answer it, the connection is closed afterwards
+static void metrics_serve(int fd) {
+    char request[METRICS_REQUEST_MAX];
+    size_t length = 0;
+    
+    struct timeval timeout = {1, 0};  // Don't let a silent peer hold up the scrape thread
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    
+    while (length < sizeof(request) - 1) {
+        ssize_t got = recv(fd, request + length, sizeof(request) - 1 - length, 0);
+        if (got <= 0) break;
+        length += got;
+        request[length] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+    }
+    request[length] = '\0';
+    
+    static char body[METRICS_BODY_MAX];
+    char header[256];
+    size_t body_length;
+    const char *status;
+    const char *type;
+    
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0) {
+        body_length = metrics_render(body, sizeof(body));
+        status = "200 OK";
+        type = "text/plain; version=0.0.4; charset=utf-8";
+    } else {
+        body_length = (size_t)snprintf(body, sizeof(body), "Not found, try /metrics\n");
+        status = "404 Not Found";
+        type = "text/plain; charset=utf-8";
+    }
+    
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                                 status, type, body_length);
+    metrics_send_all(fd, header, header_length);
+    metrics_send_all(fd, body, body_length);
+}
+
+static void *metrics_scrape_main(void *arg) {
+    (void)arg;
+    
+    while (atomic_load(&running)) {
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) continue;  // Re-check running a few times a second
+        
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        metrics_serve(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+// Start the scrape endpoint, returns 0 if it is disabled or can't listen
+// (counters keep counting either way)
+int metrics_init(void) {
+    int port = METRICS_PORT;
+    const char *override = getenv("METRICS_PORT");
+    if (override) port = atoi(override);
+    if (port <= 0 || port > 65535) {
+        log_write(LOG_INFO, LOG_SERVER, "Metrics endpoint: off");
+        return 0;
+    }
+    
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 0;
+    }
+    
+    int opt = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // Local scrapes only
+    addr.sin_port = htons(port);
+    
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 8) < 0) {
+        perror("metrics bind");
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    
+    atomic_store(&running, 1);
+    if (pthread_create(&scrape_thread, NULL, metrics_scrape_main, NULL) != 0) {
+        perror("pthread_create");
+        atomic_store(&running, 0);
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    
+    log_write(LOG_INFO, LOG_SERVER, "Metrics endpoint: http://127.0.0.1:%d/metrics", port);
+    return 1;
+}
+
+void metrics_shutdown(void) {
+    if (!atomic_load(&running)) return;
+    
+    atomic_store(&running, 0);
+    pthread_join(scrape_thread, NULL);
+    close(listen_fd);
+    listen_fd = -1;
+}
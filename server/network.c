@@ -17,6 +17,20 @@ void handle_pong(Server *server, int client_idx) {
     client->last_pong_time = now;
 }
 
+// Monotonic clock in milliseconds (for durations, not wall time)
+long long time_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Monotonic clock in nanoseconds (latency measurement)
+long long time_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 // Send PING to all connected clients
 void send_ping_to_all(Server *server) {
     for (int i = 0; i < MAX_CLIENTS; i++) {
@@ -38,8 +52,8 @@ void check_ping_timeouts(Server *server) {
             
             // Check if client hasn't responded to PONG
             if (now - client->last_pong_time > PING_TIMEOUT) {
-                printf("Client %s timed out (no PONG)\n", 
-                       client->username[0] ? client->username : "unknown");
+                log_write(LOG_INFO, LOG_NET, "Client %s timed out (no PONG)",
+                          client->username[0] ? client->username : "unknown");
                 client_disconnect(server, i);
             }
         }
@@ -60,12 +74,12 @@ void handle_chat(Server *server, int client_idx, const char *message) {
     snprintf(msg, sizeof(msg), "CHAT|%s|%s\n", client->username, message);
     room_broadcast(server, client->room_id, msg, -1);
     
-    printf("Chat from %s in room %d: %s\n", client->username, client->room_id, message);
+    log_write(LOG_DEBUG, LOG_CHAT, "Chat from %s in room %d: %s", client->username, client->room_id, message);
 }
 
 // Shutdown server gracefully
 void server_shutdown(Server *server) {
-    printf("Shutting down server...\n");
+    log_write(LOG_INFO, LOG_SERVER, "Shutting down server...");
     
     // Disconnect all clients
     for (int i = 0; i < MAX_CLIENTS; i++) {
@@ -75,9 +89,23 @@ void server_shutdown(Server *server) {
         }
     }
     
-    // Close listening socket
-    close(server->listen_fd);
+    // Close listening socket (already closed by a drain)
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+    }
+    admin_shutdown();
+    
+    // Finish queued account writes, then persist remaining player stats
+    account_shutdown(server);
+    matchlog_shutdown();
+    capture_shutdown();
+    trace_shutdown();
+    puzzle_bank_close();
+    puzzle_pool_shutdown();
+    metrics_shutdown();
+    watchdog_shutdown();
     
-    printf("Server shutdown complete\n");
+    log_write(LOG_INFO, LOG_SERVER, "Server shutdown complete");
+    log_shutdown();
 }
 
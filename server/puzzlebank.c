@@ -0,0 +1,248 @@
+#include "server.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Puzzle bank
+//
+// On-disk format: header (magic, generator version, record size, each
+// round's solution-count bound, then one {offset, count} section per round),
+// then each round's PuzzleBankRecord entries back to back.
+// tools/puzzle_bank_gen builds the file offline from calibrated, validated
+// puzzles, solving each and keeping only those within the round's bound. The
+// server maps it read-only at startup and each room draws records through its
+// own cursor; a draw only unpacks and compiles, neither the generator nor the
+// solver runs (answers are checked against the equation on submit). When a
+// room has seen every record of a round, or there is no bank, round start
+// falls back to the pool and then to puzzle_generate().
+
+#define PUZZLE_BANK_MAGIC "MPBANK02"
+#define PUZZLE_BANK_MAGIC_LEN 8
+
+typedef struct {
+    uint64_t offset;  // File offset of the round's first record
+    uint64_t count;
+} PuzzleBankSection;
+
+typedef struct {
+    char magic[PUZZLE_BANK_MAGIC_LEN];
+    uint32_t version;  // PUZZLE_GENERATOR_VERSION the bank was built with
+    uint32_t record_size;
+    uint32_t solution_bounds[PUZZLE_POOL_ROUNDS];  // Most answers any record of the round has
+    uint32_t reserved;
+    PuzzleBankSection sections[PUZZLE_POOL_ROUNDS];
+} PuzzleBankHeader;
+
+_Static_assert(sizeof(PuzzleBankHeader) % 8 == 0, "puzzle bank header layout");
+_Static_assert(sizeof(PuzzleBankRecord) % 4 == 0, "puzzle bank records must stay 4-byte aligned");
+
+// Mapped bank (event loop only)
+static void *bank_base = NULL;
+static size_t bank_size = 0;
+static const PuzzleBankRecord *bank_records[PUZZLE_POOL_ROUNDS];
+static uint32_t bank_counts[PUZZLE_POOL_ROUNDS];
+static uint32_t bank_bounds[PUZZLE_POOL_ROUNDS];
+static long served = 0;
+static long exhausted = 0;  // Takes that found the room's cursor used up
+
+// Map bank read-only and check its layout, returns 0 if there is no usable bank
+int puzzle_bank_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            log_write(LOG_INFO, LOG_PUZZLE, "Puzzle bank %s: not found", path);
+        } else {
+            perror("open");
+        }
+        return 0;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(PuzzleBankHeader)) {
+        log_write(LOG_WARN, LOG_PUZZLE, "Puzzle bank %s: too short", path);
+        close(fd);
+        return 0;
+    }
+    
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+    
+    const PuzzleBankHeader *header = base;
+    if (memcmp(header->magic, PUZZLE_BANK_MAGIC, PUZZLE_BANK_MAGIC_LEN) != 0 ||
+        header->version != PUZZLE_GENERATOR_VERSION || header->record_size != sizeof(PuzzleBankRecord)) {
+        log_write(LOG_WARN, LOG_PUZZLE, "Puzzle bank %s: bad header, record layout or generator version", path);
+        munmap(base, st.st_size);
+        return 0;
+    }
+    
+    uint64_t total = 0;
+    for (int r = 0; r < PUZZLE_POOL_ROUNDS; r++) {
+        const PuzzleBankSection *section = &header->sections[r];
+        if (section->offset < sizeof(PuzzleBankHeader) || section->offset % 4 != 0 ||
+            section->count > UINT32_MAX ||
+            section->offset + section->count * sizeof(PuzzleBankRecord) > (uint64_t)st.st_size) {
+            log_write(LOG_WARN, LOG_PUZZLE, "Puzzle bank %s: round %d section out of bounds", path, r + 1);
+            munmap(base, st.st_size);
+            return 0;
+        }
+        bank_records[r] = (const PuzzleBankRecord *)((const char *)base + section->offset);
+        bank_counts[r] = (uint32_t)section->count;
+        bank_bounds[r] = header->solution_bounds[r];
+        total += section->count;
+    }
+    
+    // Rooms jump around the file, don't let the kernel read ahead
+    madvise(base, st.st_size, MADV_RANDOM);
+    
+    bank_base = base;
+    bank_size = st.st_size;
+    log_write(LOG_INFO, LOG_PUZZLE, "Puzzle bank %s: %llu puzzles (%u/%u/%u/%u/%u per round, at most %u/%u/%u/%u/%u answers)",
+              path, (unsigned long long)total, bank_counts[0], bank_counts[1], bank_counts[2], bank_counts[3], bank_counts[4],
+              bank_bounds[0], bank_bounds[1], bank_bounds[2], bank_bounds[3], bank_bounds[4]);
+    return 1;
+}
+
+void puzzle_bank_close(void) {
+    if (!bank_base) return;
+    
+    munmap(bank_base, bank_size);
+    bank_base = NULL;
+    bank_size = 0;
+    memset(bank_counts, 0, sizeof(bank_counts));
+    
+    log_write(LOG_INFO, LOG_PUZZLE, "Puzzle bank: %ld rounds served, %ld fell back after a room used up its rounds", served, exhausted);
+}
+
+// Start a room at a random record of every round
+void puzzle_bank_cursor_init(PuzzleBankCursor *cursor, Rng *rng) {
+    for (int r = 0; r < PUZZLE_POOL_ROUNDS; r++) {
+        cursor->start[r] = rng_next(rng);
+        cursor->taken[r] = 0;
+    }
+}
+
+// 1 if the bank still has a record of round the room hasn't seen
+int puzzle_bank_available(int round, const PuzzleBankCursor *cursor) {
+    return bank_base && round >= 1 && round <= PUZZLE_POOL_ROUNDS &&
+           cursor->taken[round - 1] < bank_counts[round - 1];
+}
+
+// Unpack the room's next record for round, returns 0 if the bank has none left for it
+int puzzle_bank_take(int round, PuzzleBankCursor *cursor, Puzzle *puzzle) {
+    if (!bank_base || round < 1 || round > PUZZLE_POOL_ROUNDS || bank_counts[round - 1] == 0) {
+        return 0;
+    }
+    
+    uint32_t count = bank_counts[round - 1];
+    if (cursor->taken[round - 1] >= count) {
+        exhausted++;
+        return 0;
+    }
+    
+    const PuzzleBankRecord *record =
+        &bank_records[round - 1][(cursor->start[round - 1] % count + cursor->taken[round - 1]) % count];
+    cursor->taken[round - 1]++;
+    
+    puzzle->format = record->format;
+    puzzle->op1 = record->ops[0];
+    puzzle->op2 = record->ops[1];
+    puzzle->op3 = record->ops[2];
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        for (int c = 0; c < MATRIX_SIZE * MATRIX_SIZE; c++) {
+            puzzle->matrices[m].data[c / MATRIX_SIZE][c % MATRIX_SIZE] = record->cells[m][c];
+        }
+        int cell = record->solution_cells[m] % (MATRIX_SIZE * MATRIX_SIZE);
+        puzzle->solution_row[m] = cell / MATRIX_SIZE;
+        puzzle->solution_col[m] = cell % MATRIX_SIZE;
+        puzzle->solution_values[m] = record->cells[m][cell];
+    }
+    puzzle->result = (puzzle->format == FORMAT_P1_EQ_P2_P3_P4) ? puzzle->solution_values[0] : puzzle->solution_values[3];
+    puzzle->round = round;
+    puzzle->seed = record->seed;
+    puzzle->solution_count = record->solution_count;
+    puzzle->difficulty = record->difficulty;
+    if (!expr_compile_format(&puzzle->equation, puzzle->format, puzzle->op1, puzzle->op2)) {
+        log_write(LOG_WARN, LOG_PUZZLE, "Puzzle bank: round %d record %u has an unknown format, generating instead",
+                  round, (unsigned int)(record - bank_records[round - 1]));
+        return 0;
+    }
+    
+    // The generator solved the record and stored its answer count: a
+    // planted answer that doesn't hold or a count outside the bound means damage
+    if (!puzzle_check_values(puzzle, puzzle->solution_values) || record->solution_count < 1 ||
+        (uint32_t)record->solution_count > bank_bounds[round - 1]) {
+        log_write(LOG_WARN, LOG_PUZZLE, "Puzzle bank: round %d record %u damaged, generating instead",
+                  round, (unsigned int)(record - bank_records[round - 1]));
+        return 0;
+    }
+    
+    served++;
+    return 1;
+}
+
+// Pack a generated puzzle, returns 0 if a cell doesn't fit the record
+int puzzle_bank_pack(const Puzzle *puzzle, PuzzleBankRecord *record) {
+    memset(record, 0, sizeof(PuzzleBankRecord));
+    record->seed = puzzle->seed;
+    record->solution_count = puzzle->solution_count;
+    record->difficulty = puzzle->difficulty;
+    record->format = (uint8_t)puzzle->format;
+    record->ops[0] = (uint8_t)puzzle->op1;
+    record->ops[1] = (uint8_t)puzzle->op2;
+    record->ops[2] = (uint8_t)puzzle->op3;
+    
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        for (int c = 0; c < MATRIX_SIZE * MATRIX_SIZE; c++) {
+            int value = puzzle->matrices[m].data[c / MATRIX_SIZE][c % MATRIX_SIZE];
+            if (value < INT16_MIN || value > INT16_MAX) return 0;
+            record->cells[m][c] = (int16_t)value;
+        }
+        record->solution_cells[m] = (uint8_t)(puzzle->solution_row[m] * MATRIX_SIZE + puzzle->solution_col[m]);
+    }
+    return 1;
+}
+
+// Write a bank file with counts[r] records for round r + 1, none with more
+// than bounds[r] answers (via a temp file and rename)
+int puzzle_bank_write(const char *path, PuzzleBankRecord *const records[PUZZLE_POOL_ROUNDS],
+                      const uint32_t counts[PUZZLE_POOL_ROUNDS], const uint32_t bounds[PUZZLE_POOL_ROUNDS]) {
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        perror("fopen");
+        return 0;
+    }
+    
+    PuzzleBankHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PUZZLE_BANK_MAGIC, PUZZLE_BANK_MAGIC_LEN);
+    header.version = PUZZLE_GENERATOR_VERSION;
+    header.record_size = sizeof(PuzzleBankRecord);
+    
+    uint64_t offset = sizeof(header);
+    for (int r = 0; r < PUZZLE_POOL_ROUNDS; r++) {
+        header.solution_bounds[r] = bounds[r];
+        header.sections[r].offset = offset;
+        header.sections[r].count = counts[r];
+        offset += (uint64_t)counts[r] * sizeof(PuzzleBankRecord);
+    }
+    
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int r = 0; r < PUZZLE_POOL_ROUNDS && ok; r++) {
+        ok = fwrite(records[r], sizeof(PuzzleBankRecord), counts[r], file) == counts[r];
+    }
+    
+    if (fclose(file) != 0) ok = 0;
+    if (!ok || rename(temp_path, path) < 0) {
+        perror("puzzle bank write");
+        unlink(temp_path);
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,240 @@
+#include "server.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+// Puzzle pool
+//
+// A producer thread keeps PUZZLE_POOL_DEPTH ready puzzles per round in
+// single-producer/single-consumer rings. The event loop is the only consumer:
+// taking a puzzle is two atomic loads, a copy and a release store, with no
+// lock. After each take the consumer posts refill_sem so the producer, which
+// sleeps once every ring is full, tops the rings back up. The producer also
+// calibrates: it keeps drawing candidates until one scores inside the round's
+// difficulty band, which costs the event loop nothing.
+//
+// Rooms also ask ahead for their own next puzzle (puzzle_pool_request) with
+// a seed drawn from the room's generator, through a second SPSC ring the
+// producer drains before every refill. The result goes to the room's slot and
+// is published by storing the request's ticket, so a room that moved on (a
+// lost game asks for round 1 again) just sees a stale ticket. With a fixed
+// PUZZLE_SEED the rings stay empty: which pooled puzzle a room gets depends on
+// producer timing, while a request is plain puzzle_generate(round, seed),
+// which the event loop can rebuild from the same seed if it isn't ready.
+
+#define PUZZLE_REQUEST_SLOTS 64  // Outstanding room requests (power of two, above MAX_ROOMS)
+
+_Static_assert((PUZZLE_POOL_DEPTH & (PUZZLE_POOL_DEPTH - 1)) == 0, "ring indices wrap, depth must be a power of two");
+_Static_assert((PUZZLE_REQUEST_SLOTS & (PUZZLE_REQUEST_SLOTS - 1)) == 0 && PUZZLE_REQUEST_SLOTS > MAX_ROOMS,
+               "request ring indices wrap and every room needs a slot");
+
+typedef struct {
+    Puzzle slots[PUZZLE_POOL_DEPTH];
+    atomic_uint head;  // Next slot to fill (written by producer)
+    atomic_uint tail;  // Next slot to take (written by consumer)
+} PuzzleQueue;
+
+typedef struct {
+    int room_id;
+    int round;
+    unsigned int seed;
+    unsigned int ticket;
+} PuzzleRequest;
+
+typedef struct {
+    PuzzleRequest slots[PUZZLE_REQUEST_SLOTS];
+    atomic_uint head;  // Next slot to fill (written by event loop)
+    atomic_uint tail;  // Next slot to serve (written by producer)
+} PuzzleRequestQueue;
+
+// A room's requested puzzle, valid once ready holds the request's ticket
+typedef struct {
+    Puzzle puzzle;
+    atomic_uint ready;
+} PuzzleRoomSlot;
+
+static PuzzleQueue queues[PUZZLE_POOL_ROUNDS];
+static PuzzleRequestQueue requests;
+static PuzzleRoomSlot room_slots[MAX_ROOMS];
+static pthread_t producer_thread;
+static sem_t refill_sem;
+static atomic_int running = 0;
+static int filling = 0;           // Round queues in use (0 with a fixed PUZZLE_SEED), set before start
+static Rng seed_rng;              // Producer-only generator for puzzle seeds
+static long produced = 0;         // Producer only, read after join
+static long candidates = 0;
+static long served_requests = 0;
+static unsigned int last_ticket = 0;  // Event loop only
+static long hits = 0;
+static long misses = 0;
+static long collected = 0;
+static long late = 0;             // Requests not ready when their round started
+
+// Fill one free slot of a round's queue, returns 0 if it is full
+static int puzzle_pool_fill(int round) {
+    PuzzleQueue *queue = &queues[round - 1];
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    
+    if (head - tail == PUZZLE_POOL_DEPTH) return 0;
+    
+    candidates += puzzle_generate_calibrated(&queue->slots[head % PUZZLE_POOL_DEPTH], round, &seed_rng);
+    produced++;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 1;
+}
+
+// Build every queued room request, returns how many
+static int puzzle_pool_serve_requests(void) {
+    unsigned int tail = atomic_load_explicit(&requests.tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&requests.head, memory_order_acquire);
+    int served = 0;
+    
+    for (; tail != head && atomic_load(&running); tail++, served++) {
+        PuzzleRequest request = requests.slots[tail % PUZZLE_REQUEST_SLOTS];
+        atomic_store_explicit(&requests.tail, tail + 1, memory_order_release);
+        
+        PuzzleRoomSlot *slot = &room_slots[request.room_id];
+        if (filling) {
+            Rng rng;
+            rng_seed(&rng, request.seed, request.round);
+            candidates += puzzle_generate_calibrated(&slot->puzzle, request.round, &rng);
+            produced++;
+        } else {
+            puzzle_generate(&slot->puzzle, request.round, request.seed);
+        }
+        atomic_store_explicit(&slot->ready, request.ticket, memory_order_release);
+    }
+    served_requests += served;
+    return served;
+}
+
+// Producer thread: room requests first, then refill lowest rounds first,
+// sleep when there is nothing to do
+static void *puzzle_pool_main(void *arg) {
+    (void)arg;
+    
+    while (atomic_load(&running)) {
+        int filled = puzzle_pool_serve_requests();
+        for (int round = 1; filling && round <= PUZZLE_POOL_ROUNDS; round++) {
+            while (atomic_load(&running) && puzzle_pool_fill(round)) {
+                filled += 1 + puzzle_pool_serve_requests();
+            }
+        }
+        
+        if (filled == 0) {
+            sem_wait(&refill_sem);
+        }
+    }
+    
+    return NULL;
+}
+
+// Start producer thread (0 = pool disabled, every round generates inline).
+// With fixed_seed the round queues stay empty and only room requests are built.
+int puzzle_pool_init(unsigned int seed, int fixed_seed) {
+    rng_seed(&seed_rng, seed, PUZZLE_POOL_ROUNDS);
+    filling = !fixed_seed;
+    
+    if (sem_init(&refill_sem, 0, 0) < 0) {
+        perror("sem_init");
+        return 0;
+    }
+    
+    atomic_store(&running, 1);
+    if (pthread_create(&producer_thread, NULL, puzzle_pool_main, NULL) != 0) {
+        perror("pthread_create");
+        atomic_store(&running, 0);
+        sem_destroy(&refill_sem);
+        return 0;
+    }
+    
+    if (filling) {
+        log_write(LOG_INFO, LOG_PUZZLE, "Puzzle pool: %d puzzles per round, %d rounds", PUZZLE_POOL_DEPTH, PUZZLE_POOL_ROUNDS);
+    } else {
+        log_write(LOG_INFO, LOG_PUZZLE, "Puzzle pool: fixed seed, only building rooms' next puzzles");
+    }
+    return 1;
+}
+
+// Stop producer thread
+void puzzle_pool_shutdown(void) {
+    if (!atomic_load(&running)) return;
+    
+    atomic_store(&running, 0);
+    sem_post(&refill_sem);
+    pthread_join(producer_thread, NULL);
+    sem_destroy(&refill_sem);
+    
+    log_write(LOG_INFO, LOG_PUZZLE, "Puzzle pool: %ld of %ld requested puzzles ready in time (%ld late), "
+              "%ld rounds served from pool, %ld missed it", collected, served_requests, late, hits, misses);
+    if (produced > 0) {
+        log_write(LOG_INFO, LOG_PUZZLE, "Puzzle pool: %.2f candidates per calibrated puzzle", (double)candidates / produced);
+    }
+}
+
+// Take a ready puzzle for round (event loop only), returns 0 if none is ready
+int puzzle_pool_take(int round, Puzzle *puzzle) {
+    if (!atomic_load_explicit(&running, memory_order_relaxed) || !filling ||
+        round < 1 || round > PUZZLE_POOL_ROUNDS) {
+        misses++;
+        return 0;
+    }
+    
+    PuzzleQueue *queue = &queues[round - 1];
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    
+    if (head == tail) {
+        misses++;
+        return 0;
+    }
+    
+    *puzzle = queue->slots[tail % PUZZLE_POOL_DEPTH];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    sem_post(&refill_sem);
+    
+    hits++;
+    return 1;
+}
+
+// Queue puzzle_generate(round, seed) for room_id (calibrated from seed unless
+// the seed is fixed), event loop only. Returns the ticket to collect it with,
+// 0 if the pool isn't running or the request ring is full.
+unsigned int puzzle_pool_request(int room_id, int round, unsigned int seed) {
+    if (!atomic_load_explicit(&running, memory_order_relaxed) || room_id < 0 || room_id >= MAX_ROOMS) {
+        return 0;
+    }
+    
+    unsigned int head = atomic_load_explicit(&requests.head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&requests.tail, memory_order_acquire);
+    if (head - tail == PUZZLE_REQUEST_SLOTS) return 0;
+    
+    if (++last_ticket == 0) last_ticket = 1;
+    PuzzleRequest *request = &requests.slots[head % PUZZLE_REQUEST_SLOTS];
+    request->room_id = room_id;
+    request->round = round;
+    request->seed = seed;
+    request->ticket = last_ticket;
+    atomic_store_explicit(&requests.head, head + 1, memory_order_release);
+    sem_post(&refill_sem);
+    return last_ticket;
+}
+
+// Copy room_id's requested puzzle if the producer has built it (event loop
+// only), returns 0 if it isn't ready. The room's latest ticket is the only
+// one the producer can still be writing for, so a matching ticket means the
+// slot is complete.
+int puzzle_pool_collect(int room_id, unsigned int ticket, Puzzle *puzzle) {
+    if (ticket == 0 || room_id < 0 || room_id >= MAX_ROOMS) return 0;
+    
+    PuzzleRoomSlot *slot = &room_slots[room_id];
+    if (atomic_load_explicit(&slot->ready, memory_order_acquire) != ticket) {
+        late++;
+        return 0;
+    }
+    
+    *puzzle = slot->puzzle;
+    collected++;
+    return 1;
+}
@@ -0,0 +1,49 @@
+#include "server.h"
+
+// Random number generator
+//
+// PCG32 (XSH-RR output over a 64-bit LCG): 16 bytes of state per generator,
+// no global state, so every room and worker thread owns its own stream.
+// Bounded draws use Lemire's multiply-shift with rejection, which removes
+// the modulo bias of rand() % n.
+
+#define RNG_MULTIPLIER 6364136223846793005ULL
+
+// Seed generator; different streams give independent sequences for the same seed
+void rng_seed(Rng *rng, uint64_t seed, uint64_t stream) {
+    rng->state = 0;
+    rng->inc = (stream << 1) | 1;
+    rng_next(rng);
+    rng->state += seed;
+    rng_next(rng);
+}
+
+// Next 32 uniformly distributed bits
+uint32_t rng_next(Rng *rng) {
+    uint64_t old_state = rng->state;
+    rng->state = old_state * RNG_MULTIPLIER + rng->inc;
+    
+    uint32_t xorshifted = (uint32_t)(((old_state >> 18) ^ old_state) >> 27);
+    uint32_t rot = (uint32_t)(old_state >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// Uniform value in [0, bound), bound > 0
+uint32_t rng_below(Rng *rng, uint32_t bound) {
+    uint64_t product = (uint64_t)rng_next(rng) * bound;
+    uint32_t low = (uint32_t)product;
+    
+    if (low < bound) {
+        uint32_t threshold = -bound % bound;  // 2^32 mod bound
+        while (low < threshold) {
+            product = (uint64_t)rng_next(rng) * bound;
+            low = (uint32_t)product;
+        }
+    }
+    return (uint32_t)(product >> 32);
+}
+
+// Uniform value in [min_val, max_val]
+int rng_range(Rng *rng, int min_val, int max_val) {
+    return min_val + (int)rng_below(rng, (uint32_t)(max_val - min_val + 1));
+}
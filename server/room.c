@@ -25,6 +25,9 @@ int room_create(Server *server, const char *name) {
     room->game_started = 0;
     room->host_index = -1;  // Will be set when first player joins
     room->waiting_for_continue = 0;  // Not waiting for continue initially
+    rng_seed(&room->rng, ((uint64_t)rng_next(&server->rng) << 32) | rng_next(&server->rng), room_idx);
+    puzzle_bank_cursor_init(&room->bank_cursor, &room->rng);
+    room_request_puzzle(room, 1);
     
     for (int i = 0; i < PLAYERS_PER_ROOM; i++) {
         room->player_ids[i] = -1;
@@ -32,7 +35,7 @@ int room_create(Server *server, const char *name) {
         room->round_continue_ready[i] = 0;
     }
     
-    printf("Room created: %s (ID: %d)\n", name, room_idx);
+    log_write(LOG_INFO, LOG_ROOM, "Room created: %s (ID: %d)", name, room_idx);
     return room_idx;
 }
 
@@ -72,14 +75,14 @@ int room_join(Server *server, int room_id, int client_idx) {
     // Set first player as host
     if (room->host_index == -1) {
         room->host_index = slot;
-        printf("Player %s is now the host of room %d\n", client->username, room_id);
+        log_write(LOG_INFO, LOG_ROOM, "Player %s is now the host of room %d", client->username, room_id);
     }
     
     client->room_id = room_id;
     client->player_index = slot;
     client->state = STATE_IN_ROOM;
     
-    printf("Player %s joined room %d (slot %d)\n", client->username, room_id, slot);
+    log_write(LOG_INFO, LOG_ROOM, "Player %s joined room %d (slot %d)", client->username, room_id, slot);
     
     // Notify all players in room
     char msg[256];
@@ -176,7 +179,7 @@ void handle_leave_room(Server *server, int client_idx) {
                 for (int j = 0; j < PLAYERS_PER_ROOM; j++) {
                     if (room->player_ids[j] >= 0 && j != i) {
                         room->host_index = j;
-                        printf("New host for room %d: slot %d\n", room_id, j);
+                        log_write(LOG_INFO, LOG_ROOM, "New host for room %d: slot %d", room_id, j);
                         break;
                     }
                 }
@@ -205,18 +208,24 @@ void handle_leave_room(Server *server, int client_idx) {
     // Send room list to client
     send_room_list(server, client_idx);
     
-    printf("Player %s left room %d\n", client->username, room_id);
+    log_write(LOG_INFO, LOG_ROOM, "Player %s left room %d", client->username, room_id);
 }
 
 // Handle ready request
 void handle_ready(Server *server, int client_idx) {
     Client *client = &server->clients[client_idx];
+    long long start_ns = time_now_ns();
     
     if (client->state != STATE_IN_ROOM && client->state != STATE_READY) {
         client_send(client, "ERROR|Must be in room to ready\n");
         return;
     }
     
+    if (server->draining) {
+        client_send(client, "ERROR|Server is shutting down, no new games\n");
+        return;
+    }
+    
     int room_id = client->room_id;
     Room *room = &server->rooms[room_id];
     
@@ -226,10 +235,10 @@ void handle_ready(Server *server, int client_idx) {
     
     if (room->player_ready[slot]) {
         client->state = STATE_READY;
-        printf("Player %s is ready\n", client->username);
+        log_write(LOG_INFO, LOG_ROOM, "Player %s is ready", client->username);
     } else {
         client->state = STATE_IN_ROOM;
-        printf("Player %s is not ready\n", client->username);
+        log_write(LOG_INFO, LOG_ROOM, "Player %s is not ready", client->username);
     }
     
     // Send status update to all
@@ -248,6 +257,7 @@ void handle_ready(Server *server, int client_idx) {
         if (all_ready) {
             // Start the game!
             room_start_game(server, room_id);
+            trace_span(room, "handle_ready", start_ns, "slot", slot);
         }
     }
 }
@@ -261,6 +271,11 @@ void handle_start_game(Server *server, int client_idx) {
         return;
     }
     
+    if (server->draining) {
+        client_send(client, "ERROR|Server is shutting down, no new games\n");
+        return;
+    }
+    
     int room_id = client->room_id;
     Room *room = &server->rooms[room_id];
     
@@ -289,9 +304,11 @@ void handle_start_game(Server *server, int client_idx) {
     }
     
     // Start the game!
-    printf("Host %s starting game in room %d with %d players\n", 
-           client->username, room_id, room->player_count);
+    log_write(LOG_INFO, LOG_ROOM, "Host %s starting game in room %d with %d players",
+              client->username, room_id, room->player_count);
+    long long start_ns = time_now_ns();
     room_start_game(server, room_id);
+    trace_span(room, "handle_start_game", start_ns, "slot", client->player_index);
 }
 
 // Broadcast message to all players in room
@@ -310,7 +327,7 @@ void room_broadcast(Server *server, int room_id, const char *message, int exclud
 void room_cleanup(Server *server, int room_id) {
     Room *room = &server->rooms[room_id];
     
-    printf("Cleaning up room %d\n", room_id);
+    log_write(LOG_INFO, LOG_ROOM, "Cleaning up room %d", room_id);
     
     // Remove all players from room
     for (int i = 0; i < PLAYERS_PER_ROOM; i++) {
@@ -349,6 +366,7 @@ void send_room_list(Server *server, int client_idx) {
 // Send room status to all players in room
 void send_room_status(Server *server, int room_id) {
     Room *room = &server->rooms[room_id];
+    long long start_ns = time_now_ns();
     
     char buffer[BUFFER_SIZE];
     int offset = 0;
@@ -368,5 +386,6 @@ void send_room_status(Server *server, int room_id) {
     
     offset += snprintf(buffer + offset, BUFFER_SIZE - offset, "\n");
     room_broadcast(server, room_id, buffer, -1);
+    metrics_latency_since(METRIC_LATENCY_SEND_ROOM_STATUS, start_ns);
 }
 
@@ -1,9 +1,42 @@
 #include "server.h"
+#include <signal.h>
+
+// Set by server_request_stop() (SIGINT/SIGTERM), checked by server_run()
+static volatile sig_atomic_t stop_requested = 0;
+
+// Set by server_request_latency_dump() (SIGUSR1), checked by server_run(); also snapshots the trace
+static volatile sig_atomic_t latency_dump_requested = 0;
+
+// Ask server_run() to return after the current iteration (async-signal-safe)
+void server_request_stop(void) {
+    stop_requested = 1;
+}
+
+// Ask server_run() to log the latency report (async-signal-safe)
+void server_request_latency_dump(void) {
+    latency_dump_requested = 1;
+}
+
+// Stop accepting connections and new games; server_run() returns once running games end
+void server_drain(Server *server) {
+    if (server->draining) return;
+    
+    server->draining = 1;
+    FD_CLR(server->listen_fd, &server->master_set);
+    close(server->listen_fd);
+    server->listen_fd = -1;
+    log_write(LOG_WARN, LOG_SERVER, "Draining: refusing connections and new games, stopping when running games end");
+}
 
 // Initialize server
 void server_init(Server *server) {
     memset(server, 0, sizeof(Server));
     
+    // Logger first so every later module logs through it (synchronous if it can't start)
+    if (!log_init()) {
+        log_write(LOG_WARN, LOG_SERVER, "Logger thread disabled, logging synchronously");
+    }
+    
     // Create listening socket
     server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server->listen_fd < 0) {
@@ -57,29 +90,118 @@ void server_init(Server *server) {
     
     server->last_tick_time = time(NULL);
     
-    printf("Server initialized on port %d\n", PORT);
+    // PUZZLE_SEED fixes every room's puzzle sequence so a captured session replays identically
+    const char *puzzle_seed = getenv("PUZZLE_SEED");
+    uint64_t seed = puzzle_seed ? strtoull(puzzle_seed, NULL, 10) : (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+    rng_seed(&server->rng, seed, 0);
+    
+    // Test hooks for tools/loadgen, never enable on a public server
+    const char *debug_hooks = getenv("DEBUG_HOOKS");
+    server->debug_hooks = debug_hooks && strcmp(debug_hooks, "1") == 0;
+    if (server->debug_hooks) {
+        log_write(LOG_WARN, LOG_SERVER, "Debug hooks enabled: clients can ask for puzzle answers");
+    }
+    
+    // Start account backend and load registered usernames
+    if (!account_init()) {
+        exit(1);
+    }
+    auth_init();
+    stats_init();
+    
+    // Pre-generate puzzles off the event loop (round start falls back to inline generation).
+    // Which pooled puzzle a room gets depends on producer timing, so a fixed seed
+    // only builds each room's next puzzle from its own seed
+    if (puzzle_seed) {
+        log_write(LOG_WARN, LOG_SERVER, "Puzzle pool queues disabled: PUZZLE_SEED=%llu", (unsigned long long)seed);
+    }
+    if (!puzzle_pool_init(rng_next(&server->rng), puzzle_seed != NULL)) {
+        log_write(LOG_WARN, LOG_SERVER, "Puzzle pool disabled");
+    }
+    
+    // Serve pre-built puzzles when a bank file is present
+    if (!puzzle_bank_open(PUZZLE_BANK_FILE)) {
+        log_write(LOG_WARN, LOG_SERVER, "Puzzle bank disabled");
+    }
+    
+    // Match history is optional: keep serving if the log can't be opened
+    if (!matchlog_init(MATCHLOG_FILE)) {
+        log_write(LOG_WARN, LOG_SERVER, "Match log disabled");
+    }
+    
+    // Record traffic for tools/replay when asked to
+    const char *capture_path = getenv("CAPTURE_FILE");
+    if (capture_path && !capture_init(capture_path, seed, puzzle_seed != NULL)) {
+        log_write(LOG_WARN, LOG_SERVER, "Traffic capture disabled");
+    }
+    
+    // Span the round lifecycle per room when asked to
+    const char *trace_path = getenv("TRACE_FILE");
+    if (trace_path && !trace_init(trace_path)) {
+        log_write(LOG_WARN, LOG_SERVER, "Tracing disabled");
+    }
+    
+    // Metrics are always counted, the scrape endpoint is optional
+    if (!metrics_init()) {
+        log_write(LOG_WARN, LOG_SERVER, "Metrics endpoint disabled");
+    }
+    
+    // Loop iterations are always timed, live stall reports need the watchdog thread
+    if (!watchdog_init()) {
+        log_write(LOG_WARN, LOG_SERVER, "Stall watchdog disabled");
+    }
+    
+    // Local control socket, answered from the loop
+    if (!admin_init()) {
+        log_write(LOG_WARN, LOG_SERVER, "Admin socket disabled");
+    }
+    
+    // Wake select() when account requests complete
+    FD_SET(account_completion_fd(), &server->master_set);
+    if (account_completion_fd() > server->max_fd) {
+        server->max_fd = account_completion_fd();
+    }
+    
+    log_write(LOG_INFO, LOG_SERVER, "Server initialized on port %d", PORT);
 }
 
 // Main server loop with select()
 void server_run(Server *server) {
-    while (1) {
+    while (!stop_requested) {
+        if (latency_dump_requested) {
+            latency_dump_requested = 0;
+            metrics_log_latency();
+            trace_snapshot();
+        }
+        
         fd_set read_fds = server->master_set;
+        fd_set write_fds;
+        FD_ZERO(&write_fds);
+        int max_fd = admin_fill_fds(&read_fds, &write_fds, server->max_fd);
         struct timeval timeout;
         timeout.tv_sec = 1;  // Check every second
         timeout.tv_usec = 0;
         
-        int activity = select(server->max_fd + 1, &read_fds, NULL, NULL, &timeout);
+        int activity = select(max_fd + 1, &read_fds, &write_fds, NULL, &timeout);
         
         if (activity < 0) {
-            perror("select");
+            if (errno != EINTR) {
+                perror("select");
+            }
             continue;
         }
+        watchdog_begin_iteration();
         
         // Check for new connections
-        if (FD_ISSET(server->listen_fd, &read_fds)) {
+        if (server->listen_fd >= 0 && FD_ISSET(server->listen_fd, &read_fds)) {
             client_accept(server);
         }
         
+        // Deliver finished account requests
+        if (FD_ISSET(account_completion_fd(), &read_fds)) {
+            account_dispatch_completions(server);
+        }
+        
         // Check existing clients
         for (int i = 0; i < MAX_CLIENTS; i++) {
             if (server->clients[i].active && FD_ISSET(server->clients[i].socket_fd, &read_fds)) {
@@ -87,10 +209,15 @@ void server_run(Server *server) {
             }
         }
         
+        // Admin queries see the state after this iteration's client messages
+        admin_process(server, &read_fds, &write_fds);
+        
         // Periodic tasks (every second)
         time_t now = time(NULL);
         if (now - server->last_tick_time >= 1) {
             server->last_tick_time = now;
+            watchdog_enter_phase(LOOP_PHASE_TIMERS);
+            long long task_start = time_now_ns();
             
             // Update game timers
             for (int i = 0; i < MAX_ROOMS; i++) {
@@ -106,31 +233,62 @@ void server_run(Server *server) {
                     }
                 }
             }
+            task_start = metrics_latency_since(METRIC_LATENCY_GAME_TIMERS, task_start);
             
             // Send room status updates every 2 seconds for active rooms (not in game)
             static time_t last_room_update = 0;
             if (now - last_room_update >= 2) {
+                watchdog_enter_phase(LOOP_PHASE_BROADCASTS);
                 for (int i = 0; i < MAX_ROOMS; i++) {
                     if (server->rooms[i].active && !server->rooms[i].game_started) {
                         send_room_status(server, i);
                     }
                 }
                 last_room_update = now;
+                task_start = metrics_latency_since(METRIC_LATENCY_ROOM_STATUS, task_start);
             }
             
             // Check ping timeouts
+            watchdog_enter_phase(LOOP_PHASE_TIMERS);
             check_ping_timeouts(server);
+            task_start = metrics_latency_since(METRIC_LATENCY_PING_TIMEOUTS, task_start);
             
             // Check reconnect timeouts
             check_reconnect_timeouts(server);
+            task_start = metrics_latency_since(METRIC_LATENCY_RECONNECT_TIMEOUTS, task_start);
             
             // Send PING every interval
             static time_t last_ping = 0;
             if (now - last_ping >= PING_INTERVAL) {
+                watchdog_enter_phase(LOOP_PHASE_BROADCASTS);
                 send_ping_to_all(server);
                 last_ping = now;
+                task_start = metrics_latency_since(METRIC_LATENCY_PINGS, task_start);
+            }
+            
+            // Persist player stats in the background
+            watchdog_enter_phase(LOOP_PHASE_HOUSEKEEPING);
+            stats_flush(0);
+            task_start = metrics_latency_since(METRIC_LATENCY_STATS_FLUSH, task_start);
+            
+            // Refresh metric gauges for the next scrape
+            metrics_sample(server);
+            metrics_latency_since(METRIC_LATENCY_METRICS_SAMPLE, task_start);
+            
+            // A drain is done when no game is left running
+            if (server->draining) {
+                int games = 0;
+                for (int i = 0; i < MAX_ROOMS; i++) {
+                    if (server->rooms[i].active && server->rooms[i].game_started) games++;
+                }
+                if (games == 0) {
+                    log_write(LOG_INFO, LOG_SERVER, "Drain complete, stopping");
+                    stop_requested = 1;
+                }
             }
         }
+        
+        watchdog_end_iteration();
     }
 }
 
@@ -155,12 +313,14 @@ int client_accept(Server *server) {
     }
     
     if (client_idx == -1) {
-        printf("Max clients reached, rejecting connection\n");
+        log_write(LOG_WARN, LOG_NET, "Max clients reached, rejecting connection");
+        metrics_count(METRIC_CONNECTIONS_REJECTED, 1);
         close(new_socket);
         return -1;
     }
     
-    // Initialize client
+    // Initialize client (connections are numbered from 1 for account completions and traffic capture)
+    static uint32_t next_conn_id = 0;
     Client *client = &server->clients[client_idx];
     memset(client, 0, sizeof(Client));
     client->socket_fd = new_socket;
@@ -170,6 +330,8 @@ int client_accept(Server *server) {
     client->player_index = -1;
     client->last_pong_time = time(NULL);
     client->last_ping_time = time(NULL);
+    client->conn_id = ++next_conn_id;
+    capture_record(CAPTURE_OPEN, client->conn_id, NULL, 0);
     
     // Add to fd_set
     FD_SET(new_socket, &server->master_set);
@@ -177,10 +339,11 @@ int client_accept(Server *server) {
         server->max_fd = new_socket;
     }
     
-    printf("New client connected: %s:%d (socket %d, index %d)\n",
-           inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port),
-           new_socket, client_idx);
+    log_write(LOG_INFO, LOG_NET, "New client connected: %s:%d (socket %d, index %d)",
+              inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port),
+              new_socket, client_idx);
     
+    metrics_count(METRIC_CONNECTIONS_ACCEPTED, 1);
     client_send(client, "WELCOME|Math Puzzle Game Server v2.0\n");
     
     return client_idx;
@@ -193,9 +356,9 @@ void client_mark_disconnected(Server *server, int client_idx) {
     
     if (!client->active) return;
     
-    printf("Client disconnected: %s (socket %d), allowing reconnect...\n", 
-           client->username[0] ? client->username : "unknown", 
-           client->socket_fd);
+    log_write(LOG_INFO, LOG_NET, "Client disconnected: %s (socket %d), allowing reconnect...",
+              client->username[0] ? client->username : "unknown", 
+              client->socket_fd);
     
     // Save state before disconnect
     client->saved_state = client->state;
@@ -203,6 +366,7 @@ void client_mark_disconnected(Server *server, int client_idx) {
     client->disconnect_time = time(NULL);
     
     // Close socket but keep client data
+    capture_record(CAPTURE_CLOSE, client->conn_id, NULL, 0);
     FD_CLR(client->socket_fd, &server->master_set);
     close(client->socket_fd);
     client->socket_fd = -1;
@@ -213,8 +377,8 @@ void client_mark_disconnected(Server *server, int client_idx) {
         snprintf(msg, sizeof(msg), "PLAYER_DISCONNECTED|%s\n", client->username);
         room_broadcast(server, client->room_id, msg, client_idx);
         
-        printf("Player %s in room %d marked as disconnected. Waiting for reconnect...\n",
-               client->username, client->room_id);
+        log_write(LOG_INFO, LOG_NET, "Player %s in room %d marked as disconnected. Waiting for reconnect...",
+                  client->username, client->room_id);
     }
 }
 
@@ -224,8 +388,8 @@ void client_disconnect(Server *server, int client_idx) {
     
     if (!client->active) return;
     
-    printf("Permanently disconnecting client: %s\n", 
-           client->username[0] ? client->username : "unknown");
+    log_write(LOG_INFO, LOG_NET, "Permanently disconnecting client: %s",
+              client->username[0] ? client->username : "unknown");
     
     // If in a room, handle room cleanup
     if (client->room_id >= 0) {
@@ -251,6 +415,17 @@ void client_disconnect(Server *server, int client_idx) {
         }
         room->player_count--;
         
+        // Hand the host role to the first remaining player, as LEAVE_ROOM does
+        if (room->player_count > 0 && room->host_index >= 0 && room->player_ids[room->host_index] < 0) {
+            for (int j = 0; j < PLAYERS_PER_ROOM; j++) {
+                if (room->player_ids[j] >= 0) {
+                    room->host_index = j;
+                    log_write(LOG_INFO, LOG_ROOM, "New host for room %d: slot %d", client->room_id, j);
+                    break;
+                }
+            }
+        }
+        
         // Clean up room if empty
         if (room->player_count == 0) {
             room_cleanup(server, client->room_id);
@@ -259,6 +434,7 @@ void client_disconnect(Server *server, int client_idx) {
     
     // Remove from fd_set if still open
     if (client->socket_fd >= 0) {
+        capture_record(CAPTURE_CLOSE, client->conn_id, NULL, 0);
         FD_CLR(client->socket_fd, &server->master_set);
         close(client->socket_fd);
     }
@@ -283,11 +459,12 @@ void client_process_data(Server *server, int client_idx) {
     }
     
     temp_buf[bytes_read] = '\0';
+    metrics_count(METRIC_BYTES_RECEIVED, bytes_read);
     
     // Append to client's buffer
     int space_left = BUFFER_SIZE - client->buffer_len - 1;
     if (bytes_read > space_left) {
-        printf("Buffer overflow for client %d, clearing buffer\n", client_idx);
+        log_write(LOG_WARN, LOG_NET, "Buffer overflow for client %d, clearing buffer", client_idx);
         client->buffer_len = 0;
     }
     
@@ -304,6 +481,7 @@ void client_process_data(Server *server, int client_idx) {
         
         // Process the message
         if (strlen(line_start) > 0) {
+            capture_record(CAPTURE_IN, client->conn_id, line_start, line_end - line_start);
             handle_message(server, client_idx, line_start);
         }
         
@@ -321,23 +499,30 @@ void client_process_data(Server *server, int client_idx) {
 
 // Send message to client
 void client_send(Client *client, const char *message) {
-    if (!client->active) return;
+    if (!client->active || client->socket_fd < 0) return;  // Inactive or waiting for reconnect
     
     int len = strlen(message);
     int sent = send(client->socket_fd, message, len, 0);
+    capture_record(CAPTURE_OUT, client->conn_id, message, len);
     
     if (sent < 0) {
         perror("send");
     }
+    if (sent > 0) {
+        metrics_count(METRIC_BYTES_SENT, sent);
+    }
+    if (sent < len) {
+        metrics_count(METRIC_SEND_FAILURES, 1);
+    }
 }
 
 // Handle incoming message
 void handle_message(Server *server, int client_idx, const char *message) {
     Client *client = &server->clients[client_idx];
     
-    printf("Received from %s: %s\n", 
-           client->username[0] ? client->username : "unknown", 
-           message);
+    log_write(LOG_TRACE, LOG_MSG, "Received from %s: %s",
+              client->username[0] ? client->username : "unknown", 
+              message);
     
     // Parse command
     char cmd[64] = {0};
@@ -345,6 +530,11 @@ void handle_message(Server *server, int client_idx, const char *message) {
     char arg2[256] = {0};
     
     sscanf(message, "%63[^|]|%255[^|]|%255s", cmd, arg1, arg2);
+    MetricCommand command = metrics_command(cmd);
+    metrics_count_command(command);
+    metrics_observe(METRIC_MESSAGE_BYTES, (long long)strlen(message));
+    long long start_ns = time_now_ns();
+    watchdog_command_begin(command, client_idx);
     
     if (strcmp(cmd, "REGISTER") == 0) {
         handle_register(server, client_idx, arg1, arg2);
@@ -352,6 +542,9 @@ void handle_message(Server *server, int client_idx, const char *message) {
     else if (strcmp(cmd, "LOGIN") == 0) {
         handle_login(server, client_idx, arg1, arg2);
     }
+    else if (strcmp(cmd, "CHECK_NAME") == 0) {
+        handle_check_name(server, client_idx, arg1);
+    }
     else if (strcmp(cmd, "CREATE_ROOM") == 0) {
         handle_create_room(server, client_idx, arg1);
     }
@@ -386,9 +579,18 @@ void handle_message(Server *server, int client_idx, const char *message) {
     else if (strcmp(cmd, "READY_NEXT_ROUND") == 0) {
         handle_ready_next_round(server, client_idx);
     }
+    else if (strcmp(cmd, "LEADERBOARD") == 0) {
+        // Format: LEADERBOARD|k (k optional)
+        handle_leaderboard(server, client_idx, atoi(arg1));
+    }
+    else if (strcmp(cmd, "DEBUG_ANSWER") == 0 && server->debug_hooks) {
+        handle_debug_answer(server, client_idx);
+    }
     else {
         client_send(client, "ERROR|Unknown command\n");
     }
+    
+    watchdog_command_end(metrics_latency_since((MetricLatency)command, start_ns) - start_ns);
 }
 
 // Check for disconnected clients that exceed reconnect timeout
@@ -402,7 +604,7 @@ void check_reconnect_timeouts(Server *server) {
             time_t elapsed = now - client->disconnect_time;
             
             if (elapsed >= RECONNECT_TIMEOUT) {
-                printf("Reconnect timeout for %s, permanently disconnecting...\n", client->username);
+                log_write(LOG_INFO, LOG_NET, "Reconnect timeout for %s, permanently disconnecting...", client->username);
                 
                 // Permanently disconnect
                 client_disconnect(server, i);
@@ -410,19 +612,3 @@ void check_reconnect_timeouts(Server *server) {
         }
     }
 }
-
-// Main function
-int main() {
-    srand(time(NULL));
-    
-    Server server;
-    server_init(&server);
-    
-    printf("Math Puzzle Game Server running...\n");
-    printf("Waiting for players...\n\n");
-    
-    server_run(&server);
-    
-    return 0;
-}
-
@@ -1,6 +1,11 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+// POSIX/BSD APIs (clock_gettime, sigaction, ...) when built with -std=c11
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +17,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <time.h>
+#include <stdint.h>
 
 #define PORT 8888
 #define MAX_CLIENTS 100
@@ -26,6 +32,37 @@
 #define PING_INTERVAL 10   // Send PING every 10 seconds
 #define PING_TIMEOUT 30    // Disconnect if no PONG after 30 seconds
 #define RECONNECT_TIMEOUT 60  // Allow reconnect within 60 seconds
+#define BLOOM_BITS (1 << 16)  // Username filter size (8 KB), ~1% false positives at 6800 names
+#define BLOOM_HASHES 7        // Probes per key
+#define ACCOUNT_QUEUE_SIZE 256  // Max account requests in flight
+#define ACCOUNT_BACKEND_DEFAULT "file"  // "file" (users.txt) or "kv" (accounts.db), override with ACCOUNT_BACKEND env
+#define STATS_FLUSH_INTERVAL 5  // Persist dirty player stats every 5 seconds
+#define GAME_WIN_BONUS 10       // Leaderboard points for winning all rounds (each round won scores its round number)
+#define LEADERBOARD_DEFAULT_K 10
+#define LEADERBOARD_MAX_K 50
+#define MATCHLOG_FILE "matches.dat"  // Binary match history, one record per finished round
+#define MATCHLOG_QUEUE_SIZE 1024     // Records buffered for the writer thread (dropped when full)
+#define PUZZLE_POOL_ROUNDS 5   // Rounds with a pre-generated puzzle queue (1..5)
+#define PUZZLE_POOL_DEPTH 8    // Ready puzzles kept per round (power of two)
+#define PUZZLE_TUPLES (1 << 16)  // (P1, P2, P3, P4) cell tuples, 16 cells per matrix
+#define PUZZLE_TUPLE_WORDS (PUZZLE_TUPLES / 64)  // uint64_t words in a solution set
+#define CALIBRATION_ATTEMPTS 32  // Candidates the pool tries per puzzle before keeping the closest
+#define PUZZLE_GENERATOR_VERSION 8  // Bumped whenever the same (round, seed) gives a different puzzle or verdict
+#define PUZZLE_BANK_FILE "puzzles.bank"  // Pre-generated puzzles (tools/puzzle_bank_gen), optional
+#define LOG_RING_SIZE 1024    // Records buffered per logging thread (power of two, dropped when full)
+#define LOG_MAX_THREADS 16    // Threads with their own log ring, others log synchronously
+#define LOG_RECORD_SIZE 256   // Bytes per log record (format pointer, arguments, strings)
+#define EXPR_MAX_OPERANDS 8  // Operands an equation may have, both sides together
+#define EXPR_VALUE_MIN (INT32_MIN + 2)  // Smallest valid operand or result (the solver reserves the two below)
+#define METRICS_PORT 9100       // Prometheus scrape endpoint on 127.0.0.1, override with METRICS_PORT env (0 = off)
+#define METRICS_MAX_THREADS 8   // Threads with their own metric slot, others share one
+#define METRIC_MAX_BUCKETS 10   // Finite buckets per histogram
+#define METRIC_LATENCY_BUCKETS 304  // Log-linear latency buckets, 1 ns up to ~18 minutes
+#define STALL_BUDGET_MS 100     // Event loop iteration budget before a stall report, override with STALL_BUDGET_MS env
+#define CAPTURE_BUFFER_SIZE (1 << 22)  // Bytes of traffic buffered for the capture writer (power of two, dropped when full)
+#define ADMIN_SOCKET "admin.sock"   // Unix-domain admin socket (mode 0600), override with ADMIN_SOCKET env (empty = off)
+#define ADMIN_OUTPUT_MAX (1 << 20)    // Unsent reply bytes per admin connection before it is dropped
+#define TRACE_BUFFER_EVENTS (1 << 16)  // Round lifecycle spans kept for TRACE_FILE export (power of two, oldest overwritten)
 
 // Client states
 typedef enum {
@@ -53,6 +90,141 @@ typedef enum {
     FORMAT_P1_P2_EQ_P3_P4    // P1 ± P2 = P3 ± P4
 } EquationFormat;
 
+// One side of an equation compiled to postfix: code >= 0 pushes that
+// operand, code < 0 pops two values and pushes them combined by operator
+// -(code + 1)
+typedef struct {
+    int8_t code[2 * EXPR_MAX_OPERANDS];
+    uint8_t length;
+} ExprProgram;
+
+// Compiled equation (see expr.c): operands [0, split) form the left side
+typedef struct {
+    uint8_t operand_count;
+    uint8_t split;
+    Operator ops[EXPR_MAX_OPERANDS - 1];  // ops[i] joins operand i and i + 1 (ops[split - 1] is the '=')
+    ExprProgram sides[2];
+} Equation;
+
+// Log levels, most severe first (a record passes if its level <= the current one)
+typedef enum {
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG,
+    LOG_TRACE
+} LogLevel;
+
+// Log categories (bit flags, filtered at runtime)
+typedef enum {
+    LOG_SERVER = 1 << 0,   // Startup, shutdown, configuration
+    LOG_NET = 1 << 1,      // Connections, disconnects, timeouts
+    LOG_MSG = 1 << 2,      // Every inbound protocol message (trace)
+    LOG_AUTH = 1 << 3,
+    LOG_ROOM = 1 << 4,
+    LOG_GAME = 1 << 5,
+    LOG_CHAT = 1 << 6,
+    LOG_PUZZLE = 1 << 7,   // Generator, pool, bank
+    LOG_STORAGE = 1 << 8   // Accounts, stats, key-value store, match log
+} LogCategory;
+
+#define LOG_ALL_CATEGORIES 0x1ff
+
+// Metric counters (names and help text in metrics.c)
+typedef enum {
+    METRIC_CONNECTIONS_ACCEPTED,
+    METRIC_CONNECTIONS_REJECTED,
+    METRIC_BYTES_RECEIVED,
+    METRIC_BYTES_SENT,
+    METRIC_SEND_FAILURES,
+    METRIC_ROUNDS_WON,
+    METRIC_ROUNDS_LOST,
+    METRIC_ROUNDS_TIMED_OUT,
+    METRIC_LOOP_STALLS,
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+// Metric gauges (sampled from the server state once a tick)
+typedef enum {
+    METRIC_CLIENTS_CONNECTED,
+    METRIC_CLIENTS_AUTHENTICATED,
+    METRIC_ROOMS_ACTIVE,
+    METRIC_GAMES_IN_PROGRESS,
+    METRIC_GAUGE_COUNT
+} MetricGauge;
+
+// Metric histograms (fixed buckets)
+typedef enum {
+    METRIC_MESSAGE_BYTES,
+    METRIC_ROUND_DURATION,  // Observed in milliseconds, exported in seconds
+    METRIC_HISTOGRAM_COUNT
+} MetricHistogram;
+
+// Protocol commands, counted per message
+typedef enum {
+    METRIC_COMMAND_REGISTER,
+    METRIC_COMMAND_LOGIN,
+    METRIC_COMMAND_CHECK_NAME,
+    METRIC_COMMAND_CREATE_ROOM,
+    METRIC_COMMAND_JOIN_ROOM,
+    METRIC_COMMAND_LEAVE_ROOM,
+    METRIC_COMMAND_LIST_ROOMS,
+    METRIC_COMMAND_READY,
+    METRIC_COMMAND_START_GAME,
+    METRIC_COMMAND_SUBMIT,
+    METRIC_COMMAND_PONG,
+    METRIC_COMMAND_CHAT,
+    METRIC_COMMAND_READY_NEXT_ROUND,
+    METRIC_COMMAND_LEADERBOARD,
+    METRIC_COMMAND_DEBUG_ANSWER,
+    METRIC_COMMAND_UNKNOWN,
+    METRIC_COMMAND_COUNT
+} MetricCommand;
+
+// Latency series: one per MetricCommand (same index), then periodic tasks
+// and hot functions
+typedef enum {
+    METRIC_LATENCY_GAME_TIMERS = METRIC_COMMAND_COUNT,
+    METRIC_LATENCY_ROOM_STATUS,
+    METRIC_LATENCY_PING_TIMEOUTS,
+    METRIC_LATENCY_RECONNECT_TIMEOUTS,
+    METRIC_LATENCY_PINGS,
+    METRIC_LATENCY_STATS_FLUSH,
+    METRIC_LATENCY_METRICS_SAMPLE,
+    METRIC_LATENCY_ROOM_START_GAME,
+    METRIC_LATENCY_SEND_ROOM_STATUS,
+    METRIC_LATENCY_LOOP_ITERATION,
+    METRIC_LATENCY_PHASE_IO,  // Per-iteration phase totals, in LoopPhase order
+    METRIC_LATENCY_PHASE_TIMERS,
+    METRIC_LATENCY_PHASE_BROADCASTS,
+    METRIC_LATENCY_PHASE_HOUSEKEEPING,
+    METRIC_LATENCY_COUNT
+} MetricLatency;
+
+// Event loop phases (see watchdog.c)
+typedef enum {
+    LOOP_PHASE_WAIT,          // Blocked in select()
+    LOOP_PHASE_IO,            // Accepts, account completions, client messages
+    LOOP_PHASE_TIMERS,        // Game timers, ping and reconnect timeouts
+    LOOP_PHASE_BROADCASTS,    // Room status and pings
+    LOOP_PHASE_HOUSEKEEPING,  // Stats flush, metric gauges
+    LOOP_PHASE_COUNT
+} LoopPhase;
+
+// Traffic capture record kinds
+typedef enum {
+    CAPTURE_OPEN,   // Connection accepted
+    CAPTURE_IN,     // One inbound protocol line (without '\n')
+    CAPTURE_OUT,    // One client_send() message
+    CAPTURE_CLOSE   // Socket closed (either side)
+} CaptureKind;
+
+// PCG32 random number generator (per-owner state, see rng.c)
+typedef struct {
+    uint64_t state;
+    uint64_t inc;  // Stream selector (always odd)
+} Rng;
+
 // Matrix structure
 typedef struct {
     int data[MATRIX_SIZE][MATRIX_SIZE];
@@ -64,14 +236,25 @@ typedef struct {
     Operator op2;  // Between P2/P3 and P3/P4 (depends on format)
     Operator op3;  // For 3-operator formats
     EquationFormat format;
+    Equation equation;  // format and operators compiled, what the solver and verifier run
     Matrix matrices[PLAYERS_PER_ROOM];
     int solution_row[PLAYERS_PER_ROOM];
     int solution_col[PLAYERS_PER_ROOM];
     int solution_values[PLAYERS_PER_ROOM];
     int result;
     int round;  // Current round (1-5)
+    unsigned int seed;  // Generator seed (same seed and round give the same puzzle)
+    int solution_count;  // Cell tuples satisfying the equation (1 = unambiguous)
+    int difficulty;      // Calibration score (0 = not calibrated)
 } Puzzle;
 
+// Per-room position in the puzzle bank: each room starts at its own random
+// record per round and walks forward, so it sees every bank puzzle at most once
+typedef struct {
+    uint32_t start[PUZZLE_POOL_ROUNDS];
+    uint32_t taken[PUZZLE_POOL_ROUNDS];
+} PuzzleBankCursor;
+
 // Room structure
 typedef struct {
     int id;
@@ -92,6 +275,17 @@ typedef struct {
     int total_rounds;   // Total rounds to win (default 5)
     int round_continue_ready[PLAYERS_PER_ROOM];  // Track who is ready for next round
     int waiting_for_continue;  // 1 if waiting for players to continue to next round
+    long long round_start_ms;  // Monotonic time the current round started
+    long long submit_ms[PLAYERS_PER_ROOM];  // Monotonic time of each player's submission
+    Rng rng;  // Puzzle seeds for this room
+    PuzzleBankCursor bank_cursor;
+    int next_round;             // Round the pool thread is building a puzzle for (0 = none)
+    unsigned int next_seed;     // Its seed, drawn from rng when requested
+    unsigned int next_ticket;   // puzzle_pool_request() ticket, 0 if the request wasn't queued
+    uint64_t trace_id;        // Shared by every round of the current game (0 = not traced)
+    long long trace_game_ns;  // Monotonic start of the game, round and continue wait
+    long long trace_round_ns;
+    long long trace_wait_ns;
 } Room;
 
 // Client structure
@@ -109,8 +303,127 @@ typedef struct {
     int ping_ms;  // Stored RTT in milliseconds
     time_t disconnect_time;  // Time when client disconnected
     ClientState saved_state;  // State before disconnect
+    int auth_pending;  // LOGIN/REGISTER waiting for account backend
+    uint32_t conn_id;  // Unique connection number (account completions, traffic captures)
 } Client;
 
+// Bloom filter over registered usernames
+typedef struct {
+    unsigned char bits[BLOOM_BITS / 8];
+    int count;  // Number of keys added
+} BloomFilter;
+
+// Persistent per-player statistics
+typedef struct {
+    char username[MAX_USERNAME];
+    int games_played;
+    int games_won;
+    int rounds_played;
+    int rounds_won;
+    long long total_solve_ms;  // Sum of submit times in won rounds
+    int score;                 // Leaderboard points
+} PlayerStats;
+
+// Account backend operations
+typedef enum {
+    ACCOUNT_OP_LOOKUP,        // Verify username/password
+    ACCOUNT_OP_CREATE,        // Register new account
+    ACCOUNT_OP_EXISTS,        // Check if username is registered
+    ACCOUNT_OP_UPDATE_STATS   // Persist a batch of PlayerStats
+} AccountOp;
+
+// Account backend result codes
+typedef enum {
+    ACCOUNT_OK,
+    ACCOUNT_NOT_FOUND,     // No such user, or wrong password
+    ACCOUNT_EXISTS,        // Username already registered
+    ACCOUNT_IO_ERROR
+} AccountStatus;
+
+// Account request (queued to the I/O thread, returned as completion)
+typedef struct {
+    AccountOp op;
+    int client_idx;
+    uint32_t conn_id;   // Client.conn_id, detects client slot reuse before completion is delivered
+    char username[MAX_USERNAME];
+    char password[MAX_PASSWORD];
+    int known_absent;   // CREATE: filter says name is free, skip existence check
+    PlayerStats *stats; // UPDATE_STATS: heap batch, freed on completion
+    int stats_count;
+    AccountStatus status;  // Filled in by backend
+} AccountRequest;
+
+// Account storage backend (all calls run on the account I/O thread,
+// except open/for_each_* which run once at startup)
+typedef struct {
+    const char *name;
+    int (*open)(void);
+    void (*close)(void);
+    void (*for_each_user)(void (*fn)(const char *username, void *ctx), void *ctx);
+    void (*for_each_stats)(void (*fn)(const PlayerStats *stats, void *ctx), void *ctx);
+    AccountStatus (*lookup)(const char *username, const char *password);
+    AccountStatus (*exists)(const char *username);
+    AccountStatus (*create)(const char *username, const char *password, int known_absent);
+    AccountStatus (*update_stats)(const PlayerStats *stats, int count);
+} AccountBackend;
+
+// Embedded key-value store (append-only log + in-memory hash index)
+typedef struct KVStore KVStore;
+
+// Match log record: one finished round (fixed size, host byte order)
+typedef struct {
+    int64_t start_time;                      // Wall clock (unix seconds) the round started
+    uint32_t seed;                           // Puzzle seed
+    int32_t room_id;
+    int32_t round;
+    int32_t format;                          // EquationFormat
+    int32_t ops[3];                          // op1, op2, op3
+    int32_t result;
+    int32_t solution[PLAYERS_PER_ROOM][2];   // [row, col]
+    int32_t submitted[PLAYERS_PER_ROOM][2];  // [row, col] as verified
+    int32_t solve_ms[PLAYERS_PER_ROOM];      // Submit time since round start, -1 if no submission
+    int32_t won;
+    int32_t timeout;
+    char players[PLAYERS_PER_ROOM][MAX_USERNAME];  // "" for empty seats
+} MatchRecord;
+
+// Read-only memory-mapped view of a match log
+typedef struct {
+    void *base;
+    size_t size;
+    const MatchRecord *records;
+    int count;
+} MatchLogView;
+
+// Puzzle bank record: one pre-generated, validated puzzle (fixed size, host byte order)
+typedef struct {
+    uint32_t seed;                                        // Regenerates the puzzle (match log replay)
+    int32_t solution_count;
+    int32_t difficulty;
+    uint8_t format;                                       // EquationFormat
+    uint8_t ops[3];                                       // op1, op2, op3
+    uint8_t solution_cells[PLAYERS_PER_ROOM];             // row * MATRIX_SIZE + col
+    int16_t cells[PLAYERS_PER_ROOM][MATRIX_SIZE * MATRIX_SIZE];
+} PuzzleBankRecord;
+
+// Traffic capture record header, followed by length payload bytes padded to 8 (host byte order)
+typedef struct {
+    int64_t time_ns;  // Monotonic time since capture start
+    uint32_t conn;    // Client.conn_id
+    uint16_t length;
+    uint8_t kind;     // CaptureKind
+    uint8_t reserved;
+} CaptureRecord;
+
+// Read-only memory-mapped view of a traffic capture
+typedef struct {
+    void *base;
+    size_t size;
+    uint64_t puzzle_seed;
+    int fixed_seed;  // Captured with PUZZLE_SEED
+    uint32_t generator_version;
+} CaptureView;
+
 // Server state
 typedef struct {
     int listen_fd;
@@ -119,6 +432,9 @@ typedef struct {
     fd_set master_set;
     int max_fd;
     time_t last_tick_time;
+    Rng rng;  // Seeds per-room and worker generators
+    int debug_hooks;  // DEBUG_HOOKS=1 env: accept DEBUG_ANSWER (load testing only, reveals answers)
+    int draining;     // Admin drain: no new connections or games, stop when games end
 } Server;
 
 // Function declarations
@@ -127,6 +443,9 @@ typedef struct {
 void server_init(Server *server);
 void server_run(Server *server);
 void server_shutdown(Server *server);
+void server_request_stop(void);
+void server_request_latency_dump(void);
+void server_drain(Server *server);
 
 // Client management
 int client_accept(Server *server);
@@ -140,6 +459,8 @@ void client_send(Client *client, const char *message);
 void handle_message(Server *server, int client_idx, const char *message);
 void handle_register(Server *server, int client_idx, const char *username, const char *password);
 void handle_login(Server *server, int client_idx, const char *username, const char *password);
+void handle_check_name(Server *server, int client_idx, const char *username);
+void auth_complete(Server *server, const AccountRequest *req);
 void handle_create_room(Server *server, int client_idx, const char *room_name);
 void handle_join_room(Server *server, int client_idx, int room_id);
 void handle_leave_room(Server *server, int client_idx);
@@ -149,19 +470,24 @@ void handle_submit(Server *server, int client_idx, int row, int col);
 void handle_pong(Server *server, int client_idx);
 void handle_chat(Server *server, int client_idx, const char *message);
 void handle_ready_next_round(Server *server, int client_idx);
+void handle_debug_answer(Server *server, int client_idx);
 
 // Room management
 int room_create(Server *server, const char *name);
 int room_join(Server *server, int room_id, int client_idx);
 void room_start_game(Server *server, int room_id);
+void room_request_puzzle(Room *room, int round);
 void room_end_game(Server *server, int room_id, int won, int timeout);
 void room_broadcast(Server *server, int room_id, const char *message, int exclude_client_idx);
 void room_cleanup(Server *server, int room_id);
 
 // Game logic
-void puzzle_generate(Puzzle *puzzle, int round);
+void puzzle_generate(Puzzle *puzzle, int round, unsigned int seed);
+int puzzle_solution_bound(int round);
+void puzzle_fill_matrices(Puzzle *puzzle, Rng *rng, int low, int high);
+void puzzle_print(const Puzzle *puzzle);
 void puzzle_send_to_clients(Server *server, int room_id);
-int puzzle_verify_solution(Puzzle *puzzle, int submitted[PLAYERS_PER_ROOM][2]);
+int puzzle_verify_solution(const Puzzle *puzzle, int submitted[PLAYERS_PER_ROOM][2]);
 
 // Utility functions
 void send_room_list(Server *server, int client_idx);
@@ -169,10 +495,165 @@ void send_room_status(Server *server, int room_id);
 void broadcast_timer_update(Server *server, int room_id);
 void check_ping_timeouts(Server *server);
 void send_ping_to_all(Server *server);
-int authenticate_user(const char *username, const char *password);
-int register_user(const char *username, const char *password);
+long long time_now_ms(void);
+long long time_now_ns(void);
+void auth_init(void);
 char* get_operator_string(Operator op);
-int calculate_result(int p1, Operator op1, int p2, Operator op2, int p3);
+
+// Player statistics
+void stats_init(void);
+const PlayerStats *stats_get(const char *username);
+void stats_record_round(const char *username, int round, int won, long long solve_ms);
+void stats_record_game(const char *username, int won);
+void stats_flush(int force);
+void stats_write_failed(const PlayerStats *batch, int count);
+void stats_save(void);
+
+// Leaderboard (indexable skip list ordered by score)
+void leaderboard_update(const char *username, int old_score, int new_score);
+int leaderboard_rank(const char *username, int score);
+int leaderboard_size(void);
+int leaderboard_top(int k, const char *usernames[], int scores[]);
+void handle_leaderboard(Server *server, int client_idx, int k);
+
+// Logger (per-thread binary rings, background writer)
+int log_init(void);
+void log_shutdown(void);
+void log_write(LogLevel level, LogCategory category, const char *format, ...) __attribute__((format(printf, 3, 4)));
+int log_enabled(LogLevel level, LogCategory category);
+void log_set_level(LogLevel level);
+int log_parse_level(const char *name);
+const char *log_level_name(LogLevel level);
+void log_set_categories(unsigned int mask);
+LogLevel log_get_level(void);
+unsigned int log_get_categories(void);
+long log_dropped(void);
+
+// Metrics (per-thread slots, Prometheus scrape thread)
+int metrics_init(void);
+void metrics_shutdown(void);
+void metrics_count(MetricCounter counter, unsigned long long delta);
+void metrics_count_command(MetricCommand command);
+void metrics_observe(MetricHistogram histogram, long long value);
+void metrics_set_gauge(MetricGauge gauge, long long value);
+void metrics_record_latency(MetricLatency series, long long ns);
+long long metrics_latency_since(MetricLatency series, long long start_ns);
+void metrics_log_latency(void);
+int metrics_latency_bucket(unsigned long long ns);
+unsigned long long metrics_latency_bound(int bucket);
+MetricCommand metrics_command(const char *name);
+const char *metrics_command_name(MetricCommand command);
+void metrics_sample(const Server *server);
+size_t metrics_render(char *out, size_t size);
+
+// Event loop watchdog (iteration timing on the loop, stall reports from a thread)
+int watchdog_init(void);
+void watchdog_shutdown(void);
+void watchdog_begin_iteration(void);
+void watchdog_enter_phase(LoopPhase phase);
+void watchdog_end_iteration(void);
+void watchdog_command_begin(MetricCommand command, int client_idx);
+void watchdog_command_end(long long elapsed_ns);
+
+// Equation engine
+int expr_compile(Equation *equation, int count, int split, const Operator *ops);
+int expr_compile_format(Equation *equation, EquationFormat format, Operator op1, Operator op2);
+int expr_apply(long long a, Operator op, long long b, long long *out);
+int expr_eval(const ExprProgram *program, const int *values, long long *out, long long *largest);
+int expr_check(const Equation *equation, const int *values);
+void expr_format(const Equation *equation, const int *values, const int *rows, const int *cols,
+                 char *buffer, size_t size);
+
+// Puzzle solver
+int puzzle_solve(const Puzzle *puzzle, uint64_t tuples[PUZZLE_TUPLE_WORDS]);
+int puzzle_check_values(const Puzzle *puzzle, const int values[PLAYERS_PER_ROOM]);
+int puzzle_tuple_index(int cells[PLAYERS_PER_ROOM][2]);
+int puzzle_near_misses(const Puzzle *puzzle, int max_delta);
+int puzzle_solver_simd(void);
+void puzzle_solver_use_simd(int enable);
+
+// Difficulty calibration
+int puzzle_difficulty(const Puzzle *puzzle);
+int puzzle_generate_calibrated(Puzzle *puzzle, int round, Rng *seed_rng);
+
+// Random number generator
+void rng_seed(Rng *rng, uint64_t seed, uint64_t stream);
+uint32_t rng_next(Rng *rng);
+uint32_t rng_below(Rng *rng, uint32_t bound);
+int rng_range(Rng *rng, int min_val, int max_val);
+
+// Puzzle pool (background pre-generation, one SPSC queue per round)
+int puzzle_pool_init(unsigned int seed, int fixed_seed);
+void puzzle_pool_shutdown(void);
+int puzzle_pool_take(int round, Puzzle *puzzle);
+unsigned int puzzle_pool_request(int room_id, int round, unsigned int seed);
+int puzzle_pool_collect(int room_id, unsigned int ticket, Puzzle *puzzle);
+
+// Puzzle bank (memory-mapped, read by the event loop)
+int puzzle_bank_open(const char *path);
+void puzzle_bank_close(void);
+void puzzle_bank_cursor_init(PuzzleBankCursor *cursor, Rng *rng);
+int puzzle_bank_take(int round, PuzzleBankCursor *cursor, Puzzle *puzzle);
+int puzzle_bank_available(int round, const PuzzleBankCursor *cursor);
+int puzzle_bank_pack(const Puzzle *puzzle, PuzzleBankRecord *record);
+int puzzle_bank_write(const char *path, PuzzleBankRecord *const records[PUZZLE_POOL_ROUNDS],
+                      const uint32_t counts[PUZZLE_POOL_ROUNDS], const uint32_t bounds[PUZZLE_POOL_ROUNDS]);
+
+// Match log (buffered background writer, mmap reader)
+int matchlog_init(const char *path);
+void matchlog_shutdown(void);
+void matchlog_record_round(Server *server, int room_id, int won, int timeout);
+int matchlog_map(const char *path, MatchLogView *view);
+void matchlog_unmap(MatchLogView *view);
+int matchlog_replay(const MatchRecord *record, Puzzle *puzzle);
+
+// Traffic capture (buffered background writer, mmap reader for tools/replay)
+int capture_init(const char *path, uint64_t puzzle_seed, int fixed_seed);
+void capture_shutdown(void);
+void capture_record(CaptureKind kind, uint32_t conn, const char *data, size_t length);
+size_t capture_credential_prefix(const char *line, size_t length);
+int capture_map(const char *path, CaptureView *view);
+void capture_unmap(CaptureView *view);
+const CaptureRecord *capture_next(const CaptureView *view, size_t *offset);
+
+// Round lifecycle tracing (in-memory spans, Chrome trace JSON export)
+int trace_init(const char *path);
+void trace_shutdown(void);
+void trace_snapshot(void);
+void trace_begin_game(Room *room, long long start);
+void trace_span(const Room *room, const char *name, long long start, const char *arg_name, int arg);
+void trace_async(const Room *room, const char *name, long long start);
+
+// Admin control socket (served by the event loop, non-blocking)
+int admin_init(void);
+void admin_shutdown(void);
+int admin_fill_fds(fd_set *read_fds, fd_set *write_fds, int max_fd);
+void admin_process(Server *server, const fd_set *read_fds, const fd_set *write_fds);
+
+// Bloom filter
+void bloom_init(BloomFilter *filter);
+void bloom_add(BloomFilter *filter, const char *key);
+int bloom_maybe_contains(const BloomFilter *filter, const char *key);
+
+// Account backend (async, completions delivered to event loop)
+extern const AccountBackend account_file_backend;
+extern const AccountBackend account_kv_backend;
+int account_init(void);
+void account_shutdown(Server *server);
+const AccountBackend *account_backend(void);
+int account_completion_fd(void);
+int account_submit(const AccountRequest *req);
+void account_dispatch_completions(Server *server);
+int account_format_stats(const PlayerStats *stats, char *buffer, int size);
+int account_parse_stats(const char *text, PlayerStats *stats);
+
+// Key-value store
+KVStore *kv_open(const char *path);
+void kv_close(KVStore *store);
+const char *kv_get(KVStore *store, const char *key);
+int kv_put(KVStore *store, const char *key, const char *value);
+void kv_for_each(KVStore *store, const char *prefix,
+                 void (*fn)(const char *key, const char *value, void *ctx), void *ctx);
 
 #endif // SERVER_H
 
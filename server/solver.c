@@ -0,0 +1,266 @@
+#include "server.h"
+#include <pthread.h>
+#include <immintrin.h>
+
+// Puzzle solver
+//
+// Finds every (P1, P2, P3, P4) cell tuple that satisfies the puzzle equation,
+// as a 65536-bit set indexed by puzzle_tuple_index(). Each side of the
+// compiled equation (expr.c) is run over every cell combination of its
+// operands into a table, and a single kernel compares every entry of the
+// first against the whole second table, writing the matches into the set
+// (entry s of the first table owns bits s * count .. s * count + count - 1):
+//   P1 op P2 op P3 = P4   4096 left sides  x 16 P4 values
+//   P1 = P2 op P3 op P4   16 P1 values     x 4096 right sides
+//   P1 op P2 = P3 op P4   256 left sides   x 256 right sides
+// The kernel uses AVX2 (8 compares per instruction) when the CPU has it.
+//
+// Tables follow expr_apply(): a division only counts if it is exact (7 / 2
+// is not 3 to a player), so solver and verifier always agree.
+
+#define CELLS (MATRIX_SIZE * MATRIX_SIZE)
+#define NO_VALUE INT32_MIN        // Missing entry (inexact or overflow) in the first table
+#define NO_MATCH (INT32_MIN + 1)  // Missing entry in the second table, never equal to NO_VALUE
+#define VALUE_MIN EXPR_VALUE_MIN   // Smallest real entry
+
+typedef void (*MatchKernel)(uint64_t *tuples, const int32_t *values, int value_count,
+                            const int32_t *table, int count);
+
+static MatchKernel match_kernel = NULL;
+static int simd_enabled = 0;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+// Bit s * count + i of tuples = (values[s] == table[i]), count a power of two >= 8.
+// Writes every word of the value_count * count bits (a multiple of 64).
+static void match_scalar(uint64_t *tuples, const int32_t *values, int value_count,
+                         const int32_t *table, int count) {
+    int shift = __builtin_ctz(count);
+    int words = (value_count << shift) >> 6;
+    
+    for (int w = 0; w < words; w++) {
+        uint64_t word = 0;
+        for (int bit = 0; bit < 64; bit++) {
+            int pos = (w << 6) + bit;
+            word |= (uint64_t)(values[pos >> shift] == table[pos & (count - 1)]) << bit;
+        }
+        tuples[w] = word;
+    }
+}
+
+// Eight compares of 8 lanes are narrowed 32 -> 16 -> 8 bits with saturating
+// packs (which interleave the two 128-bit halves, undone by one permute) so
+// two byte movemasks yield the whole 64-bit word.
+__attribute__((target("avx2")))
+static void match_avx2(uint64_t *tuples, const int32_t *values, int value_count,
+                       const int32_t *table, int count) {
+    int words = value_count * count / 64;
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int s = 0, i = 0;
+    
+    for (int w = 0; w < words; w++) {
+        __m256i equal[8];
+        for (int block = 0; block < 8; block++) {
+            __m256i needle = _mm256_set1_epi32(values[s]);
+            __m256i lanes = _mm256_loadu_si256((const __m256i *)(table + i));
+            equal[block] = _mm256_cmpeq_epi32(needle, lanes);
+            i += 8;
+            if (i == count) {
+                i = 0;
+                s++;
+            }
+        }
+        
+        __m256i low = _mm256_packs_epi16(_mm256_packs_epi32(equal[0], equal[1]),
+                                         _mm256_packs_epi32(equal[2], equal[3]));
+        __m256i high = _mm256_packs_epi16(_mm256_packs_epi32(equal[4], equal[5]),
+                                          _mm256_packs_epi32(equal[6], equal[7]));
+        uint32_t low_bits = (uint32_t)_mm256_movemask_epi8(_mm256_permutevar8x32_epi32(low, order));
+        uint32_t high_bits = (uint32_t)_mm256_movemask_epi8(_mm256_permutevar8x32_epi32(high, order));
+        tuples[w] = (uint64_t)high_bits << 32 | low_bits;
+    }
+}
+
+static void solver_set_kernel(int simd) {
+    simd_enabled = simd && __builtin_cpu_supports("avx2") != 0;
+    match_kernel = simd_enabled ? match_avx2 : match_scalar;
+}
+
+static void solver_select_kernel(void) {
+    __builtin_cpu_init();
+    solver_set_kernel(1);
+}
+
+// Force the scalar kernel (enable = 0) or back to the best available (benchmarks)
+void puzzle_solver_use_simd(int enable) {
+    pthread_once(&kernel_once, solver_select_kernel);
+    solver_set_kernel(enable);
+}
+
+// 1 if the AVX2 kernel is in use
+int puzzle_solver_simd(void) {
+    pthread_once(&kernel_once, solver_select_kernel);
+    return simd_enabled;
+}
+
+// 1 if values (P1..P4) satisfy the puzzle equation
+int puzzle_check_values(const Puzzle *puzzle, const int values[PLAYERS_PER_ROOM]) {
+    return expr_check(&puzzle->equation, values);
+}
+
+// Keep v if it is a real entry, else missing
+static inline int32_t solver_fit(long long v, int32_t missing) {
+    return v >= VALUE_MIN && v <= INT32_MAX ? (int32_t)v : missing;
+}
+
+// out[i * b_count + j] = a[i] op b[j], missing where either side is missing or the result doesn't count
+static void solver_table(const int32_t *a, int a_count, Operator op, const int32_t *b, int b_count,
+                         int32_t *out, int32_t missing) {
+    for (int i = 0; i < a_count; i++) {
+        int32_t *row = out + i * b_count;
+        long long x = a[i];
+        
+        if (x < VALUE_MIN) {
+            for (int j = 0; j < b_count; j++) row[j] = missing;
+            continue;
+        }
+        
+        switch (op) {
+            case OP_ADD:
+                for (int j = 0; j < b_count; j++) row[j] = b[j] < VALUE_MIN ? missing : solver_fit(x + b[j], missing);
+                break;
+            case OP_SUB:
+                for (int j = 0; j < b_count; j++) row[j] = b[j] < VALUE_MIN ? missing : solver_fit(x - b[j], missing);
+                break;
+            case OP_MUL:
+                for (int j = 0; j < b_count; j++) row[j] = b[j] < VALUE_MIN ? missing : solver_fit(x * b[j], missing);
+                break;
+            case OP_DIV:
+                for (int j = 0; j < b_count; j++) {
+                    row[j] = b[j] < VALUE_MIN || b[j] == 0 || x % b[j] != 0 ? missing : solver_fit(x / b[j], missing);
+                }
+                break;
+            default:
+                for (int j = 0; j < b_count; j++) row[j] = missing;
+        }
+    }
+}
+
+// Run one side's program over every cell combination of its operands (first
+// operand major) into out, missing where the side has no valid value.
+// Intermediate tables go to scratch. Returns the number of entries.
+static int solver_side(const ExprProgram *program, int32_t values[][CELLS], int32_t *out, int32_t missing,
+                       int32_t *scratch) {
+    const int32_t *stack[EXPR_MAX_OPERANDS];
+    int counts[EXPR_MAX_OPERANDS];
+    int depth = 0;
+    
+    if (program->length == 1) {
+        memcpy(out, values[program->code[0]], CELLS * sizeof(int32_t));
+        return CELLS;
+    }
+    
+    for (int k = 0; k < program->length; k++) {
+        int code = program->code[k];
+        if (code >= 0) {
+            stack[depth] = values[code];
+            counts[depth++] = CELLS;
+            continue;
+        }
+        
+        // Operands stay in order in postfix, so the left table always covers
+        // the earlier operands and the outer product keeps the first one major
+        depth -= 2;
+        int last = k == program->length - 1;
+        int32_t *table = last ? out : scratch;
+        solver_table(stack[depth], counts[depth], (Operator)(-code - 1), stack[depth + 1], counts[depth + 1],
+                     table, last ? missing : NO_VALUE);
+        counts[depth] = counts[depth] * counts[depth + 1];
+        stack[depth] = table;
+        if (!last) scratch += counts[depth];
+        depth++;
+    }
+    return counts[0];
+}
+
+// Tuple index of one cell per matrix: P1 cell in bits 12-15 ... P4 cell in bits 0-3
+int puzzle_tuple_index(int cells[PLAYERS_PER_ROOM][2]) {
+    int index = 0;
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        index = (index << 4) | (cells[m][0] * MATRIX_SIZE + cells[m][1]);
+    }
+    return index;
+}
+
+// Both sides of the equation as match kernel tables
+typedef struct {
+    int32_t first[CELLS * CELLS * CELLS];
+    int32_t second[CELLS * CELLS * CELLS];
+    int first_count;
+    int second_count;
+} SolverTables;
+
+// 32 KB of tables and the near-miss buffers are too big for the stack of the
+// event loop, which solves when it generates inline; every solving thread
+// (event loop, pool producer, bank generator workers) gets its own
+static _Thread_local SolverTables solver_tables;
+static _Thread_local int32_t shifted[CELLS * CELLS * CELLS];
+static _Thread_local uint64_t near_tuples[PUZZLE_TUPLE_WORDS];
+
+// Build both sides' tables from the compiled equation, returns 0 unless it
+// has one operand per matrix
+static int solver_build(const Puzzle *puzzle, SolverTables *tables) {
+    const Equation *equation = &puzzle->equation;
+    int32_t values[PLAYERS_PER_ROOM][CELLS];
+    int32_t scratch[CELLS * CELLS];  // A side has at most PLAYERS_PER_ROOM - 1 operands
+    
+    if (equation->operand_count != PLAYERS_PER_ROOM) return 0;
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        memcpy(values[m], puzzle->matrices[m].data, sizeof(values[m]));
+    }
+    
+    tables->first_count = solver_side(&equation->sides[0], values, tables->first, NO_VALUE, scratch);
+    tables->second_count = solver_side(&equation->sides[1], values, tables->second, NO_MATCH, scratch);
+    return 1;
+}
+
+static int solver_count(const uint64_t tuples[PUZZLE_TUPLE_WORDS]) {
+    int count = 0;
+    for (int w = 0; w < PUZZLE_TUPLE_WORDS; w++) {
+        count += __builtin_popcountll(tuples[w]);
+    }
+    return count;
+}
+
+// Fill tuples with every valid cell tuple, returns how many there are
+int puzzle_solve(const Puzzle *puzzle, uint64_t tuples[PUZZLE_TUPLE_WORDS]) {
+    pthread_once(&kernel_once, solver_select_kernel);
+    
+    SolverTables *tables = &solver_tables;
+    if (!solver_build(puzzle, tables)) {
+        memset(tuples, 0, PUZZLE_TUPLE_WORDS * sizeof(uint64_t));
+        return 0;
+    }
+    
+    match_kernel(tuples, tables->first, tables->first_count, tables->second, tables->second_count);
+    return solver_count(tuples);
+}
+
+// Count cell tuples whose two sides differ by 1..max_delta (answers that are
+// almost right), by shifting the first table and re-running the kernel
+int puzzle_near_misses(const Puzzle *puzzle, int max_delta) {
+    pthread_once(&kernel_once, solver_select_kernel);
+    
+    SolverTables *tables = &solver_tables;
+    if (!solver_build(puzzle, tables)) return 0;
+    
+    int count = 0;
+    for (int delta = -max_delta; delta <= max_delta; delta++) {
+        if (delta == 0) continue;
+        for (int i = 0; i < tables->first_count; i++) {
+            shifted[i] = tables->first[i] < VALUE_MIN ? NO_VALUE : solver_fit((long long)tables->first[i] + delta, NO_VALUE);
+        }
+        match_kernel(near_tuples, shifted, tables->first_count, tables->second, tables->second_count);
+        count += solver_count(near_tuples);
+    }
+    return count;
+}
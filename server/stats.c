@@ -0,0 +1,236 @@
+#include "server.h"
+
+// Player statistics store
+//
+// All stats live in memory (loaded from the account backend at startup) and
+// are only touched by the event loop. Updates mark the entry dirty; every
+// STATS_FLUSH_INTERVAL seconds the dirty set is copied into one batch and
+// handed to the account I/O thread, so game code never waits on disk. A
+// batch the backend fails to write marks its players dirty again, so the
+// next flush retries them with their current stats. At shutdown, after the
+// I/O thread has stopped, the last dirty set is written directly.
+
+typedef struct {
+    PlayerStats stats;
+    int dirty;
+} StatsEntry;
+
+static StatsEntry *entries = NULL;  // Growable array
+static int entry_count = 0;
+static int entry_capacity = 0;
+static int *index_table = NULL;     // Open addressing hash -> entry index, -1 if empty
+static int index_capacity = 0;      // Power of two
+static int *dirty_list = NULL;      // Indices of dirty entries
+static int dirty_count = 0;
+static time_t last_flush_time = 0;
+
+// FNV-1a 32-bit hash
+static unsigned int stats_hash(const char *username) {
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)username; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Find index slot for username
+static int *stats_find_slot(const char *username) {
+    unsigned int mask = index_capacity - 1;
+    unsigned int idx = stats_hash(username) & mask;
+    
+    while (index_table[idx] >= 0 &&
+           strcmp(entries[index_table[idx]].stats.username, username) != 0) {
+        idx = (idx + 1) & mask;
+    }
+    return &index_table[idx];
+}
+
+// Double hash index and rehash all entries
+static int stats_grow_index(void) {
+    int new_capacity = index_capacity ? index_capacity * 2 : 256;
+    int *table = malloc(new_capacity * sizeof(int));
+    if (!table) return 0;
+    
+    for (int i = 0; i < new_capacity; i++) {
+        table[i] = -1;
+    }
+    free(index_table);
+    index_table = table;
+    index_capacity = new_capacity;
+    
+    for (int i = 0; i < entry_count; i++) {
+        *stats_find_slot(entries[i].stats.username) = i;
+    }
+    return 1;
+}
+
+// Find or create stats entry for username (new players join the leaderboard at 0)
+static StatsEntry *stats_entry(const char *username) {
+    if ((entry_count + 1) * 2 > index_capacity && !stats_grow_index()) {
+        return NULL;
+    }
+    
+    int *slot = stats_find_slot(username);
+    if (*slot >= 0) {
+        return &entries[*slot];
+    }
+    
+    if (entry_count == entry_capacity) {
+        int new_capacity = entry_capacity ? entry_capacity * 2 : 128;
+        StatsEntry *new_entries = realloc(entries, new_capacity * sizeof(StatsEntry));
+        int *new_dirty = realloc(dirty_list, new_capacity * sizeof(int));
+        if (new_entries) entries = new_entries;
+        if (new_dirty) dirty_list = new_dirty;
+        if (!new_entries || !new_dirty) return NULL;
+        entry_capacity = new_capacity;
+    }
+    
+    StatsEntry *entry = &entries[entry_count];
+    memset(entry, 0, sizeof(StatsEntry));
+    strncpy(entry->stats.username, username, MAX_USERNAME - 1);
+    *slot = entry_count++;
+    leaderboard_update(entry->stats.username, -1, 0);
+    return entry;
+}
+
+static void stats_mark_dirty(StatsEntry *entry) {
+    if (!entry->dirty) {
+        entry->dirty = 1;
+        dirty_list[dirty_count++] = (int)(entry - entries);
+    }
+}
+
+static void stats_load_entry(const PlayerStats *stats, void *ctx) {
+    (void)ctx;
+    StatsEntry *entry = stats_entry(stats->username);
+    if (entry) {
+        int old_score = entry->stats.score;
+        entry->stats = *stats;
+        leaderboard_update(stats->username, old_score, stats->score);
+    }
+}
+
+// Load stored stats from account backend (startup, before the I/O thread is used)
+void stats_init(void) {
+    account_backend()->for_each_stats(stats_load_entry, NULL);
+    last_flush_time = time(NULL);
+    
+    log_write(LOG_INFO, LOG_STORAGE, "Loaded stats for %d players", entry_count);
+}
+
+// Get stats for username (NULL if player has none yet)
+const PlayerStats *stats_get(const char *username) {
+    if (index_capacity == 0) return NULL;
+    
+    int idx = *stats_find_slot(username);
+    return idx >= 0 ? &entries[idx].stats : NULL;
+}
+
+// Change score and reposition player on the leaderboard
+static void stats_add_score(StatsEntry *entry, int points) {
+    int old_score = entry->stats.score;
+    entry->stats.score += points;
+    leaderboard_update(entry->stats.username, old_score, entry->stats.score);
+}
+
+// Record a finished round for a player (a won round scores its round number)
+void stats_record_round(const char *username, int round, int won, long long solve_ms) {
+    StatsEntry *entry = stats_entry(username);
+    if (!entry) return;
+    
+    entry->stats.rounds_played++;
+    if (won) {
+        entry->stats.rounds_won++;
+        entry->stats.total_solve_ms += solve_ms;
+        stats_add_score(entry, round);
+    }
+    stats_mark_dirty(entry);
+}
+
+// Record a finished game (all rounds won, or lost on some round)
+void stats_record_game(const char *username, int won) {
+    StatsEntry *entry = stats_entry(username);
+    if (!entry) return;
+    
+    entry->stats.games_played++;
+    if (won) {
+        entry->stats.games_won++;
+        stats_add_score(entry, GAME_WIN_BONUS);
+    }
+    stats_mark_dirty(entry);
+}
+
+// Copy the dirty entries into a new batch (NULL if none or out of memory)
+static PlayerStats *stats_dirty_batch(void) {
+    if (dirty_count == 0) return NULL;
+    
+    PlayerStats *batch = malloc(dirty_count * sizeof(PlayerStats));
+    if (!batch) return NULL;
+    
+    for (int i = 0; i < dirty_count; i++) {
+        batch[i] = entries[dirty_list[i]].stats;
+    }
+    return batch;
+}
+
+static void stats_clear_dirty(void) {
+    for (int i = 0; i < dirty_count; i++) {
+        entries[dirty_list[i]].dirty = 0;
+    }
+    dirty_count = 0;
+}
+
+// Hand dirty entries to the account I/O thread as one batch
+// Without force, only runs once every STATS_FLUSH_INTERVAL seconds
+void stats_flush(int force) {
+    time_t now = time(NULL);
+    if (!force && now - last_flush_time < STATS_FLUSH_INTERVAL) return;
+    last_flush_time = now;
+    
+    PlayerStats *batch = stats_dirty_batch();
+    if (!batch) return;
+    
+    AccountRequest req;
+    memset(&req, 0, sizeof(req));
+    req.op = ACCOUNT_OP_UPDATE_STATS;
+    req.client_idx = -1;
+    req.conn_id = 0;
+    req.stats = batch;
+    req.stats_count = dirty_count;
+    
+    if (!account_submit(&req)) {
+        // Queue full: keep entries dirty and retry next interval
+        free(batch);
+        return;
+    }
+    
+    // Changes from here on go in the next batch; a failed write re-marks these
+    stats_clear_dirty();
+}
+
+// A submitted batch was not written: mark its players dirty again (event loop)
+void stats_write_failed(const PlayerStats *batch, int count) {
+    for (int i = 0; i < count; i++) {
+        StatsEntry *entry = stats_entry(batch[i].username);
+        if (entry) stats_mark_dirty(entry);
+    }
+}
+
+// Write the dirty entries directly through the backend
+// (shutdown, after the I/O thread has stopped and its completions were dispatched)
+void stats_save(void) {
+    int count = dirty_count;
+    PlayerStats *batch = stats_dirty_batch();
+    if (!batch) {
+        if (count > 0) log_write(LOG_ERROR, LOG_STORAGE, "Failed to persist %d player stats records", count);
+        return;
+    }
+    
+    if (account_backend()->update_stats(batch, count) != ACCOUNT_OK) {
+        log_write(LOG_ERROR, LOG_STORAGE, "Failed to persist %d player stats records", count);
+    } else {
+        stats_clear_dirty();
+    }
+    free(batch);
+}
@@ -0,0 +1,857 @@
+// Load generator: a fleet of headless bots speaking the text protocol
+//
+// Each worker thread drives its share of the bots with one poll() loop;
+// every socket is non-blocking, connect() included, so no bot stalls it.
+// A bot registers (or logs in when the name already exists), lists rooms
+// and joins the fullest loadgen room with a free seat, creating one when
+// there is none, readies up and plays every round it is dealt. The bot that
+// created a room starts the game if it hasn't filled after -W seconds.
+// Answers are random cells, or with -a the planted ones from the server's
+// DEBUG_ANSWER hook (start the server with DEBUG_HOOKS=1), so rooms play
+// all five rounds. Bots also chat and drop their connection at random, then
+// log back in and resume through the server's reconnect path.
+//
+// Every request has at most one reply in flight per bot; the time to its
+// first matching reply goes into a log-linear histogram per command (the
+// same buckets as the server's latency series). CONNECT is connect() to
+// WELCOME. The report gives throughput, p50/p90/p99/max per command and
+// error counts. Exits non-zero if no bot logged in, or if error replies and
+// timeouts exceed -x percent of timed requests.
+//
+// Build (from server/):
+//   gcc -O2 -Wall -Wextra -std=c11 -pthread -I. -o loadgen tools/loadgen.c $(ls *.c | grep -v '^main.c$')
+//
+// Usage:
+//   ./loadgen [-H host] [-p port] [-n bots] [-t threads] [-d seconds] [-R ramp_seconds] [-a]
+//             [-w think_ms] [-W start_wait_seconds] [-c chat_every_seconds] [-r reconnect_every_seconds]
+//             [-s seed] [-u name_prefix] [-x max_error_percent]
+
+#include "server.h"
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define LOADGEN_MAX_THREADS 64
+#define LOADGEN_PASSWORD "loadgen"
+#define LOADGEN_REPLY_TIMEOUT_MS 10000  // A request without a reply by then counts as a timeout
+#define LOADGEN_ROOM_IDLE_MS 20000      // Leave a room where nothing started for this long
+#define LOADGEN_READY_RETRY_MS 3000    // Ready again if ROOM_STATUS still says not ready (periodic status every 2 s)
+#define LOADGEN_POLL_MS 10
+
+// Timed requests (CMD_CONNECT is the handshake up to WELCOME)
+typedef enum {
+    CMD_CONNECT,
+    CMD_REGISTER,
+    CMD_LOGIN,
+    CMD_LIST_ROOMS,
+    CMD_CREATE_ROOM,
+    CMD_JOIN_ROOM,
+    CMD_LEAVE_ROOM,
+    CMD_READY,
+    CMD_START_GAME,
+    CMD_DEBUG_ANSWER,
+    CMD_SUBMIT,
+    CMD_READY_NEXT_ROUND,
+    CMD_CHAT,
+    CMD_COUNT,
+    CMD_NONE = -1
+} LoadCommand;
+
+static const char *command_names[CMD_COUNT] = {
+    "CONNECT", "REGISTER", "LOGIN", "LIST_ROOMS", "CREATE_ROOM", "JOIN_ROOM", "LEAVE_ROOM",
+    "READY", "START_GAME", "DEBUG_ANSWER", "SUBMIT", "READY_NEXT_ROUND", "CHAT"
+};
+
+// Replies that complete each request ("" ends the list); ERROR completes any of them
+static const char *command_replies[CMD_COUNT][3] = {
+    {"WELCOME", ""}, {"REGISTER_OK", ""}, {"LOGIN_OK", "RECONNECT_OK", ""}, {"ROOM_LIST", ""},
+    {"ROOM_CREATED", ""}, {"ROOM_JOINED", ""}, {"LEFT_ROOM", ""}, {"ROOM_STATUS", "GAME_START", ""},
+    {"GAME_START", ""}, {"DEBUG_ANSWER", ""}, {"PLAYER_SUBMITTED", ""}, {"WAIT_CONTINUE", "GAME_START", ""},
+    {"CHAT", ""}
+};
+
+// Where a bot is in the session
+typedef enum {
+    BOT_OFFLINE,     // No socket, waiting for its connect action
+    BOT_CONNECTING,  // Non-blocking connect() in progress, waiting for POLLOUT
+    BOT_HANDSHAKE,   // Connected, waiting for WELCOME
+    BOT_AUTH,        // REGISTER or LOGIN in flight
+    BOT_RESTORING,   // RECONNECT_OK received, the next ROOM_LIST/ROOM_STATUS/GAME_START says where
+    BOT_LOBBY,
+    BOT_ROOM,
+    BOT_GAME
+} BotPhase;
+
+// Deferred actions (at most one scheduled per bot)
+typedef enum {
+    ACT_NONE,
+    ACT_CONNECT,
+    ACT_LIST,
+    ACT_READY,
+    ACT_ANSWER,
+    ACT_CONTINUE
+} BotAction;
+
+typedef struct {
+    int fd;
+    BotPhase phase;
+    char name[MAX_USERNAME];
+    char buffer[BUFFER_SIZE];
+    int buffer_len;
+    int registered;
+    int is_host;         // Created the room it is in
+    int ready;           // Own ready flag per the last ROOM_STATUS
+    long long ready_ns;  // Last READY sent (READY toggles, so never resend on a stale status)
+    LoadCommand pending; // Request waiting for its reply
+    long long pending_ns;
+    BotAction action;
+    long long action_ns;
+    long long progress_ns;  // Entered the room or last round event
+    long long tick_ns;      // Next chat/reconnect roll
+    Rng rng;
+} Bot;
+
+// Per-thread results; counters are read live by the progress line, so the
+// owning thread updates them with a relaxed load and store
+typedef struct {
+    atomic_ullong sent;
+    atomic_ullong received;
+    atomic_ullong bytes_sent;
+    atomic_ullong bytes_received;
+    atomic_ullong connects;
+    atomic_ullong connect_failures;  // connect() failed
+    atomic_ullong rejected;          // Closed before WELCOME (server full)
+    atomic_ullong dropped;           // Closed by the server after WELCOME
+    atomic_ullong reconnects;        // Dropped on purpose
+    atomic_ullong errors;            // ERROR replies
+    atomic_ullong timeouts;
+    atomic_ullong logins;
+    atomic_ullong games_won;
+    atomic_ullong games_lost;
+    atomic_ullong rounds_won;
+    atomic_ullong aborted;
+    atomic_ullong debug_refused;     // DEBUG_ANSWER unknown: server runs without DEBUG_HOOKS=1
+    unsigned long long latency[CMD_COUNT][METRIC_LATENCY_BUCKETS];
+    unsigned long long latency_count[CMD_COUNT];
+    unsigned long long latency_max[CMD_COUNT];
+    unsigned long long command_errors[CMD_COUNT];
+} FleetStats;
+
+typedef struct {
+    struct sockaddr_in addr;
+    int bots;
+    int threads;
+    int duration;
+    int ramp_ms;
+    int use_debug_answer;
+    int think_ms;
+    int start_wait_ms;
+    int chat_every;       // Seconds between chats per bot on average, 0 = never
+    int reconnect_every;  // Seconds between drops per bot on average, 0 = never
+    uint64_t seed;
+    const char *prefix;
+    double max_error_percent;  // < 0 = no gate
+} FleetConfig;
+
+typedef struct {
+    pthread_t thread;
+    int index;
+    int first_bot;
+    int bot_count;
+    FleetStats stats;
+} Worker;
+
+static FleetConfig config;
+static atomic_int stop_flag = 0;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    atomic_store(&stop_flag, 1);
+}
+
+static void stat_add(atomic_ullong *value, unsigned long long delta) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+static unsigned long long stat_get(const atomic_ullong *value) {
+    return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+static void bot_schedule(Bot *bot, BotAction action, long long delay_ms) {
+    bot->action = action;
+    bot->action_ns = time_now_ns() + delay_ms * 1000000LL;
+}
+
+// Think time: uniform in [think / 2, 3 * think / 2]
+static int bot_think_ms(Bot *bot, int think_ms) {
+    if (think_ms <= 1) return think_ms;
+    return think_ms / 2 + (int)rng_below(&bot->rng, (uint32_t)think_ms);
+}
+
+static void bot_close(Bot *bot) {
+    if (bot->fd >= 0) close(bot->fd);
+    bot->fd = -1;
+    bot->phase = BOT_OFFLINE;
+    bot->buffer_len = 0;
+    bot->pending = CMD_NONE;
+    bot->is_host = 0;
+    bot->ready = 0;
+}
+
+// Drop the connection and come back after delay_ms
+static void bot_reconnect_later(Bot *bot, long long delay_ms) {
+    bot_close(bot);
+    bot_schedule(bot, ACT_CONNECT, delay_ms);
+}
+
+// Send one line; a timed command must be the only request in flight
+static int bot_send(Worker *worker, Bot *bot, LoadCommand command, const char *line) {
+    size_t len = strlen(line);
+    ssize_t sent = send(bot->fd, line, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    
+    if (sent != (ssize_t)len) {
+        // Socket buffer full or peer gone: the stream is no longer usable
+        stat_add(&worker->stats.dropped, 1);
+        bot_reconnect_later(bot, 1000);
+        return 0;
+    }
+    stat_add(&worker->stats.sent, 1);
+    stat_add(&worker->stats.bytes_sent, len);
+    if (command != CMD_NONE) {
+        bot->pending = command;
+        bot->pending_ns = time_now_ns();
+    }
+    return 1;
+}
+
+static void bot_connected(Worker *worker, Bot *bot) {
+    stat_add(&worker->stats.connects, 1);
+    bot->phase = BOT_HANDSHAKE;
+    bot->tick_ns = time_now_ns() + 1000000000LL;
+}
+
+// Start a non-blocking connect; CONNECT stays pending (and times out like a request) until WELCOME
+static void bot_connect(Worker *worker, Bot *bot) {
+    bot->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bot->fd < 0 || fcntl(bot->fd, F_SETFL, O_NONBLOCK) < 0) {
+        stat_add(&worker->stats.connect_failures, 1);
+        bot_reconnect_later(bot, 1000);
+        return;
+    }
+    
+    bot->pending = CMD_CONNECT;
+    bot->pending_ns = time_now_ns();
+    if (connect(bot->fd, (struct sockaddr *)&config.addr, sizeof(config.addr)) == 0) {
+        bot_connected(worker, bot);
+    } else if (errno == EINPROGRESS) {
+        bot->phase = BOT_CONNECTING;
+    } else {
+        stat_add(&worker->stats.connect_failures, 1);
+        bot_reconnect_later(bot, 1000);
+    }
+}
+
+// Socket of a connecting bot became writable (or failed): SO_ERROR has the connect() result
+static void bot_finish_connect(Worker *worker, Bot *bot) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    
+    if (getsockopt(bot->fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+        stat_add(&worker->stats.connect_failures, 1);
+        bot_reconnect_later(bot, 1000);
+        return;
+    }
+    bot_connected(worker, bot);
+}
+
+static void bot_record_reply(Worker *worker, Bot *bot, int error) {
+    FleetStats *stats = &worker->stats;
+    LoadCommand command = bot->pending;
+    unsigned long long ns = (unsigned long long)(time_now_ns() - bot->pending_ns);
+    
+    stats->latency[command][metrics_latency_bucket(ns)]++;
+    stats->latency_count[command]++;
+    if (ns > stats->latency_max[command]) stats->latency_max[command] = ns;
+    if (error) {
+        stats->command_errors[command]++;
+        stat_add(&stats->errors, 1);
+    }
+    bot->pending = CMD_NONE;
+}
+
+// Reply to the request in flight; room broadcasts count only when they carry our own name
+static int reply_matches(const Bot *bot, LoadCommand command, const char *verb, const char *args) {
+    size_t name_len = strlen(bot->name);
+    
+    for (int i = 0; command_replies[command][i][0]; i++) {
+        if (strcmp(verb, command_replies[command][i]) != 0) continue;
+        if (command == CMD_CHAT) {
+            // CHAT|name|text
+            return args && strncmp(args, bot->name, name_len) == 0 && args[name_len] == '|';
+        }
+        if (command == CMD_SUBMIT) {
+            // PLAYER_SUBMITTED|slot|name
+            const char *name = args ? strchr(args, '|') : NULL;
+            return name && strcmp(name + 1, bot->name) == 0;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static void bot_enter_lobby(Bot *bot) {
+    bot->phase = BOT_LOBBY;
+    bot->is_host = 0;
+    bot->ready = 0;
+    bot_schedule(bot, ACT_LIST, 50 + rng_below(&bot->rng, 250));
+}
+
+static void bot_enter_room(Bot *bot, int is_host) {
+    bot->phase = BOT_ROOM;
+    bot->is_host = is_host;
+    bot->ready = 0;
+    bot->progress_ns = time_now_ns();
+    bot_schedule(bot, ACT_READY, bot_think_ms(bot, config.think_ms / 4));
+}
+
+// ROOM_LIST|id:name:count|...: join the fullest loadgen room with a seat, else create one
+static void bot_pick_room(Worker *worker, Bot *bot, char *list) {
+    int best_id = -1, best_count = -1;
+    size_t prefix_len = strlen(config.prefix);
+    char *save = NULL;
+    
+    for (char *entry = strtok_r(list, "|", &save); entry; entry = strtok_r(NULL, "|", &save)) {
+        int id, count;
+        char name[MAX_ROOM_NAME];
+        if (sscanf(entry, "%d:%31[^:]:%d", &id, name, &count) != 3) continue;
+        if (strncmp(name, config.prefix, prefix_len) != 0 || count >= PLAYERS_PER_ROOM) continue;
+        if (count > best_count) {
+            best_id = id;
+            best_count = count;
+        }
+    }
+    
+    char line[96];
+    if (best_id >= 0) {
+        snprintf(line, sizeof(line), "JOIN_ROOM|%d\n", best_id);
+        bot_send(worker, bot, CMD_JOIN_ROOM, line);
+    } else {
+        snprintf(line, sizeof(line), "CREATE_ROOM|%s-%s\n", config.prefix, bot->name);
+        bot_send(worker, bot, CMD_CREATE_ROOM, line);
+    }
+}
+
+// ROOM_STATUS|count|host|slot:name:ready:ping|...: learn own ready flag and host seat
+static void bot_read_status(Bot *bot, char *status) {
+    char *save = NULL;
+    char *field = strtok_r(status, "|", &save);  // Player count
+    field = strtok_r(NULL, "|", &save);          // Host seat
+    int host = field ? atoi(field) : -1;
+    
+    for (char *entry = strtok_r(NULL, "|", &save); entry; entry = strtok_r(NULL, "|", &save)) {
+        int slot, ready;
+        char name[MAX_USERNAME];
+        if (sscanf(entry, "%d:%31[^:]:%d", &slot, name, &ready) != 3) continue;
+        if (strcmp(name, bot->name) == 0) {
+            bot->ready = ready;
+            bot->is_host = slot == host;
+        }
+    }
+    
+    // Not ready (game over, or state lost on reconnect): ready up again
+    if (!bot->ready && bot->action == ACT_NONE && time_now_ns() - bot->ready_ns > LOADGEN_READY_RETRY_MS * 1000000LL) {
+        bot_schedule(bot, ACT_READY, bot_think_ms(bot, config.think_ms / 4));
+    }
+}
+
+// React to one line from the server
+static void bot_handle_line(Worker *worker, Bot *bot, char *line) {
+    char *args = strchr(line, '|');
+    if (args) *args++ = '\0';
+    const char *verb = line;
+    LoadCommand command = bot->pending;
+    
+    stat_add(&worker->stats.received, 1);
+    
+    if (strcmp(verb, "PING") == 0) {
+        bot_send(worker, bot, CMD_NONE, "PONG\n");
+        return;
+    }
+    
+    // Complete the request in flight
+    if (command != CMD_NONE) {
+        int error = strcmp(verb, "ERROR") == 0;
+        if (error || reply_matches(bot, command, verb, args)) {
+            // Name taken by an earlier run is expected: log in instead
+            int name_taken = error && command == CMD_REGISTER && args && strstr(args, "already exists");
+            bot_record_reply(worker, bot, error && !name_taken);
+            if (name_taken) {
+                char login[160];
+                bot->registered = 1;
+                snprintf(login, sizeof(login), "LOGIN|%s|" LOADGEN_PASSWORD "\n", bot->name);
+                bot_send(worker, bot, CMD_LOGIN, login);
+                return;
+            }
+            if (error) {
+                if (command == CMD_REGISTER || command == CMD_LOGIN) {
+                    bot_reconnect_later(bot, 1000);
+                } else if (command == CMD_CREATE_ROOM || command == CMD_JOIN_ROOM) {
+                    bot_schedule(bot, ACT_LIST, 200 + rng_below(&bot->rng, 800));
+                } else if (command == CMD_LEAVE_ROOM) {
+                    bot_enter_lobby(bot);
+                } else if (command == CMD_DEBUG_ANSWER && args && strstr(args, "Unknown command")) {
+                    // Hook disabled on the server: answer at random from now on
+                    stat_add(&worker->stats.debug_refused, 1);
+                    bot_schedule(bot, ACT_ANSWER, 0);
+                }
+                return;
+            }
+        }
+    }
+    
+    if (strcmp(verb, "WELCOME") == 0) {
+        char auth[160];
+        bot->phase = BOT_AUTH;
+        if (bot->registered) {
+            snprintf(auth, sizeof(auth), "LOGIN|%s|" LOADGEN_PASSWORD "\n", bot->name);
+            bot_send(worker, bot, CMD_LOGIN, auth);
+        } else {
+            snprintf(auth, sizeof(auth), "REGISTER|%s|" LOADGEN_PASSWORD "\n", bot->name);
+            bot_send(worker, bot, CMD_REGISTER, auth);
+        }
+    } else if (strcmp(verb, "REGISTER_OK") == 0) {
+        char login[160];
+        bot->registered = 1;
+        snprintf(login, sizeof(login), "LOGIN|%s|" LOADGEN_PASSWORD "\n", bot->name);
+        bot_send(worker, bot, CMD_LOGIN, login);
+    } else if (strcmp(verb, "LOGIN_OK") == 0) {
+        stat_add(&worker->stats.logins, 1);
+        bot_enter_lobby(bot);
+    } else if (strcmp(verb, "RECONNECT_OK") == 0) {
+        stat_add(&worker->stats.logins, 1);
+        bot->phase = BOT_RESTORING;
+    } else if (strcmp(verb, "ROOM_LIST") == 0) {
+        if (bot->phase == BOT_RESTORING) {
+            bot_enter_lobby(bot);
+        } else if (command == CMD_LIST_ROOMS && bot->phase == BOT_LOBBY) {
+            char empty[1] = "";
+            bot_pick_room(worker, bot, args ? args : empty);
+        }
+    } else if (strcmp(verb, "ROOM_CREATED") == 0) {
+        bot_enter_room(bot, 1);
+    } else if (strcmp(verb, "ROOM_JOINED") == 0) {
+        if (bot->phase != BOT_ROOM) bot_enter_room(bot, 0);
+    } else if (strcmp(verb, "ROOM_STATUS") == 0) {
+        if (bot->phase == BOT_RESTORING) {
+            bot->phase = BOT_ROOM;
+            bot->progress_ns = time_now_ns();
+        }
+        if (bot->phase == BOT_ROOM && args) bot_read_status(bot, args);
+    } else if (strcmp(verb, "GAME_START") == 0) {
+        bot->phase = BOT_GAME;
+        bot->progress_ns = time_now_ns();
+        bot_schedule(bot, ACT_ANSWER, bot_think_ms(bot, config.think_ms));
+    } else if (strcmp(verb, "DEBUG_ANSWER") == 0) {
+        int row, col;
+        char submit[64];
+        if (args && sscanf(args, "%d|%d", &row, &col) == 2) {
+            snprintf(submit, sizeof(submit), "SUBMIT|%d|%d\n", row, col);
+            bot_send(worker, bot, CMD_SUBMIT, submit);
+        }
+    } else if (strcmp(verb, "ROUND_END") == 0) {
+        stat_add(&worker->stats.rounds_won, 1);
+        bot->progress_ns = time_now_ns();
+        bot_schedule(bot, ACT_CONTINUE, bot_think_ms(bot, config.think_ms / 4));
+    } else if (strcmp(verb, "GAME_END") == 0) {
+        int won = args && strncmp(args, "WIN", 3) == 0;
+        stat_add(won ? &worker->stats.games_won : &worker->stats.games_lost, 1);
+        if (won) stat_add(&worker->stats.rounds_won, 1);
+        bot->phase = BOT_ROOM;
+        bot->ready = 0;
+        bot->progress_ns = time_now_ns();
+        bot->action = ACT_NONE;  // The ROOM_STATUS that follows readies up again
+    } else if (strcmp(verb, "GAME_ABORTED") == 0) {
+        stat_add(&worker->stats.aborted, 1);
+    } else if (strcmp(verb, "LEFT_ROOM") == 0) {
+        bot_enter_lobby(bot);
+    }
+}
+
+// Run the bot's scheduled action and its once-a-second rolls
+static void bot_step(Worker *worker, Bot *bot, long long now) {
+    // Waiting on a reply: only check it hasn't timed out
+    if (bot->pending != CMD_NONE) {
+        if (now - bot->pending_ns > LOADGEN_REPLY_TIMEOUT_MS * 1000000LL) {
+            stat_add(&worker->stats.timeouts, 1);
+            worker->stats.command_errors[bot->pending]++;
+            bot_reconnect_later(bot, 1000);
+        }
+        return;
+    }
+    
+    if (bot->phase != BOT_OFFLINE && now >= bot->tick_ns) {
+        bot->tick_ns = now + 1000000000LL;
+        
+        if (config.reconnect_every > 0 && rng_below(&bot->rng, (uint32_t)config.reconnect_every) == 0) {
+            stat_add(&worker->stats.reconnects, 1);
+            bot_reconnect_later(bot, 100 + rng_below(&bot->rng, 900));
+            return;
+        }
+        if ((bot->phase == BOT_ROOM || bot->phase == BOT_GAME) && config.chat_every > 0 &&
+            rng_below(&bot->rng, (uint32_t)config.chat_every) == 0) {
+            bot_send(worker, bot, CMD_CHAT, "CHAT|glhf from loadgen\n");
+            return;
+        }
+        
+        // Nothing started for a while (room never filled, peer gone mid-round): start over
+        long long idle_limit = bot->phase == BOT_GAME ? (GAME_DURATION + 15) * 1000LL : LOADGEN_ROOM_IDLE_MS;
+        if ((bot->phase == BOT_ROOM || bot->phase == BOT_GAME) && now - bot->progress_ns > idle_limit * 1000000LL) {
+            bot->action = ACT_NONE;
+            bot_send(worker, bot, CMD_LEAVE_ROOM, "LEAVE_ROOM\n");
+            return;
+        }
+        
+        // Host of a room that didn't fill: start with whoever is there
+        if (bot->phase == BOT_ROOM && bot->is_host && bot->ready &&
+            now - bot->progress_ns > config.start_wait_ms * 1000000LL) {
+            bot->progress_ns = now;
+            bot_send(worker, bot, CMD_START_GAME, "START_GAME\n");
+            return;
+        }
+    }
+    
+    if (bot->action == ACT_NONE || now < bot->action_ns) return;
+    BotAction action = bot->action;
+    bot->action = ACT_NONE;
+    
+    switch (action) {
+        case ACT_CONNECT:
+            bot_connect(worker, bot);
+            break;
+        case ACT_LIST:
+            if (bot->phase == BOT_LOBBY) bot_send(worker, bot, CMD_LIST_ROOMS, "LIST_ROOMS\n");
+            break;
+        case ACT_READY:
+            if (bot->phase == BOT_ROOM && !bot->ready && bot_send(worker, bot, CMD_READY, "READY\n")) {
+                bot->ready_ns = now;
+            }
+            break;
+        case ACT_ANSWER:
+            if (bot->phase != BOT_GAME) break;
+            if (config.use_debug_answer && stat_get(&worker->stats.debug_refused) == 0) {
+                bot_send(worker, bot, CMD_DEBUG_ANSWER, "DEBUG_ANSWER\n");
+            } else {
+                char submit[64];
+                snprintf(submit, sizeof(submit), "SUBMIT|%u|%u\n",
+                         rng_below(&bot->rng, MATRIX_SIZE), rng_below(&bot->rng, MATRIX_SIZE));
+                bot_send(worker, bot, CMD_SUBMIT, submit);
+            }
+            break;
+        case ACT_CONTINUE:
+            if (bot->phase == BOT_GAME) bot_send(worker, bot, CMD_READY_NEXT_ROUND, "READY_NEXT_ROUND\n");
+            break;
+        default:
+            break;
+    }
+}
+
+// Read what arrived and handle every complete line
+static void bot_receive(Worker *worker, Bot *bot) {
+    ssize_t n = recv(bot->fd, bot->buffer + bot->buffer_len, sizeof(bot->buffer) - 1 - bot->buffer_len, 0);
+    
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (n <= 0) {
+        // Closed before WELCOME means the server turned us away (MAX_CLIENTS)
+        stat_add(bot->phase == BOT_HANDSHAKE ? &worker->stats.rejected : &worker->stats.dropped, 1);
+        bot_reconnect_later(bot, 1000 + rng_below(&bot->rng, 1000));
+        return;
+    }
+    stat_add(&worker->stats.bytes_received, (unsigned long long)n);
+    bot->buffer_len += (int)n;
+    bot->buffer[bot->buffer_len] = '\0';
+    
+    char *line_start = bot->buffer;
+    char *line_end;
+    while (bot->fd >= 0 && (line_end = strchr(line_start, '\n')) != NULL) {
+        *line_end = '\0';
+        if (*line_start) bot_handle_line(worker, bot, line_start);
+        line_start = line_end + 1;
+    }
+    if (bot->fd < 0) return;  // Reconnecting, the rest of the stream is gone
+    
+    int remaining = bot->buffer_len - (int)(line_start - bot->buffer);
+    if (remaining >= (int)sizeof(bot->buffer) - 1) remaining = 0;  // Line longer than any reply
+    memmove(bot->buffer, line_start, remaining);
+    bot->buffer_len = remaining;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    Bot *bots = calloc(worker->bot_count, sizeof(Bot));
+    struct pollfd *fds = calloc(worker->bot_count, sizeof(struct pollfd));
+    int *owners = calloc(worker->bot_count, sizeof(int));
+    
+    if (!bots || !fds || !owners) {
+        fprintf(stderr, "worker %d: out of memory\n", worker->index);
+        free(bots);
+        free(fds);
+        free(owners);
+        return NULL;
+    }
+    
+    // Spread first connects over the ramp so the listen backlog isn't flooded
+    for (int i = 0; i < worker->bot_count; i++) {
+        Bot *bot = &bots[i];
+        int id = worker->first_bot + i;
+        bot->fd = -1;
+        bot->pending = CMD_NONE;
+        snprintf(bot->name, sizeof(bot->name), "%s%d", config.prefix, id);
+        rng_seed(&bot->rng, config.seed, (uint64_t)id);
+        bot_schedule(bot, ACT_CONNECT, config.ramp_ms > 0 ? rng_below(&bot->rng, (uint32_t)config.ramp_ms) : 0);
+    }
+    
+    while (!atomic_load(&stop_flag)) {
+        int count = 0;
+        for (int i = 0; i < worker->bot_count; i++) {
+            if (bots[i].fd < 0) continue;
+            fds[count].fd = bots[i].fd;
+            fds[count].events = bots[i].phase == BOT_CONNECTING ? POLLOUT : POLLIN;
+            fds[count].revents = 0;
+            owners[count++] = i;
+        }
+        
+        if (poll(fds, count, LOADGEN_POLL_MS) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            Bot *bot = &bots[owners[i]];
+            if (!fds[i].revents || bot->fd != fds[i].fd) continue;
+            if (bot->phase == BOT_CONNECTING) {
+                bot_finish_connect(worker, bot);
+            } else if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                bot_receive(worker, bot);
+            }
+        }
+        
+        long long now = time_now_ns();
+        for (int i = 0; i < worker->bot_count; i++) {
+            bot_step(worker, &bots[i], now);
+        }
+    }
+    
+    for (int i = 0; i < worker->bot_count; i++) {
+        bot_close(&bots[i]);
+    }
+    free(bots);
+    free(fds);
+    free(owners);
+    return NULL;
+}
+
+// Upper bound of the bucket holding the q-th quantile, never above max
+static unsigned long long latency_quantile(const unsigned long long *buckets, unsigned long long count,
+                                           unsigned long long max, double q) {
+    if (count == 0) return 0;
+    
+    unsigned long long rank = (unsigned long long)(q * count + 0.999999);
+    unsigned long long seen = 0;
+    if (rank < 1) rank = 1;
+    for (int b = 0; b < METRIC_LATENCY_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            unsigned long long bound = metrics_latency_bound(b);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+static unsigned long long fleet_sum(Worker *workers, size_t offset) {
+    unsigned long long total = 0;
+    for (int w = 0; w < config.threads; w++) {
+        total += stat_get((const atomic_ullong *)((const char *)&workers[w].stats + offset));
+    }
+    return total;
+}
+
+#define FLEET_SUM(workers, field) fleet_sum(workers, offsetof(FleetStats, field))
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-H host] [-p port] [-n bots] [-t threads] [-d seconds] [-R ramp_seconds] [-a]\n"
+            "          [-w think_ms] [-W start_wait_seconds] [-c chat_every_seconds] [-r reconnect_every_seconds]\n"
+            "          [-s seed] [-u name_prefix] [-x max_error_percent]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = "127.0.0.1";
+    int port = PORT;
+    
+    config.bots = 100;
+    config.threads = 4;
+    config.duration = 30;
+    config.ramp_ms = 2000;
+    config.think_ms = 1000;
+    config.start_wait_ms = 3000;
+    config.chat_every = 30;
+    config.reconnect_every = 300;
+    config.seed = (uint64_t)time(NULL);
+    config.prefix = "lg";
+    config.max_error_percent = -1;
+    
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-a") == 0) { config.use_debug_answer = 1; continue; }
+        if (!value || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            usage(argv[0]);
+            return 2;
+        }
+        switch (argv[i][1]) {
+            case 'H': host = value; break;
+            case 'p': port = atoi(value); break;
+            case 'n': config.bots = atoi(value); break;
+            case 't': config.threads = atoi(value); break;
+            case 'd': config.duration = atoi(value); break;
+            case 'R': config.ramp_ms = (int)(atof(value) * 1000); break;
+            case 'w': config.think_ms = atoi(value); break;
+            case 'W': config.start_wait_ms = (int)(atof(value) * 1000); break;
+            case 'c': config.chat_every = atoi(value); break;
+            case 'r': config.reconnect_every = atoi(value); break;
+            case 's': config.seed = strtoull(value, NULL, 10); break;
+            case 'u': config.prefix = value; break;
+            case 'x': config.max_error_percent = atof(value); break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+        i++;
+    }
+    if (config.bots < 1 || config.duration < 1 || config.threads < 1 || strlen(config.prefix) > 12) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (config.threads > LOADGEN_MAX_THREADS) config.threads = LOADGEN_MAX_THREADS;
+    if (config.threads > config.bots) config.threads = config.bots;
+    
+    struct addrinfo hints, *resolved;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &resolved) != 0) {
+        fprintf(stderr, "Cannot resolve %s\n", host);
+        return 2;
+    }
+    memcpy(&config.addr, resolved->ai_addr, sizeof(config.addr));
+    config.addr.sin_port = htons((uint16_t)port);
+    freeaddrinfo(resolved);
+    
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    Worker *workers = calloc(config.threads, sizeof(Worker));
+    if (!workers) return 1;
+    
+    printf("Load generator: %d bots on %d threads for %d s against %s:%d (seed %llu, answers %s)\n",
+           config.bots, config.threads, config.duration, host, port, (unsigned long long)config.seed,
+           config.use_debug_answer ? "from DEBUG_ANSWER" : "random");
+    
+    long long start_ns = time_now_ns();
+    for (int w = 0, first = 0; w < config.threads; w++) {
+        Worker *worker = &workers[w];
+        worker->index = w;
+        worker->first_bot = first;
+        worker->bot_count = config.bots / config.threads + (w < config.bots % config.threads);
+        first += worker->bot_count;
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    
+    // Progress once a second until the run ends or Ctrl+C
+    unsigned long long last_sent = 0;
+    for (int second = 1; second <= config.duration && !atomic_load(&stop_flag); second++) {
+        sleep(1);
+        unsigned long long sent = FLEET_SUM(workers, sent);
+        printf("[%3d s] sent %8llu (%6llu/s)  received %8llu  logins %6llu  games %5llu  errors %5llu  timeouts %4llu\n",
+               second, sent, sent - last_sent, FLEET_SUM(workers, received), FLEET_SUM(workers, logins),
+               FLEET_SUM(workers, games_won) + FLEET_SUM(workers, games_lost), FLEET_SUM(workers, errors),
+               FLEET_SUM(workers, timeouts));
+        fflush(stdout);
+        last_sent = sent;
+    }
+    atomic_store(&stop_flag, 1);
+    for (int w = 0; w < config.threads; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
+    double elapsed = (time_now_ns() - start_ns) / 1e9;
+    
+    // Merge latency histograms (threads are joined, plain reads)
+    static unsigned long long buckets[CMD_COUNT][METRIC_LATENCY_BUCKETS];
+    unsigned long long counts[CMD_COUNT] = {0}, maxes[CMD_COUNT] = {0}, errors[CMD_COUNT] = {0};
+    unsigned long long timed = 0;
+    for (int w = 0; w < config.threads; w++) {
+        const FleetStats *stats = &workers[w].stats;
+        for (int c = 0; c < CMD_COUNT; c++) {
+            for (int b = 0; b < METRIC_LATENCY_BUCKETS; b++) buckets[c][b] += stats->latency[c][b];
+            counts[c] += stats->latency_count[c];
+            errors[c] += stats->command_errors[c];
+            if (stats->latency_max[c] > maxes[c]) maxes[c] = stats->latency_max[c];
+        }
+    }
+    
+    unsigned long long sent = FLEET_SUM(workers, sent);
+    unsigned long long received = FLEET_SUM(workers, received);
+    unsigned long long error_replies = FLEET_SUM(workers, errors);
+    unsigned long long timeouts = FLEET_SUM(workers, timeouts);
+    
+    printf("\nThroughput over %.1f s:\n", elapsed);
+    printf("  sent     %10llu msgs %10.1f/s  %12llu bytes\n", sent, sent / elapsed, FLEET_SUM(workers, bytes_sent));
+    printf("  received %10llu msgs %10.1f/s  %12llu bytes\n", received, received / elapsed,
+           FLEET_SUM(workers, bytes_received));
+    printf("Sessions: %llu connects, %llu logins, %llu connect failures, %llu rejected, %llu dropped by server, %llu reconnects\n",
+           FLEET_SUM(workers, connects), FLEET_SUM(workers, logins), FLEET_SUM(workers, connect_failures),
+           FLEET_SUM(workers, rejected), FLEET_SUM(workers, dropped), FLEET_SUM(workers, reconnects));
+    printf("Games (per bot): %llu won, %llu lost, %llu rounds won, %llu aborted\n",
+           FLEET_SUM(workers, games_won), FLEET_SUM(workers, games_lost), FLEET_SUM(workers, rounds_won),
+           FLEET_SUM(workers, aborted));
+    
+    printf("\nLatency (microseconds):\n");
+    printf("  %-18s %9s %7s %9s %9s %9s %9s\n", "request", "count", "errors", "p50", "p90", "p99", "max");
+    for (int c = 0; c < CMD_COUNT; c++) {
+        if (counts[c] == 0 && errors[c] == 0) continue;
+        timed += counts[c];
+        printf("  %-18s %9llu %7llu %9.1f %9.1f %9.1f %9.1f\n", command_names[c], counts[c], errors[c],
+               latency_quantile(buckets[c], counts[c], maxes[c], 0.5) / 1e3,
+               latency_quantile(buckets[c], counts[c], maxes[c], 0.9) / 1e3,
+               latency_quantile(buckets[c], counts[c], maxes[c], 0.99) / 1e3, maxes[c] / 1e3);
+    }
+    
+    double error_percent = timed + timeouts > 0 ? 100.0 * (error_replies + timeouts) / (timed + timeouts) : 0;
+    printf("\nErrors: %llu error replies, %llu timeouts (%.2f%% of timed requests)\n",
+           error_replies, timeouts, error_percent);
+    if (config.use_debug_answer && FLEET_SUM(workers, debug_refused) > 0) {
+        printf("Warning: DEBUG_ANSWER refused, start the server with DEBUG_HOOKS=1 (answered at random)\n");
+    }
+    
+    int failed = 0;
+    if (FLEET_SUM(workers, logins) == 0) {
+        printf("FAIL: no bot logged in\n");
+        failed = 1;
+    }
+    if (config.max_error_percent >= 0 && error_percent > config.max_error_percent) {
+        printf("FAIL: error rate %.2f%% over %.2f%%\n", error_percent, config.max_error_percent);
+        failed = 1;
+    }
+    
+    free(workers);
+    return failed;
+}
@@ -0,0 +1,63 @@
+// Match log reader: prints every recorded round and optionally replays it
+//
+// Build (from server/):
+//   gcc -Wall -Wextra -std=c11 -pthread -I. -o matchlog_dump tools/matchlog_dump.c $(ls *.c | grep -v '^main.c$')
+//
+// Usage:
+//   ./matchlog_dump [--replay] [matches.dat]
+
+#include "server.h"
+
+int main(int argc, char *argv[]) {
+    const char *path = MATCHLOG_FILE;
+    int replay = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--replay") == 0) {
+            replay = 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    
+    MatchLogView view;
+    if (!matchlog_map(path, &view)) {
+        return 1;
+    }
+    
+    int won_count = 0;
+    int mismatches = 0;
+    Puzzle puzzle;
+    
+    for (int i = 0; i < view.count; i++) {
+        const MatchRecord *record = &view.records[i];
+        if (record->won) won_count++;
+        
+        printf("#%d room %d round %d seed %u format %d ops %d/%d result %d %s",
+               i, record->room_id, record->round, record->seed, record->format,
+               record->ops[0], record->ops[1], record->result,
+               record->won ? "WIN" : (record->timeout ? "TIMEOUT" : "LOSE"));
+        
+        for (int p = 0; p < PLAYERS_PER_ROOM; p++) {
+            if (!record->players[p][0]) continue;
+            printf(" | %s [%d,%d] %dms", record->players[p],
+                   record->submitted[p][0], record->submitted[p][1], record->solve_ms[p]);
+        }
+        
+        if (replay) {
+            int ok = matchlog_replay(record, &puzzle);
+            if (!ok) mismatches++;
+            printf(" | replay %s", ok ? "OK" : "MISMATCH");
+        }
+        printf("\n");
+    }
+    
+    printf("%d rounds, %d won", view.count, won_count);
+    if (replay) {
+        printf(", %d replay mismatches", mismatches);
+    }
+    printf("\n");
+    
+    matchlog_unmap(&view);
+    return mismatches > 0;
+}
@@ -0,0 +1,319 @@
+// Protocol hot-path microbenchmarks
+//
+// Runs the server's own functions on a hand-built Server: four clients in
+// one room, each with a socketpair standing in for its TCP connection, so
+// every client_send() is a real send() into a local socket. The bench end
+// of each pair is drained between timed batches, outside the timing.
+//
+//   frame.*        client_process_data(): recv, line framing, dispatch of PONG
+//   dispatch.*     handle_message(): parse, metrics and the handler
+//   format.*       send_room_status() and send_room_list() on a full server
+//   broadcast.*    room_broadcast() of a short line to four players
+//   encode.*       puzzle_send_to_clients(): GAME_START for four players
+//   verify.*       puzzle_verify_solution() on random submissions
+//
+// Every benchmark runs a fixed number of operations (-n, default 200000)
+// in fixed batches after a warmup, so runs are comparable. Reported per
+// operation: mean, p50 and p99 over batches, and bytes sent. -j prints
+// JSON instead of a table, for tracking numbers across commits; a future
+// binary protocol gets its own entries under the same groups.
+//
+// Build (from server/):
+//   gcc -O2 -Wall -Wextra -std=c11 -pthread -I. -o proto_bench tools/proto_bench.c $(ls *.c | grep -v '^main.c$')
+//
+// Usage:
+//   ./proto_bench [-n operations] [-b filter] [-j]
+
+#include "server.h"
+#include <fcntl.h>
+
+#define BENCH_BATCH 64         // Operations per timed batch
+#define BENCH_WARMUP_BATCHES 16
+#define BENCH_SNDBUF (1 << 20)  // Socket buffer so a batch never blocks in send()
+#define FRAME_LINES 64          // PONG lines per frame.pong call
+
+typedef struct {
+    const char *name;
+    int batch;                  // Operations per timed batch (1 when each needs fresh input)
+    void (*prepare)(void);      // Untimed, before every batch
+    void (*run)(int i);
+} Benchmark;
+
+typedef struct {
+    const char *name;
+    long operations;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double bytes_per_op;
+} BenchResult;
+
+static Server server;
+static int peer_fds[PLAYERS_PER_ROOM];  // Bench end of each client's socketpair
+static unsigned long long drained_bytes = 0;
+static int submissions[1024][PLAYERS_PER_ROOM][2];
+static long long checksum = 0;  // Keeps the optimizer from dropping the work
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Read everything the server sent so far
+static void drain_peers(void) {
+    char buffer[65536];
+    for (int i = 0; i < PLAYERS_PER_ROOM; i++) {
+        ssize_t n;
+        while ((n = recv(peer_fds[i], buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+            drained_bytes += (unsigned long long)n;
+        }
+    }
+}
+
+// Four clients in room 0 with a round-3 puzzle dealt, and every other room open
+static int setup_server(void) {
+    memset(&server, 0, sizeof(server));
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        server.clients[i].socket_fd = -1;
+        server.clients[i].room_id = -1;
+    }
+    for (int r = 0; r < MAX_ROOMS; r++) {
+        Room *room = &server.rooms[r];
+        room->id = r;
+        room->active = 1;
+        snprintf(room->name, sizeof(room->name), "Room %02d", r);
+        for (int p = 0; p < PLAYERS_PER_ROOM; p++) {
+            room->player_ids[p] = -1;
+        }
+        room->player_count = r % PLAYERS_PER_ROOM;  // List formatting only reads the count
+    }
+    
+    Room *room = &server.rooms[0];
+    room->player_count = PLAYERS_PER_ROOM;
+    room->current_round = 3;
+    room->total_rounds = 5;
+    puzzle_generate(&room->puzzle, 3, 12345);
+    
+    for (int p = 0; p < PLAYERS_PER_ROOM; p++) {
+        int fds[2];
+        int size = BENCH_SNDBUF;
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+            perror("socketpair");
+            return 0;
+        }
+        setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        peer_fds[p] = fds[1];
+        
+        Client *client = &server.clients[p];
+        client->socket_fd = fds[0];
+        client->active = 1;
+        client->state = STATE_IN_ROOM;
+        client->room_id = 0;
+        client->player_index = p;
+        client->ping_ms = 12 + p;
+        snprintf(client->username, sizeof(client->username), "player%d", p);
+        room->player_ids[p] = p;
+        room->player_ready[p] = p % 2;
+    }
+    
+    Rng rng;
+    rng_seed(&rng, 777, 0);
+    for (int i = 0; i < 1024; i++) {
+        for (int p = 0; p < PLAYERS_PER_ROOM; p++) {
+            submissions[i][p][0] = rng_below(&rng, MATRIX_SIZE);
+            submissions[i][p][1] = rng_below(&rng, MATRIX_SIZE);
+        }
+    }
+    return 1;
+}
+
+// frame.pong: one recv() holding FRAME_LINES complete lines
+static void prepare_frame_pong(void) {
+    char lines[FRAME_LINES * 5 + 1];
+    for (int i = 0; i < FRAME_LINES; i++) {
+        memcpy(lines + i * 5, "PONG\n", 5);
+    }
+    if (send(peer_fds[0], lines, FRAME_LINES * 5, 0) < 0) perror("send");
+}
+
+// frame.split: 1000-byte reads that cut lines, so partial lines carry over
+static void prepare_frame_split(void) {
+    static const char stream[] = "PONG\nUNKNOWN_COMMAND|with|arguments\n";
+    static size_t offset = 0;
+    char chunk[1000];
+    for (size_t i = 0; i < sizeof(chunk); i++) {
+        chunk[i] = stream[offset];
+        offset = (offset + 1) % (sizeof(stream) - 1);
+    }
+    if (send(peer_fds[0], chunk, sizeof(chunk), 0) < 0) perror("send");
+}
+
+static void run_frame(int i) {
+    (void)i;
+    client_process_data(&server, 0);
+}
+
+static void run_dispatch_pong(int i) {
+    (void)i;
+    handle_message(&server, 0, "PONG");
+}
+
+static void run_dispatch_unknown(int i) {
+    (void)i;
+    handle_message(&server, 0, "NOT_A_COMMAND|x|y");
+}
+
+static void run_dispatch_chat(int i) {
+    (void)i;
+    handle_message(&server, 0, "CHAT|good luck everyone");
+}
+
+static void run_dispatch_list_rooms(int i) {
+    (void)i;
+    handle_message(&server, 0, "LIST_ROOMS");
+}
+
+static void run_room_status(int i) {
+    (void)i;
+    send_room_status(&server, 0);
+}
+
+static void run_room_list(int i) {
+    (void)i;
+    send_room_list(&server, 0);
+}
+
+static void run_broadcast(int i) {
+    (void)i;
+    room_broadcast(&server, 0, "PLAYER_SUBMITTED|2|player2\n", -1);
+}
+
+static void run_encode_game_start(int i) {
+    (void)i;
+    puzzle_send_to_clients(&server, 0);
+}
+
+static void run_verify(int i) {
+    checksum += puzzle_verify_solution(&server.rooms[0].puzzle, submissions[i & 1023]);
+}
+
+static const Benchmark benchmarks[] = {
+    {"frame.pong_x64", 1, prepare_frame_pong, run_frame},
+    {"frame.split_1000b", 1, prepare_frame_split, run_frame},
+    {"dispatch.pong", BENCH_BATCH, NULL, run_dispatch_pong},
+    {"dispatch.unknown", BENCH_BATCH, NULL, run_dispatch_unknown},
+    {"dispatch.chat", BENCH_BATCH, NULL, run_dispatch_chat},
+    {"dispatch.list_rooms", BENCH_BATCH, NULL, run_dispatch_list_rooms},
+    {"format.room_status", BENCH_BATCH, NULL, run_room_status},
+    {"format.room_list", BENCH_BATCH, NULL, run_room_list},
+    {"broadcast.room_4", BENCH_BATCH, NULL, run_broadcast},
+    {"encode.game_start", BENCH_BATCH, NULL, run_encode_game_start},
+    {"verify.solution", BENCH_BATCH, NULL, run_verify},
+};
+
+#define BENCHMARK_COUNT ((int)(sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+static void run_benchmark(const Benchmark *bench, long operations, BenchResult *result) {
+    long batches = (operations + bench->batch - 1) / bench->batch;
+    double *per_op = malloc((size_t)batches * sizeof(double));
+    if (!per_op) {
+        perror("malloc");
+        exit(2);
+    }
+    
+    for (int w = 0; w < BENCH_WARMUP_BATCHES; w++) {
+        if (bench->prepare) bench->prepare();
+        for (int i = 0; i < bench->batch; i++) bench->run(i);
+        drain_peers();
+    }
+    
+    double total = 0;
+    unsigned long long bytes_start = drained_bytes;
+    for (long b = 0; b < batches; b++) {
+        if (bench->prepare) bench->prepare();
+        double start = now_ns();
+        for (int i = 0; i < bench->batch; i++) {
+            bench->run((int)(b * bench->batch + i));
+        }
+        double elapsed = now_ns() - start;
+        drain_peers();
+        per_op[b] = elapsed / bench->batch;
+        total += elapsed;
+    }
+    
+    long done = batches * bench->batch;
+    qsort(per_op, batches, sizeof(double), compare_double);
+    result->name = bench->name;
+    result->operations = done;
+    result->mean_ns = total / done;
+    result->p50_ns = per_op[batches / 2];
+    result->p99_ns = per_op[(long)(batches * 0.99) < batches ? (long)(batches * 0.99) : batches - 1];
+    result->bytes_per_op = (double)(drained_bytes - bytes_start) / done;
+    free(per_op);
+}
+
+int main(int argc, char *argv[]) {
+    long operations = 200000;
+    const char *filter = NULL;
+    int json = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            operations = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0) {
+            json = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [-n operations] [-b filter] [-j]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (operations <= 0) operations = 200000;
+    
+    // Handlers log at INFO and DEBUG, which would time the logger instead
+    log_set_level(LOG_ERROR);
+    if (!setup_server()) {
+        return 2;
+    }
+    
+    BenchResult results[BENCHMARK_COUNT];
+    int count = 0;
+    for (int b = 0; b < BENCHMARK_COUNT; b++) {
+        if (filter && !strstr(benchmarks[b].name, filter)) continue;
+        run_benchmark(&benchmarks[b], operations, &results[count++]);
+    }
+    
+    if (json) {
+        printf("{\"operations\": %ld, \"batch\": %d, \"benchmarks\": [", operations, BENCH_BATCH);
+        for (int r = 0; r < count; r++) {
+            printf("%s\n  {\"name\": \"%s\", \"operations\": %ld, \"mean_ns\": %.1f, \"p50_ns\": %.1f, "
+                   "\"p99_ns\": %.1f, \"bytes_per_op\": %.1f}", r ? "," : "", results[r].name,
+                   results[r].operations, results[r].mean_ns, results[r].p50_ns, results[r].p99_ns,
+                   results[r].bytes_per_op);
+        }
+        printf("\n], \"checksum\": %lld}\n", checksum);
+    } else {
+        printf("%-22s %10s %10s %10s %10s %10s\n", "benchmark", "ops", "mean ns", "p50 ns", "p99 ns", "bytes/op");
+        for (int r = 0; r < count; r++) {
+            printf("%-22s %10ld %10.1f %10.1f %10.1f %10.1f\n", results[r].name, results[r].operations,
+                   results[r].mean_ns, results[r].p50_ns, results[r].p99_ns, results[r].bytes_per_op);
+        }
+        printf("(checksum %lld)\n", checksum);
+    }
+    
+    for (int p = 0; p < PLAYERS_PER_ROOM; p++) {
+        close(server.clients[p].socket_fd);
+        close(peer_fds[p]);
+    }
+    return 0;
+}
@@ -0,0 +1,238 @@
+// Puzzle bank generator: builds a puzzles.bank file offline
+//
+// Every puzzle is calibrated into its round's difficulty band and validated
+// (planted answer holds, at least one solution, distinct non-zero cells that
+// fit the record) before it is written. Offline there is time to be picky:
+// a candidate with more answers than the round's bound (-b, by default
+// puzzle_solution_bound()) is dropped and another seed drawn, up to -a
+// candidates per record; a record that runs out is left out of the bank. The
+// bounds go into the bank header and the server refuses records above them.
+// Tighter bounds than the generator's cost decoy skew (small values go
+// missing from the matrices, see tools/puzzle_bench), so lower them with care.
+// Workers split each round's quota and draw seeds from their own streams;
+// repeated seeds are dropped afterwards so every record in a round is a
+// different puzzle.
+//
+// Build (from server/):
+//   gcc -O2 -Wall -Wextra -std=c11 -pthread -I. -o puzzle_bank_gen tools/puzzle_bank_gen.c $(ls *.c | grep -v '^main.c$')
+//
+// Usage:
+//   ./puzzle_bank_gen [-n puzzles_per_round] [-j threads] [-s seed] [-o puzzles.bank]
+//                     [-b bound1,...,bound5] [-a attempts_per_record]
+
+#include "server.h"
+#include <pthread.h>
+
+#define FILTER_ATTEMPTS 256  // Default -a: candidates per record before it is left out
+
+typedef struct {
+    int index;
+    int threads;
+    uint64_t seed;
+    uint32_t per_round;
+    const uint32_t *bounds;
+    int attempts;
+    PuzzleBankRecord **records;
+    long rejected;   // Failed validation
+    long filtered;   // Valid, but over the round's bound
+    long missing;    // Records left out after attempts candidates
+} Worker;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Planted answer holds, the puzzle has answers, every matrix has distinct non-zero cells
+static int puzzle_valid(const Puzzle *puzzle) {
+    if (puzzle->solution_count < 1 || !puzzle_check_values(puzzle, puzzle->solution_values)) {
+        return 0;
+    }
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        const int *cells = &puzzle->matrices[m].data[0][0];
+        for (int a = 0; a < MATRIX_SIZE * MATRIX_SIZE; a++) {
+            if (cells[a] == 0) return 0;
+            for (int b = a + 1; b < MATRIX_SIZE * MATRIX_SIZE; b++) {
+                if (cells[a] == cells[b]) return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Fill this worker's share of every round: records i with i % threads == index.
+// A record no candidate filled keeps solution_count 0 and is dropped later.
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    Rng seed_rng;
+    Puzzle puzzle;
+    
+    rng_seed(&seed_rng, worker->seed, (uint64_t)worker->index);
+    for (int r = 0; r < PUZZLE_POOL_ROUNDS; r++) {
+        for (uint32_t i = worker->index; i < worker->per_round; i += worker->threads) {
+            PuzzleBankRecord *record = &worker->records[r][i];
+            record->solution_count = 0;
+            
+            int attempt;
+            for (attempt = 0; attempt < worker->attempts; attempt++) {
+                puzzle_generate_calibrated(&puzzle, r + 1, &seed_rng);
+                if (!puzzle_valid(&puzzle) || !puzzle_bank_pack(&puzzle, record)) {
+                    worker->rejected++;
+                } else if ((uint32_t)puzzle.solution_count > worker->bounds[r]) {
+                    worker->filtered++;
+                } else {
+                    break;
+                }
+            }
+            if (attempt == worker->attempts) {
+                record->solution_count = 0;
+                worker->missing++;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int compare_seed(const void *a, const void *b) {
+    uint32_t x = ((const PuzzleBankRecord *)a)->seed;
+    uint32_t y = ((const PuzzleBankRecord *)b)->seed;
+    return (x > y) - (x < y);
+}
+
+// Drop unfilled records, sort by seed and drop repeats, returns the new
+// count. Seeds are uniform random, so seed order is as good as any shuffle
+// for the per-room cursors.
+static uint32_t drop_duplicates(PuzzleBankRecord *records, uint32_t count) {
+    uint32_t filled = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (records[i].solution_count > 0) {
+            records[filled++] = records[i];
+        }
+    }
+    if (filled == 0) return 0;
+    qsort(records, filled, sizeof(PuzzleBankRecord), compare_seed);
+    
+    uint32_t kept = 1;
+    for (uint32_t i = 1; i < filled; i++) {
+        if (records[i].seed != records[kept - 1].seed) {
+            records[kept++] = records[i];
+        }
+    }
+    return kept;
+}
+
+// Parse "b1,b2,...": fills bounds[0..], a shorter list repeats its last value.
+// Returns 0 on a malformed list or a bound under 1.
+static int parse_bounds(const char *list, uint32_t bounds[PUZZLE_POOL_ROUNDS]) {
+    int r = 0;
+    const char *p = list;
+    while (r < PUZZLE_POOL_ROUNDS) {
+        char *end;
+        unsigned long bound = strtoul(p, &end, 10);
+        if (end == p || bound < 1 || bound > PUZZLE_TUPLES) return 0;
+        bounds[r++] = (uint32_t)bound;
+        if (*end == '\0') break;
+        if (*end != ',') return 0;
+        p = end + 1;
+    }
+    for (; r < PUZZLE_POOL_ROUNDS; r++) {
+        bounds[r] = bounds[r - 1];
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t per_round = 100000;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = (uint64_t)time(NULL);
+    const char *path = PUZZLE_BANK_FILE;
+    int attempts = FILTER_ATTEMPTS;
+    uint32_t bounds[PUZZLE_POOL_ROUNDS];
+    for (int r = 0; r < PUZZLE_POOL_ROUNDS; r++) {
+        bounds[r] = (uint32_t)puzzle_solution_bound(r + 1);
+    }
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            per_round = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc && parse_bounds(argv[i + 1], bounds)) {
+            i++;
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            attempts = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-n puzzles_per_round] [-j threads] [-s seed] [-o puzzles.bank] "
+                    "[-b bound1,...,bound5] [-a attempts_per_record]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (per_round == 0) per_round = 1;
+    if (threads < 1) threads = 1;
+    if (attempts < 1) attempts = FILTER_ATTEMPTS;
+    
+    PuzzleBankRecord *records[PUZZLE_POOL_ROUNDS];
+    for (int r = 0; r < PUZZLE_POOL_ROUNDS; r++) {
+        records[r] = malloc((size_t)per_round * sizeof(PuzzleBankRecord));
+        if (!records[r]) {
+            perror("malloc");
+            return 1;
+        }
+    }
+    
+    printf("Generating %u puzzles per round on %d threads (seed %llu, SIMD solver %s)\n",
+           per_round, threads, (unsigned long long)seed, puzzle_solver_simd() ? "on" : "off");
+    printf("At most %u/%u/%u/%u/%u answers per round, %d candidates per record\n",
+           bounds[0], bounds[1], bounds[2], bounds[3], bounds[4], attempts);
+    double start = now_s();
+    
+    Worker *workers = calloc(threads, sizeof(Worker));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) {
+        workers[t].index = t;
+        workers[t].threads = threads;
+        workers[t].seed = seed;
+        workers[t].per_round = per_round;
+        workers[t].bounds = bounds;
+        workers[t].attempts = attempts;
+        workers[t].records = records;
+        if (pthread_create(&ids[t], NULL, worker_main, &workers[t]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    
+    long rejected = 0;
+    long filtered = 0;
+    long missing = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+        rejected += workers[t].rejected;
+        filtered += workers[t].filtered;
+        missing += workers[t].missing;
+    }
+    
+    uint32_t counts[PUZZLE_POOL_ROUNDS];
+    for (int r = 0; r < PUZZLE_POOL_ROUNDS; r++) {
+        counts[r] = drop_duplicates(records[r], per_round);
+        printf("  round %d: %u puzzles (%u left out or repeated)\n", r + 1, counts[r], per_round - counts[r]);
+    }
+    
+    int ok = puzzle_bank_write(path, records, counts, bounds);
+    double elapsed = now_s() - start;
+    printf("%s %s: %.1f s, %.0f puzzles/s, %ld candidates failed validation, %ld over their bound, "
+           "%ld records left out\n", ok ? "Wrote" : "Failed to write", path, elapsed,
+           per_round * (double)PUZZLE_POOL_ROUNDS / elapsed, rejected, filtered, missing);
+    
+    for (int r = 0; r < PUZZLE_POOL_ROUNDS; r++) {
+        free(records[r]);
+    }
+    free(workers);
+    free(ids);
+    return ok ? 0 : 1;
+}
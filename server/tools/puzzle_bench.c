@@ -0,0 +1,416 @@
+// Puzzle generation benchmark and quality suite
+//
+// Times the matrix fill per round type against the previous full-pool
+// shuffle (pools under 32 values use that shuffle in the generator too), then generates puzzles_per_round puzzles per round with
+// puzzle_generate() and reports, per round:
+//   - ns/puzzle (mean, p50, p99, max) and heap allocations per puzzle
+//   - invalid puzzles: the planted answer doesn't satisfy the equation
+//     (e.g. a zero operand clamped to 1) or a matrix has repeated or zero
+//     cells, checked against a fresh solve's exhaustive answer set (which
+//     must also match the puzzle's solution_count)
+//   - ambiguous puzzles: more than one cell tuple solves the equation
+//   - over bound: more answers than puzzle_solution_bound() allows, i.e.
+//     the repair gave up and the last redraw was kept
+//   - planted value histogram over the round's fill range, and decoy cells
+//     against a uniform draw over the range minus each matrix's planted
+//     value: chi-square (chi2/df near 1 is unbiased; it grows with n for
+//     any real bias) and skew, the largest relative gap between any value's
+//     decoy count and its expected count (values the repair keeps out of
+//     the matrices make the planted cell stand out)
+// Exits non-zero if puzzles are invalid or over bound above the allowed
+// rates, or the decoy skew exceeds its limit, so it can run headless before
+// a deploy. Skew doesn't grow with n, but small runs add a few percent of
+// sampling noise. Use -n 1000000 for a full quality run.
+//
+// Build (from server/):
+//   gcc -O2 -Wall -Wextra -std=c11 -pthread -I. -o puzzle_bench tools/puzzle_bench.c $(ls *.c | grep -v '^main.c$')
+//
+// Usage:
+//   ./puzzle_bench [-n puzzles_per_round] [-f fill_iterations] [-r round] [-x max_invalid_percent]
+//                  [-b max_over_bound_percent] [-d max_decoy_skew_percent] [-q]
+
+#include "server.h"
+
+#define HISTOGRAM_BUCKETS 10  // Buckets across the fill range (plus below and above)
+#define HISTOGRAM_WIDTH 40    // Characters of the largest bar
+#define VALUE_RANGE_MAX 128   // Widest fill range the decoy counts cover
+#define FILL_PASSES 8         // Alternating timing passes per fill variant
+#define MAX_OVER_BOUND 1.0    // Default -b: percent of puzzles allowed over their round's bound
+#define MAX_DECOY_SKEW 20.0   // Default -d: percent any decoy value may be off its expected count
+
+// Value range each round draws decoys from (see puzzle_generate)
+static const int round_low[PUZZLE_POOL_ROUNDS] = {1, 1, 1, 1, -20};
+static const int round_high[PUZZLE_POOL_ROUNDS] = {50, 80, 30, 40, 50};
+
+// Allocation counter: the bench replaces malloc/calloc/realloc and forwards
+// to glibc, counting calls only while a timed puzzle_generate() runs
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+static int counting = 0;
+static long allocations = 0;
+
+void *malloc(size_t size) {
+    if (counting) allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    if (counting) allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (counting) allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+typedef struct {
+    long puzzles;
+    long invalid;    // Planted answer fails or a matrix is malformed
+    long unsolvable; // No cell tuple solves it at all
+    long ambiguous;  // More than one cell tuple solves it
+    long over_bound; // More cell tuples than puzzle_solution_bound()
+    long long solutions;
+    long allocations;
+    long long planted_sum[PLAYERS_PER_ROOM];
+    long histogram[HISTOGRAM_BUCKETS + 2];  // [0] below the range, [HISTOGRAM_BUCKETS + 1] above
+    long decoys[VALUE_RANGE_MAX];           // Decoy cell counts, indexed by value - low
+    long planted[VALUE_RANGE_MAX];          // Matrices whose planted value is value - low
+    long planted_outside;                   // Matrices whose planted value is outside the range
+} RoundStats;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Previous algorithm: build and fully shuffle a fresh pool for every matrix
+static void legacy_fill(Puzzle *puzzle, Rng *rng, int low, int high) {
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        int solution_value = puzzle->solution_values[m];
+        int available_numbers[1000];
+        int pool_size = 0;
+        
+        for (int n = low; n <= high; n++) {
+            if (n != solution_value && n != 0) {
+                available_numbers[pool_size++] = n;
+            }
+        }
+        
+        for (int i = pool_size - 1; i > 0; i--) {
+            int j = rng_below(rng, i + 1);
+            int temp = available_numbers[i];
+            available_numbers[i] = available_numbers[j];
+            available_numbers[j] = temp;
+        }
+        
+        int pool_idx = 0;
+        for (int i = 0; i < MATRIX_SIZE; i++) {
+            for (int j = 0; j < MATRIX_SIZE; j++) {
+                puzzle->matrices[m].data[i][j] = available_numbers[pool_idx++];
+            }
+        }
+        
+        puzzle->solution_row[m] = rng_below(rng, MATRIX_SIZE);
+        puzzle->solution_col[m] = rng_below(rng, MATRIX_SIZE);
+        puzzle->matrices[m].data[puzzle->solution_row[m]][puzzle->solution_col[m]] = solution_value;
+    }
+}
+
+// Every matrix holds distinct non-zero values with the solution at its cell
+static int check_puzzle(const Puzzle *puzzle) {
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        const int *cells = &puzzle->matrices[m].data[0][0];
+        for (int a = 0; a < MATRIX_SIZE * MATRIX_SIZE; a++) {
+            if (cells[a] == 0) return 0;
+            for (int b = a + 1; b < MATRIX_SIZE * MATRIX_SIZE; b++) {
+                if (cells[a] == cells[b]) return 0;
+            }
+        }
+        if (puzzle->matrices[m].data[puzzle->solution_row[m]][puzzle->solution_col[m]] !=
+            puzzle->solution_values[m]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Planted answer holds and is in the solver's exhaustive answer set, whose
+// size is the count the generator stored
+static int check_answer(const Puzzle *puzzle) {
+    static uint64_t tuples[PUZZLE_TUPLE_WORDS];
+    if (puzzle_solve(puzzle, tuples) != puzzle->solution_count) return 0;
+    
+    int cells[PLAYERS_PER_ROOM][2];
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        cells[m][0] = puzzle->solution_row[m];
+        cells[m][1] = puzzle->solution_col[m];
+    }
+    int index = puzzle_tuple_index(cells);
+    return puzzle_check_values(puzzle, puzzle->solution_values) &&
+           ((tuples[index >> 6] >> (index & 63)) & 1);
+}
+
+static void record_puzzle(RoundStats *stats, const Puzzle *puzzle, int low, int high) {
+    int valid = check_puzzle(puzzle) && check_answer(puzzle);
+    
+    stats->puzzles++;
+    stats->solutions += puzzle->solution_count;
+    if (!valid) stats->invalid++;
+    if (puzzle->solution_count == 0) stats->unsolvable++;
+    if (puzzle->solution_count > 1) stats->ambiguous++;
+    if (puzzle->solution_count > puzzle_solution_bound(puzzle->round)) stats->over_bound++;
+    
+    int width = high - low + 1;
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        int value = puzzle->solution_values[m];
+        stats->planted_sum[m] += value;
+        if (value < low) {
+            stats->histogram[0]++;
+        } else if (value > high) {
+            stats->histogram[HISTOGRAM_BUCKETS + 1]++;
+        } else {
+            stats->histogram[1 + (value - low) * HISTOGRAM_BUCKETS / width]++;
+        }
+        if (value < low || value > high || value == 0) {
+            stats->planted_outside++;
+        } else {
+            stats->planted[value - low]++;
+        }
+        
+        for (int r = 0; r < MATRIX_SIZE; r++) {
+            for (int c = 0; c < MATRIX_SIZE; c++) {
+                int cell = puzzle->matrices[m].data[r][c];
+                if ((r == puzzle->solution_row[m] && c == puzzle->solution_col[m]) || cell < low || cell > high) {
+                    continue;
+                }
+                stats->decoys[cell - low]++;
+            }
+        }
+    }
+}
+
+// Decoy counts against uniform: returns chi-square per degree of freedom and
+// sets skew to the largest |observed / expected - 1| in percent. A matrix's
+// 15 decoys are uniform over the range's non-zero values minus its planted
+// value, so each value expects 15 / (values - 1) per matrix that didn't
+// plant it (15 / values per matrix whose planted value is outside the range).
+static double decoy_bias(const RoundStats *stats, int low, int high, double *skew) {
+    const double decoys = MATRIX_SIZE * MATRIX_SIZE - 1;
+    long inside = 0;
+    int values = 0;
+    for (int v = low; v <= high; v++) {
+        if (v == 0) continue;
+        inside += stats->planted[v - low];
+        values++;
+    }
+    *skew = 0.0;
+    if (inside + stats->planted_outside == 0 || values < 2) return 0.0;
+    
+    double chi2 = 0.0;
+    for (int v = low; v <= high; v++) {
+        if (v == 0) continue;
+        double expected = (inside - stats->planted[v - low]) * decoys / (values - 1) +
+                          stats->planted_outside * decoys / values;
+        double diff = stats->decoys[v - low] - expected;
+        chi2 += diff * diff / expected;
+        double gap = (diff < 0 ? -diff : diff) * 100.0 / expected;
+        if (gap > *skew) *skew = gap;
+    }
+    return chi2 / (values - 1);
+}
+
+static void print_histogram(const RoundStats *stats, int low, int high) {
+    long largest = 1;
+    long total = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS + 2; b++) {
+        if (stats->histogram[b] > largest) largest = stats->histogram[b];
+        total += stats->histogram[b];
+    }
+    if (total == 0) return;
+    
+    int width = high - low + 1;
+    for (int b = 0; b < HISTOGRAM_BUCKETS + 2; b++) {
+        char label[32];
+        if (b == 0) {
+            snprintf(label, sizeof(label), "< %d", low);
+        } else if (b == HISTOGRAM_BUCKETS + 1) {
+            snprintf(label, sizeof(label), "> %d", high);
+        } else {
+            int first = low + ((b - 1) * width + HISTOGRAM_BUCKETS - 1) / HISTOGRAM_BUCKETS;
+            int last = low + (b * width + HISTOGRAM_BUCKETS - 1) / HISTOGRAM_BUCKETS - 1;
+            snprintf(label, sizeof(label), "%d..%d", first, last);
+        }
+        
+        char bar[HISTOGRAM_WIDTH + 1];
+        int length = (int)(stats->histogram[b] * HISTOGRAM_WIDTH / largest);
+        memset(bar, '#', length);
+        bar[length] = '\0';
+        printf("    %-10s %6.2f%% %s\n", label, 100.0 * stats->histogram[b] / total, bar);
+    }
+}
+
+// Fill timing against the legacy shuffle, returns the number of malformed fills.
+// The two alternate over FILL_PASSES passes and each keeps its fastest pass,
+// so a noisy neighbour slows both or neither.
+static int bench_fill(int round, int iterations, Rng *rng, Puzzle *puzzle, long long *checksum) {
+    int low = round_low[round - 1];
+    int high = round_high[round - 1];
+    for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+        puzzle->solution_values[m] = low + m + 1;
+    }
+    
+    int per_pass = iterations / FILL_PASSES > 0 ? iterations / FILL_PASSES : 1;
+    double legacy_ns = 0.0;
+    double fill_ns = 0.0;
+    for (int pass = 0; pass < FILL_PASSES; pass++) {
+        double start = now_ns();
+        for (int i = 0; i < per_pass; i++) {
+            legacy_fill(puzzle, rng, low, high);
+            *checksum += puzzle->matrices[i & 3].data[0][0];
+        }
+        double ns = (now_ns() - start) / per_pass;
+        if (pass == 0 || ns < legacy_ns) legacy_ns = ns;
+        
+        start = now_ns();
+        for (int i = 0; i < per_pass; i++) {
+            puzzle_fill_matrices(puzzle, rng, low, high);
+            *checksum += puzzle->matrices[i & 3].data[0][0];
+        }
+        ns = (now_ns() - start) / per_pass;
+        if (pass == 0 || ns < fill_ns) fill_ns = ns;
+    }
+    
+    int pool = high - low + 1 - (low <= 0 && high >= 0);
+    printf("%-6d %6d %12.1f %12.1f %7.1fx\n", round, pool, legacy_ns, fill_ns, legacy_ns / fill_ns);
+    return check_puzzle(puzzle) ? 0 : 1;
+}
+
+// Generate count puzzles for round (seeds 0..count - 1), time each one and record its quality
+static void bench_generate(int round, long count, double *latency, RoundStats *stats, Puzzle *puzzle,
+                           long long *checksum) {
+    int low = round_low[round - 1];
+    int high = round_high[round - 1];
+    
+    memset(stats, 0, sizeof(RoundStats));
+    for (long i = 0; i < count; i++) {
+        long before = allocations;
+        counting = 1;
+        double start = now_ns();
+        puzzle_generate(puzzle, round, (unsigned int)i);
+        latency[i] = now_ns() - start;
+        counting = 0;
+        stats->allocations += allocations - before;
+        
+        *checksum += puzzle->result;
+        record_puzzle(stats, puzzle, low, high);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long per_round = 100000;
+    int fill_iterations = 200000;
+    int only_round = 0;
+    double max_invalid = 0.0;
+    double max_over_bound = MAX_OVER_BOUND;
+    double max_skew = MAX_DECOY_SKEW;
+    int quiet = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            per_round = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            fill_iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            only_round = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            max_invalid = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            max_over_bound = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            max_skew = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quiet = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [-n puzzles_per_round] [-f fill_iterations] [-r round] "
+                    "[-x max_invalid_percent] [-b max_over_bound_percent] [-d max_decoy_skew_percent] [-q]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (per_round <= 0) per_round = 100000;
+    if (fill_iterations <= 0) fill_iterations = 200000;
+    if (only_round < 0 || only_round > PUZZLE_POOL_ROUNDS) only_round = 0;
+    
+    double *latency = malloc((size_t)per_round * sizeof(double));
+    RoundStats *stats = malloc(sizeof(RoundStats));
+    if (!latency || !stats) {
+        perror("malloc");
+        return 2;
+    }
+    
+    Rng rng;
+    rng_seed(&rng, 12345, 0);
+    Puzzle puzzle;
+    memset(&puzzle, 0, sizeof(puzzle));
+    long long checksum = 0;  // Keeps the optimizer from dropping the work
+    int failures = 0;
+    
+    printf("Generator version %d, SIMD solver %s, %ld puzzles per round\n\n",
+           PUZZLE_GENERATOR_VERSION, puzzle_solver_simd() ? "on" : "off", per_round);
+    
+    printf("%-6s %6s %12s %12s %8s\n", "round", "pool", "legacy ns", "fill ns", "speedup");
+    for (int round = 1; round <= PUZZLE_POOL_ROUNDS; round++) {
+        if (only_round && round != only_round) continue;
+        failures += bench_fill(round, fill_iterations, &rng, &puzzle, &checksum);
+    }
+    
+    printf("\n%-6s %10s %10s %10s %10s %7s %8s %8s %9s %6s %8s %8s %8s %7s\n", "round", "mean ns", "p50 ns", "p99 ns",
+           "max ns", "allocs", "invalid", "no-sol", "ambiguous", "bound", "over", "avg sol", "chi2/df", "skew");
+    for (int round = 1; round <= PUZZLE_POOL_ROUNDS; round++) {
+        if (only_round && round != only_round) continue;
+        int low = round_low[round - 1];
+        int high = round_high[round - 1];
+        
+        bench_generate(round, per_round, latency, stats, &puzzle, &checksum);
+        
+        double total = 0.0;
+        for (long i = 0; i < per_round; i++) total += latency[i];
+        qsort(latency, per_round, sizeof(double), compare_double);
+        double invalid_percent = 100.0 * stats->invalid / stats->puzzles;
+        double over_percent = 100.0 * stats->over_bound / stats->puzzles;
+        double skew;
+        double chi2 = decoy_bias(stats, low, high, &skew);
+        
+        printf("%-6d %10.0f %10.0f %10.0f %10.0f %7.2f %7.3f%% %7.3f%% %8.2f%% %6d %7.3f%% %8.1f %8.2f %6.1f%%\n", round,
+               total / per_round, latency[per_round / 2], latency[(long)(per_round * 0.99)], latency[per_round - 1],
+               (double)stats->allocations / stats->puzzles, invalid_percent,
+               100.0 * stats->unsolvable / stats->puzzles, 100.0 * stats->ambiguous / stats->puzzles,
+               puzzle_solution_bound(round), over_percent, (double)stats->solutions / stats->puzzles, chi2, skew);
+        
+        if (!quiet) {
+            printf("  planted values (mean");
+            for (int m = 0; m < PLAYERS_PER_ROOM; m++) {
+                printf(" P%d %.1f", m + 1, (double)stats->planted_sum[m] / stats->puzzles);
+            }
+            printf("), fill range %d..%d:\n", low, high);
+            print_histogram(stats, low, high);
+        }
+        
+        if (invalid_percent > max_invalid) failures++;
+        if (over_percent > max_over_bound) failures++;
+        if (skew > max_skew) failures++;
+    }
+    
+    printf("\nchecksum %lld, %d checks failed\n", checksum, failures);
+    free(latency);
+    free(stats);
+    return failures > 0;
+}
@@ -0,0 +1,562 @@
+// Traffic replay: plays a captured trace against a running server and
+// compares its output and latency
+//
+// Capture a session with the server started as
+//   PUZZLE_SEED=42 CAPTURE_FILE=session.trace ./game_server
+// then start the build under test with the same PUZZLE_SEED, from the same
+// account and stats files the capture started from, and replay:
+//   ./replay -x 0 -o new.txt -b old.txt session.trace
+// Passwords are not captured: every REGISTER and LOGIN is sent with
+// REPLAY_PASSWORD, so accounts must have been registered during the
+// capture (or by an earlier replay) to log in.
+//
+// Every connection in the trace gets its own socket and the inbound lines
+// are sent in trace order. -x sets the pace: 1 (default) keeps the captured
+// timing, N runs N times faster, 0 sends as soon as causality allows. A
+// line is only sent once its connection has received every reply it had
+// received at that point of the capture, and once every earlier request in
+// the trace has had its first reply, so rooms fill and rounds start in the
+// captured order at any speed. A gate that isn't met within -g ms is
+// counted and skipped.
+//
+// Output: each connection's lines are compared, in order, with what the
+// server sent it in the capture. PING, TIMER and ROOM_STATUS depend on wall
+// time and are skipped. Without PUZZLE_SEED in the capture the puzzle lines
+// differ by design and are not compared either.
+//
+// Latency: the time from sending a request to the first line of its reply,
+// per command (CONNECT is connect() to WELCOME), in the same log-linear
+// buckets the server uses. -o writes the figures, -b reads a previous -o
+// file and prints the change, so two builds are measured on the same
+// workload. Exits non-zero on any output difference.
+//
+// Build (from server/):
+//   gcc -O2 -Wall -Wextra -std=c11 -pthread -I. -o replay tools/replay.c $(ls *.c | grep -v '^main.c$')
+//
+// Usage:
+//   ./replay [-H host] [-p port] [-x speed] [-g gate_ms] [-d max_diffs] [-o results] [-b baseline] trace
+
+#include "server.h"
+#include <netdb.h>
+#include <poll.h>
+
+#define REPLAY_SERIES (METRIC_COMMAND_COUNT + 1)  // Protocol commands, then CONNECT
+#define REPLAY_CONNECT METRIC_COMMAND_COUNT
+#define REPLAY_PASSWORD "replay"  // Sent in place of the redacted REGISTER/LOGIN passwords
+
+// One line the server sent a connection in the capture
+typedef struct {
+    const char *data;
+    int length;
+    int event;  // Event this line is the first reply to, -1 if none
+} ExpectedLine;
+
+typedef struct {
+    int fd;
+    ExpectedLine *expected;
+    int expected_count;
+    int expected_capacity;
+    int received;  // Compared lines received so far
+    int stalled;   // A gate on this connection timed out, don't wait on it again
+    int awaiting;  // Preprocessing: event still waiting for its first reply
+    char buffer[BUFFER_SIZE * 2];
+    int buffer_len;
+} ReplayConn;
+
+// OPEN, IN or CLOSE record of the trace
+typedef struct {
+    uint8_t kind;
+    uint32_t conn;
+    long long time_ns;
+    const char *data;
+    int length;
+    int lines_before;  // Lines the connection had been sent at this point of the capture
+    int has_reply;     // The capture has a line answering it (see conn_reply_event)
+    int answered;
+    int series;
+    long long sent_ns;
+} ReplayEvent;
+
+typedef struct {
+    unsigned long long buckets[METRIC_LATENCY_BUCKETS];
+    unsigned long long count;
+    unsigned long long max;
+} ReplaySeries;
+
+static ReplayConn *conns;
+static uint32_t conn_count;  // Highest connection number + 1
+static ReplayEvent *events;
+static int event_count;
+static int gate_index = 0;  // Lowest event whose reply is still owed
+static ReplaySeries series[REPLAY_SERIES];
+static int compare_puzzles = 1;
+static int max_diffs = 10;
+static long compared = 0, mismatched = 0, unexpected = 0, gate_timeouts = 0;
+
+// Lines that depend on wall time rather than on the inbound traffic
+static int line_is_volatile(const char *line, int length) {
+    static const char *verbs[] = {"PING", "TIMER", "ROOM_STATUS", "SERVER_SHUTDOWN"};
+    for (size_t i = 0; i < sizeof(verbs) / sizeof(verbs[0]); i++) {
+        int n = (int)strlen(verbs[i]);
+        if (length >= n && memcmp(line, verbs[i], n) == 0 && (length == n || line[n] == '|')) return 1;
+    }
+    return 0;
+}
+
+// Lines that carry the puzzle (only reproducible with a fixed seed)
+static int line_is_puzzle(const char *line, int length) {
+    return (length >= 10 && memcmp(line, "GAME_START", 10) == 0) ||
+           (length >= 13 && memcmp(line, "GAME_END|LOSE", 13) == 0) ||
+           (length >= 12 && memcmp(line, "DEBUG_ANSWER", 12) == 0);
+}
+
+// Event a line sent to conn answers: the event loop is single-threaded, so a reply is
+// sent before the next inbound event is handled, except for account commands, which
+// complete on the account thread and answer with the connection's next line
+static int conn_reply_event(const ReplayConn *conn) {
+    if (conn->awaiting < 0) return -1;
+    
+    int series = events[conn->awaiting].series;
+    if (conn->awaiting == event_count - 1 || series == METRIC_COMMAND_REGISTER ||
+        series == METRIC_COMMAND_LOGIN || series == METRIC_COMMAND_CHECK_NAME) {
+        return conn->awaiting;
+    }
+    return -1;
+}
+
+static void conn_expect(ReplayConn *conn, const char *data, int length) {
+    if (conn->expected_count == conn->expected_capacity) {
+        conn->expected_capacity = conn->expected_capacity ? conn->expected_capacity * 2 : 64;
+        conn->expected = realloc(conn->expected, conn->expected_capacity * sizeof(ExpectedLine));
+        if (!conn->expected) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    
+    ExpectedLine *line = &conn->expected[conn->expected_count++];
+    line->data = data;
+    line->length = length;
+    line->event = conn_reply_event(conn);
+    conn->awaiting = -1;
+}
+
+// Split the trace into events and per-connection expected output
+static int replay_load(const CaptureView *view) {
+    const CaptureRecord *record;
+    size_t offset = 0;
+    int capacity = 0;
+    
+    while ((record = capture_next(view, &offset)) != NULL) {
+        if (record->conn >= conn_count) conn_count = record->conn + 1;
+    }
+    conns = calloc(conn_count ? conn_count : 1, sizeof(ReplayConn));
+    if (!conns) return 0;
+    for (uint32_t i = 0; i < conn_count; i++) {
+        conns[i].fd = -1;
+        conns[i].awaiting = -1;
+    }
+    
+    offset = 0;
+    while ((record = capture_next(view, &offset)) != NULL) {
+        ReplayConn *conn = &conns[record->conn];
+        const char *payload = (const char *)(record + 1);
+        
+        if (record->kind == CAPTURE_OUT) {
+            // One message can hold several lines
+            const char *end = payload + record->length;
+            for (const char *line = payload; line < end;) {
+                const char *newline = memchr(line, '\n', end - line);
+                int length = (int)((newline ? newline : end) - line);
+                if (length > 0 && !line_is_volatile(line, length)) {
+                    conn_expect(conn, line, length);
+                }
+                line += length + 1;
+            }
+            continue;
+        }
+        
+        if (event_count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            events = realloc(events, capacity * sizeof(ReplayEvent));
+            if (!events) return 0;
+        }
+        ReplayEvent *event = &events[event_count];
+        memset(event, 0, sizeof(ReplayEvent));
+        event->kind = record->kind;
+        event->conn = record->conn;
+        event->time_ns = record->time_ns;
+        event->data = payload;
+        event->length = record->length;
+        event->lines_before = conn->expected_count;
+        event->series = REPLAY_CONNECT;
+        
+        if (record->kind == CAPTURE_IN) {
+            char verb[64] = {0};
+            int n = 0;
+            while (n < event->length && n < (int)sizeof(verb) - 1 && payload[n] != '|') {
+                verb[n] = payload[n];
+                n++;
+            }
+            event->series = metrics_command(verb);
+        }
+        
+        // Wait for the request's first reply (PONG gets none)
+        int replied = record->kind != CAPTURE_CLOSE && event->series != METRIC_COMMAND_PONG;
+        conn->awaiting = replied ? event_count : -1;
+        event_count++;
+    }
+    
+    // Events whose connection got a reply line are the ones the gate waits on
+    for (uint32_t c = 0; c < conn_count; c++) {
+        for (int i = 0; i < conns[c].expected_count; i++) {
+            if (conns[c].expected[i].event >= 0) events[conns[c].expected[i].event].has_reply = 1;
+        }
+    }
+    return 1;
+}
+
+static void series_record(int index, long long ns) {
+    ReplaySeries *s = &series[index];
+    unsigned long long value = ns > 0 ? (unsigned long long)ns : 0;
+    
+    s->buckets[metrics_latency_bucket(value)]++;
+    s->count++;
+    if (value > s->max) s->max = value;
+}
+
+// Upper bound of the bucket holding the q-th quantile, never above max
+static unsigned long long series_quantile(const ReplaySeries *s, double q) {
+    if (s->count == 0) return 0;
+    
+    unsigned long long rank = (unsigned long long)(q * s->count + 0.999999);
+    unsigned long long seen = 0;
+    if (rank < 1) rank = 1;
+    for (int b = 0; b < METRIC_LATENCY_BUCKETS; b++) {
+        seen += s->buckets[b];
+        if (seen >= rank) {
+            unsigned long long bound = metrics_latency_bound(b);
+            return bound < s->max ? bound : s->max;
+        }
+    }
+    return s->max;
+}
+
+static const char *series_name(int index) {
+    return index == REPLAY_CONNECT ? "CONNECT" : metrics_command_name((MetricCommand)index);
+}
+
+// Compare one received line with the capture and settle the request it answers
+static void replay_line(uint32_t id, const char *line, int length) {
+    ReplayConn *conn = &conns[id];
+    
+    if (line_is_volatile(line, length)) return;
+    if (conn->received >= conn->expected_count) {
+        unexpected++;
+        if (unexpected + mismatched <= max_diffs) {
+            printf("  conn %u: unexpected \"%.*s\"\n", id, length, line);
+        }
+        return;
+    }
+    
+    const ExpectedLine *expected = &conn->expected[conn->received++];
+    if (expected->event >= 0) {
+        ReplayEvent *event = &events[expected->event];
+        if (!event->answered && event->sent_ns > 0) {
+            series_record(event->series, time_now_ns() - event->sent_ns);
+        }
+        event->answered = 1;
+    }
+    
+    if (!compare_puzzles && line_is_puzzle(expected->data, expected->length)) return;
+    compared++;
+    if (length != expected->length || memcmp(line, expected->data, length) != 0) {
+        mismatched++;
+        if (unexpected + mismatched <= max_diffs) {
+            printf("  conn %u line %d:\n    expected \"%.*s\"\n    got      \"%.*s\"\n", id, conn->received,
+                   expected->length, expected->data, length, line);
+        }
+    }
+}
+
+// Read whatever arrived on every open connection, waiting up to timeout_ms
+static void replay_pump(int timeout_ms) {
+    static struct pollfd *fds;
+    static uint32_t *owners;
+    if (!fds) {
+        fds = calloc(conn_count ? conn_count : 1, sizeof(struct pollfd));
+        owners = calloc(conn_count ? conn_count : 1, sizeof(uint32_t));
+        if (!fds || !owners) {
+            perror("calloc");
+            exit(1);
+        }
+    }
+    
+    int count = 0;
+    for (uint32_t i = 0; i < conn_count; i++) {
+        if (conns[i].fd < 0) continue;
+        fds[count].fd = conns[i].fd;
+        fds[count].events = POLLIN;
+        fds[count].revents = 0;
+        owners[count++] = i;
+    }
+    if (poll(fds, count, timeout_ms) <= 0) return;
+    
+    for (int i = 0; i < count; i++) {
+        if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        ReplayConn *conn = &conns[owners[i]];
+        ssize_t n = recv(conn->fd, conn->buffer + conn->buffer_len, sizeof(conn->buffer) - 1 - conn->buffer_len, 0);
+        if (n <= 0) {
+            close(conn->fd);
+            conn->fd = -1;
+            continue;
+        }
+        conn->buffer_len += (int)n;
+        
+        char *start = conn->buffer;
+        char *end;
+        while ((end = memchr(start, '\n', conn->buffer + conn->buffer_len - start)) != NULL) {
+            if (end > start) replay_line(owners[i], start, (int)(end - start));
+            start = end + 1;
+        }
+        int remaining = conn->buffer_len - (int)(start - conn->buffer);
+        if (remaining >= (int)sizeof(conn->buffer) - 1) remaining = 0;  // Longer than any server line
+        memmove(conn->buffer, start, remaining);
+        conn->buffer_len = remaining;
+    }
+}
+
+// Gate for event: its connection caught up with the capture and every earlier request has its reply
+static int replay_gate_open(int index) {
+    const ReplayEvent *event = &events[index];
+    const ReplayConn *conn = &conns[event->conn];
+    
+    while (gate_index < index && (!events[gate_index].has_reply || events[gate_index].answered)) {
+        gate_index++;
+    }
+    if (gate_index < index) return 0;
+    return conn->stalled || conn->fd < 0 || conn->received >= event->lines_before;
+}
+
+static void replay_run(const struct sockaddr_in *addr, double speed, int gate_ms) {
+    long long start_ns = time_now_ns();
+    
+    for (int i = 0; i < event_count; i++) {
+        ReplayEvent *event = &events[i];
+        ReplayConn *conn = &conns[event->conn];
+        
+        // Captured timing, scaled
+        if (speed > 0) {
+            long long due_ns = start_ns + (long long)(event->time_ns / speed);
+            long long now;
+            while ((now = time_now_ns()) < due_ns) {
+                long long wait_ms = (due_ns - now) / 1000000;
+                replay_pump(wait_ms > 0 ? (int)(wait_ms < 50 ? wait_ms : 50) : 0);
+            }
+        }
+        
+        // Causality
+        long long gate_start = time_now_ns();
+        while (!replay_gate_open(i)) {
+            if (time_now_ns() - gate_start > gate_ms * 1000000LL) {
+                gate_timeouts++;
+                for (int j = gate_index; j < i; j++) events[j].answered = 1;
+                conn->stalled = 1;
+                break;
+            }
+            replay_pump(5);
+        }
+        
+        if (event->kind == CAPTURE_OPEN) {
+            conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+            event->sent_ns = time_now_ns();
+            if (conn->fd < 0 || connect(conn->fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+                perror("connect");
+                if (conn->fd >= 0) close(conn->fd);
+                conn->fd = -1;
+            }
+        } else if (event->kind == CAPTURE_IN && conn->fd >= 0) {
+            char line[BUFFER_SIZE + sizeof(REPLAY_PASSWORD) + 1];
+            int length = event->length < BUFFER_SIZE ? event->length : BUFFER_SIZE;
+            memcpy(line, event->data, length);
+            size_t prefix = capture_credential_prefix(line, length);
+            if (prefix > 0) {
+                memcpy(line + prefix, REPLAY_PASSWORD, sizeof(REPLAY_PASSWORD) - 1);
+                length = (int)(prefix + sizeof(REPLAY_PASSWORD) - 1);
+            }
+            line[length] = '\n';
+            event->sent_ns = time_now_ns();
+            if (send(conn->fd, line, length + 1, MSG_NOSIGNAL) != length + 1) {
+                perror("send");
+            }
+        } else if (event->kind == CAPTURE_CLOSE && conn->fd >= 0) {
+            close(conn->fd);
+            conn->fd = -1;
+        }
+        replay_pump(0);
+    }
+    
+    // Let the last replies arrive
+    long long drain_start = time_now_ns();
+    while (time_now_ns() - drain_start < gate_ms * 1000000LL) {
+        int waiting = 0;
+        for (uint32_t i = 0; i < conn_count; i++) {
+            if (conns[i].fd >= 0 && conns[i].received < conns[i].expected_count) waiting = 1;
+        }
+        if (!waiting) break;
+        replay_pump(10);
+    }
+}
+
+// Results file: one "name count p50_ns p99_ns max_ns" line per command
+static void replay_write_results(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror("fopen");
+        return;
+    }
+    for (int s = 0; s < REPLAY_SERIES; s++) {
+        if (series[s].count == 0) continue;
+        fprintf(file, "%s %llu %llu %llu %llu\n", series_name(s), series[s].count,
+                series_quantile(&series[s], 0.5), series_quantile(&series[s], 0.99), series[s].max);
+    }
+    fclose(file);
+}
+
+// Baseline p50/p99 of one command from a results file (0 if absent)
+static int replay_baseline(FILE *file, const char *name, double *p50, double *p99) {
+    char line[256], found[64];
+    unsigned long long count, b50, b99, max;
+    
+    rewind(file);
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%63s %llu %llu %llu %llu", found, &count, &b50, &b99, &max) == 5 &&
+            strcmp(found, name) == 0) {
+            *p50 = (double)b50;
+            *p99 = (double)b99;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = "127.0.0.1";
+    const char *results_path = NULL;
+    const char *baseline_path = NULL;
+    const char *trace_path = NULL;
+    int port = PORT;
+    double speed = 1;
+    int gate_ms = 2000;
+    
+    int bad_usage = 0;
+    
+    for (int i = 1; i < argc && !bad_usage; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (argv[i][0] != '-') {
+            trace_path = argv[i];
+            continue;
+        }
+        if (!value || strlen(argv[i]) != 2) {
+            bad_usage = 1;
+            break;
+        }
+        switch (argv[i][1]) {
+            case 'H': host = value; break;
+            case 'p': port = atoi(value); break;
+            case 'x': speed = atof(value); break;
+            case 'g': gate_ms = atoi(value); break;
+            case 'd': max_diffs = atoi(value); break;
+            case 'o': results_path = value; break;
+            case 'b': baseline_path = value; break;
+            default: bad_usage = 1; break;
+        }
+        i++;
+    }
+    if (bad_usage || !trace_path) {
+        fprintf(stderr, "Usage: %s [-H host] [-p port] [-x speed] [-g gate_ms] [-d max_diffs] [-o results] [-b baseline] trace\n",
+                argv[0]);
+        return 2;
+    }
+    
+    CaptureView view;
+    if (!capture_map(trace_path, &view)) {
+        return 1;
+    }
+    if (!replay_load(&view)) {
+        fprintf(stderr, "Out of memory loading %s\n", trace_path);
+        return 1;
+    }
+    
+    struct addrinfo hints, *resolved;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &resolved) != 0) {
+        fprintf(stderr, "Cannot resolve %s\n", host);
+        return 2;
+    }
+    struct sockaddr_in addr;
+    memcpy(&addr, resolved->ai_addr, sizeof(addr));
+    addr.sin_port = htons((uint16_t)port);
+    freeaddrinfo(resolved);
+    
+    int connections = 0, messages = 0;
+    for (int i = 0; i < event_count; i++) {
+        connections += events[i].kind == CAPTURE_OPEN;
+        messages += events[i].kind == CAPTURE_IN;
+    }
+    double captured_s = event_count > 0 ? events[event_count - 1].time_ns / 1e9 : 0;
+    printf("Trace %s: %d connections, %d messages over %.1f s", trace_path, connections, messages, captured_s);
+    if (view.fixed_seed) {
+        printf(" (PUZZLE_SEED=%llu)\n", (unsigned long long)view.puzzle_seed);
+    } else {
+        printf(" (no fixed seed, puzzle lines not compared)\n");
+        compare_puzzles = 0;
+    }
+    if (view.generator_version != PUZZLE_GENERATOR_VERSION) {
+        printf("Warning: captured with puzzle generator v%u, this build is v%d, puzzles will differ\n",
+               view.generator_version, PUZZLE_GENERATOR_VERSION);
+    }
+    
+    long long start_ns = time_now_ns();
+    replay_run(&addr, speed, gate_ms);
+    double elapsed = (time_now_ns() - start_ns) / 1e9;
+    
+    long missing = 0;
+    for (uint32_t i = 0; i < conn_count; i++) {
+        if (conns[i].received < conns[i].expected_count) missing += conns[i].expected_count - conns[i].received;
+        if (conns[i].fd >= 0) close(conns[i].fd);
+    }
+    
+    if (speed > 0) printf("Replayed at %gx in %.1f s\n", speed, elapsed);
+    else printf("Replayed at max speed in %.1f s\n", elapsed);
+    printf("Output: %ld lines compared, %ld mismatched, %ld missing, %ld unexpected (PING/TIMER/ROOM_STATUS skipped)\n",
+           compared, mismatched, missing, unexpected);
+    printf("Gate timeouts: %ld\n", gate_timeouts);
+    
+    FILE *baseline = baseline_path ? fopen(baseline_path, "r") : NULL;
+    if (baseline_path && !baseline) perror(baseline_path);
+    
+    printf("\nLatency (microseconds):\n");
+    printf("  %-18s %8s %9s %9s %9s", "command", "count", "p50", "p99", "max");
+    printf(baseline ? " %12s %12s\n" : "\n", "p50 vs base", "p99 vs base");
+    for (int s = 0; s < REPLAY_SERIES; s++) {
+        if (series[s].count == 0) continue;
+        double p50 = (double)series_quantile(&series[s], 0.5);
+        double p99 = (double)series_quantile(&series[s], 0.99);
+        printf("  %-18s %8llu %9.1f %9.1f %9.1f", series_name(s), series[s].count, p50 / 1e3, p99 / 1e3,
+               series[s].max / 1e3);
+        
+        double base50, base99;
+        if (baseline && replay_baseline(baseline, series_name(s), &base50, &base99) && base50 > 0 && base99 > 0) {
+            printf(" %+11.1f%% %+11.1f%%", 100.0 * (p50 - base50) / base50, 100.0 * (p99 - base99) / base99);
+        }
+        printf("\n");
+    }
+    if (baseline) fclose(baseline);
+    if (results_path) replay_write_results(results_path);
+    
+    capture_unmap(&view);
+    return (mismatched + missing + unexpected) > 0;
+}
@@ -0,0 +1,439 @@
+// Soak test: hours of randomized churn, watched through the admin socket
+//
+// Runs tools/loadgen against a live server in back-to-back waves with
+// random bot counts, think times, chat and reconnect rates and lengths.
+// Some waves are killed with SIGKILL partway through, so every socket
+// drops at once. Waves draw bot names from a few shared prefixes, which
+// means new bots often log in as names the last wave left disconnected.
+// That exercises the reconnect handoff in handle_login().
+//
+// Every -i seconds the harness asks the admin socket for "status" (RSS,
+// open fds, slot and room counts) and "check" (room/client invariants: a
+// drifting room->player_count, slots pointing at the wrong client, or two
+// active slots for one user). Every -q waves it lets the server go idle
+// past RECONNECT_TIMEOUT. By then every client slot and room must be free,
+// and RSS and fds are compared with the first idle point. Any violation,
+// growth beyond -m KB / -f fds, a server restart or an unreachable admin
+// socket stops the run with SOAK FAILED and exit status 1. Samples go to
+// stdout and, with -o, to a CSV file.
+//
+// Start the server from its own directory (the admin socket is created
+// there), with DEBUG_HOOKS=1 when passing -a so bots can finish rounds.
+//
+// Build (from server/, after building tools/loadgen.c):
+//   gcc -O2 -Wall -Wextra -std=c11 -pthread -I. -o soak tools/soak.c $(ls *.c | grep -v '^main.c$')
+//
+// Usage:
+//   ./soak [-A admin_socket] [-L loadgen] [-H host] [-p port] [-T seconds] [-i sample_seconds]
+//          [-q quiet_every_waves] [-m rss_growth_kb] [-f fd_growth] [-s seed] [-o samples.csv]
+//          [-l wave_log] [-a]
+
+#include "server.h"
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define SOAK_ADMIN_TIMEOUT_S 5
+#define SOAK_REPLY_MAX 65536
+#define SOAK_PREFIXES 3                             // Name pools shared across waves
+#define SOAK_QUIET_SECONDS (RECONNECT_TIMEOUT + 10)  // Idle time after which every slot must be free
+#define SOAK_TICK_MS 200
+
+typedef struct {
+    long long uptime_s;
+    int clients;
+    int disconnected;
+    int rooms;
+    int games;
+    long rss_kb;
+    int fds;
+} SoakStatus;
+
+typedef enum {
+    SOAK_WAVE,   // A loadgen child is running
+    SOAK_GAP,    // Short pause before the next wave (disconnected sessions still linger)
+    SOAK_QUIET   // No load until every reconnect window has expired
+} SoakPhase;
+
+static struct {
+    const char *admin_path;
+    const char *loadgen;
+    const char *host;
+    int port;
+    int duration;
+    int sample_every;
+    int quiet_every;
+    long rss_growth_kb;
+    int fd_growth;
+    uint64_t seed;
+    const char *wave_log;
+    int use_debug_answer;
+} config;
+
+static volatile sig_atomic_t stop_requested = 0;
+static int admin_fd = -1;
+static FILE *csv = NULL;
+static pid_t wave_pid = -1;
+static long long start_ms = 0;
+static char reply[SOAK_REPLY_MAX];
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-A admin_socket] [-L loadgen] [-H host] [-p port] [-T seconds] [-i sample_seconds]\n"
+                    "          [-q quiet_every_waves] [-m rss_growth_kb] [-f fd_growth] [-s seed] [-o samples.csv]\n"
+                    "          [-l wave_log] [-a]\n", program);
+}
+
+static double elapsed_s(void) {
+    return (time_now_ms() - start_ms) / 1000.0;
+}
+
+// Stop the run: kill the wave, print why, exit 1
+static void soak_fail(const char *format, ...) __attribute__((format(printf, 1, 2), noreturn));
+static void soak_fail(const char *format, ...) {
+    if (wave_pid > 0) {
+        kill(wave_pid, SIGKILL);
+        waitpid(wave_pid, NULL, 0);
+    }
+    
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "\nSOAK FAILED after %.0f s: ", elapsed_s());
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    
+    if (csv) fclose(csv);
+    exit(1);
+}
+
+static int admin_connect(void) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", config.admin_path);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    
+    struct timeval timeout = {SOAK_ADMIN_TIMEOUT_S, 0};  // A hung event loop is a failure too
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Run one admin command; reply holds the lines before the final OK (fails the run if unreachable)
+static void admin_query(const char *command) {
+    if (admin_fd < 0 && (admin_fd = admin_connect()) < 0) {
+        soak_fail("admin socket %s unreachable (%s), server down?", config.admin_path, strerror(errno));
+    }
+    
+    char line[64];
+    int length = snprintf(line, sizeof(line), "%s\n", command);
+    if (send(admin_fd, line, length, MSG_NOSIGNAL) != length) {
+        soak_fail("admin socket closed while sending %s", command);
+    }
+    
+    size_t used = 0;
+    while (1) {
+        ssize_t got = recv(admin_fd, reply + used, sizeof(reply) - 1 - used, 0);
+        if (got <= 0) {
+            soak_fail("no reply to %s within %d s (%s)", command, SOAK_ADMIN_TIMEOUT_S, got == 0 ? "closed" : strerror(errno));
+        }
+        used += (size_t)got;
+        reply[used] = '\0';
+        
+        // A reply ends with an OK or ERROR line
+        char *last = used >= 2 ? reply + used - 2 : reply;
+        while (last > reply && last[-1] != '\n') last--;
+        if (reply[used - 1] == '\n' && (strncmp(last, "OK", 2) == 0 || strncmp(last, "ERROR", 5) == 0)) {
+            if (last[0] == 'E') soak_fail("admin %s: %s", command, last);
+            *last = '\0';
+            return;
+        }
+        if (used == sizeof(reply) - 1) soak_fail("admin reply to %s too long", command);
+    }
+}
+
+static long long status_field(const char *text, const char *key) {
+    const char *found = strstr(text, key);
+    return found ? atoll(found + strlen(key)) : -1;
+}
+
+static void soak_status(SoakStatus *status) {
+    admin_query("status");
+    status->uptime_s = status_field(reply, "uptime_s=");
+    status->clients = (int)status_field(reply, " clients=");
+    status->disconnected = (int)status_field(reply, "disconnected=");
+    status->rooms = (int)status_field(reply, " rooms=");
+    status->games = (int)status_field(reply, "games=");
+    status->rss_kb = (long)status_field(reply, "rss_kb=");
+    status->fds = (int)status_field(reply, "fds=");
+}
+
+// Start a loadgen child with random churn settings
+static pid_t start_wave(Rng *rng, int wave, int *duration, long long *kill_at_ms) {
+    char bots[16], threads[16], seconds[16], think[16], start_wait[16], chat[16], reconnect[16], seed[32], prefix[16];
+    char port[16];
+    
+    *duration = rng_range(rng, 20, 120);
+    snprintf(bots, sizeof(bots), "%d", rng_range(rng, 4, 48));
+    snprintf(threads, sizeof(threads), "%d", rng_range(rng, 1, 4));
+    snprintf(seconds, sizeof(seconds), "%d", *duration);
+    snprintf(think, sizeof(think), "%d", rng_range(rng, 50, 1500));
+    snprintf(start_wait, sizeof(start_wait), "%d", rng_range(rng, 1, 6));
+    snprintf(chat, sizeof(chat), "%d", rng_range(rng, 2, 30));
+    snprintf(reconnect, sizeof(reconnect), "%d", rng_range(rng, 3, 60));
+    snprintf(seed, sizeof(seed), "%u", rng_next(rng));
+    snprintf(prefix, sizeof(prefix), "soak%d", (int)rng_below(rng, SOAK_PREFIXES));
+    snprintf(port, sizeof(port), "%d", config.port);
+    
+    // One wave in four is killed partway through
+    *kill_at_ms = rng_below(rng, 4) == 0 ? time_now_ms() + rng_range(rng, 5, *duration) * 1000LL : 0;
+    
+    const char *argv[32];
+    int argc = 0;
+    argv[argc++] = config.loadgen;
+    argv[argc++] = "-H"; argv[argc++] = config.host;
+    argv[argc++] = "-p"; argv[argc++] = port;
+    argv[argc++] = "-n"; argv[argc++] = bots;
+    argv[argc++] = "-t"; argv[argc++] = threads;
+    argv[argc++] = "-d"; argv[argc++] = seconds;
+    argv[argc++] = "-w"; argv[argc++] = think;
+    argv[argc++] = "-W"; argv[argc++] = start_wait;
+    argv[argc++] = "-c"; argv[argc++] = chat;
+    argv[argc++] = "-r"; argv[argc++] = reconnect;
+    argv[argc++] = "-s"; argv[argc++] = seed;
+    argv[argc++] = "-u"; argv[argc++] = prefix;
+    if (config.use_debug_answer) argv[argc++] = "-a";
+    argv[argc] = NULL;
+    
+    printf("[%7.0f s] wave %d: %s bots (%s) for %s s, think %s ms, reconnect every %s s%s\n", elapsed_s(), wave,
+           bots, prefix, seconds, think, reconnect, *kill_at_ms ? ", killed early" : "");
+    fflush(stdout);
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        soak_fail("fork: %s", strerror(errno));
+    }
+    if (pid == 0) {
+        FILE *log = freopen(config.wave_log, "a", stdout);
+        if (log) dup2(fileno(stdout), STDERR_FILENO);
+        execv(config.loadgen, (char *const *)argv);
+        perror("execv");
+        _exit(127);
+    }
+    return pid;
+}
+
+// Periodic sample: status and invariants
+static void sample(int wave, SoakStatus *last) {
+    SoakStatus status;
+    soak_status(&status);
+    if (last->uptime_s >= 0 && status.uptime_s < last->uptime_s) {
+        soak_fail("server restarted (uptime %lld s, was %lld s)", status.uptime_s, last->uptime_s);
+    }
+    
+    admin_query("check");
+    int violations = (int)status_field(reply, "violations=");
+    if (violations != 0) {
+        soak_fail("%d invariant violation(s):\n%s", violations, reply);
+    }
+    
+    printf("[%7.0f s] clients %3d (%3d disconnected), rooms %2d, games %2d, rss %ld KB, fds %d\n", elapsed_s(),
+           status.clients, status.disconnected, status.rooms, status.games, status.rss_kb, status.fds);
+    fflush(stdout);
+    if (csv) {
+        fprintf(csv, "%.0f,%d,%d,%d,%d,%d,%ld,%d\n", elapsed_s(), wave, status.clients, status.disconnected,
+                status.rooms, status.games, status.rss_kb, status.fds);
+        fflush(csv);
+    }
+    *last = status;
+}
+
+// Idle point: nothing may be left over, and memory and fds must not have grown since the first one
+static void quiet_check(SoakStatus *baseline, int *have_baseline, SoakStatus *idle) {
+    SoakStatus status;
+    soak_status(&status);
+    *idle = status;
+    
+    if (status.clients != 0 || status.rooms != 0) {
+        admin_query("clients");
+        char clients[SOAK_REPLY_MAX];
+        snprintf(clients, sizeof(clients), "%s", reply);
+        admin_query("rooms");
+        soak_fail("%d client slot(s) and %d room(s) still active after %d s idle:\n%s%s", status.clients,
+                  status.rooms, SOAK_QUIET_SECONDS, clients, reply);
+    }
+    
+    if (!*have_baseline) {
+        *baseline = status;
+        *have_baseline = 1;
+        printf("[%7.0f s] idle baseline: rss %ld KB, fds %d\n", elapsed_s(), status.rss_kb, status.fds);
+    } else {
+        printf("[%7.0f s] idle: rss %ld KB (%+ld), fds %d (%+d)\n", elapsed_s(), status.rss_kb,
+               status.rss_kb - baseline->rss_kb, status.fds, status.fds - baseline->fds);
+        if (status.rss_kb - baseline->rss_kb > config.rss_growth_kb) {
+            soak_fail("RSS grew %ld KB since the first idle point (limit %ld KB)", status.rss_kb - baseline->rss_kb,
+                      config.rss_growth_kb);
+        }
+        if (status.fds - baseline->fds > config.fd_growth) {
+            soak_fail("open fds grew from %d to %d at idle (limit +%d)", baseline->fds, status.fds, config.fd_growth);
+        }
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    config.admin_path = ADMIN_SOCKET;
+    config.loadgen = "./loadgen";
+    config.host = "127.0.0.1";
+    config.port = PORT;
+    config.duration = 4 * 3600;
+    config.sample_every = 10;
+    config.quiet_every = 5;
+    config.rss_growth_kb = 16384;
+    config.fd_growth = 2;
+    config.seed = (uint64_t)time(NULL);
+    config.wave_log = "/dev/null";
+    const char *csv_path = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "-a") == 0) { config.use_debug_answer = 1; continue; }
+        if (!value || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            usage(argv[0]);
+            return 2;
+        }
+        switch (argv[i][1]) {
+            case 'A': config.admin_path = value; break;
+            case 'L': config.loadgen = value; break;
+            case 'H': config.host = value; break;
+            case 'p': config.port = atoi(value); break;
+            case 'T': config.duration = atoi(value); break;
+            case 'i': config.sample_every = atoi(value); break;
+            case 'q': config.quiet_every = atoi(value); break;
+            case 'm': config.rss_growth_kb = atol(value); break;
+            case 'f': config.fd_growth = atoi(value); break;
+            case 's': config.seed = strtoull(value, NULL, 10); break;
+            case 'o': csv_path = value; break;
+            case 'l': config.wave_log = value; break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+        i++;
+    }
+    if (config.duration < 1 || config.sample_every < 1 || config.quiet_every < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (access(config.loadgen, X_OK) != 0) {
+        fprintf(stderr, "Cannot run %s (build tools/loadgen.c or pass -L)\n", config.loadgen);
+        return 2;
+    }
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            perror("fopen");
+            return 2;
+        }
+        fprintf(csv, "elapsed_s,wave,clients,disconnected,rooms,games,rss_kb,fds\n");
+    }
+    
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    Rng rng;
+    rng_seed(&rng, config.seed, 0);
+    start_ms = time_now_ms();
+    printf("Soak: %d s against %s:%d, admin %s, idle check every %d waves (seed %llu)\n", config.duration,
+           config.host, config.port, config.admin_path, config.quiet_every, (unsigned long long)config.seed);
+    
+    SoakStatus last = {.uptime_s = -1};
+    SoakStatus baseline = {0};
+    SoakStatus idle = {0};
+    int have_baseline = 0;
+    sample(0, &last);
+    
+    SoakPhase phase = SOAK_GAP;
+    long long phase_end_ms = time_now_ms();
+    long long kill_at_ms = 0;
+    long long next_sample_ms = time_now_ms() + config.sample_every * 1000LL;
+    int wave = 0;
+    int waves_killed = 0;
+    long long end_ms = start_ms + config.duration * 1000LL;
+    
+    while (!stop_requested) {
+        long long now = time_now_ms();
+        
+        if (phase == SOAK_WAVE) {
+            int status;
+            if (kill_at_ms && now >= kill_at_ms) {
+                kill(wave_pid, SIGKILL);
+                kill_at_ms = 0;
+                waves_killed++;
+            }
+            if (waitpid(wave_pid, &status, WNOHANG) == wave_pid) {
+                if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+                    soak_fail("could not run %s", config.loadgen);
+                }
+                wave_pid = -1;
+                if (now >= end_ms || wave % config.quiet_every == 0) {
+                    printf("[%7.0f s] idle for %d s\n", elapsed_s(), SOAK_QUIET_SECONDS);
+                    fflush(stdout);
+                    phase = SOAK_QUIET;
+                    phase_end_ms = now + SOAK_QUIET_SECONDS * 1000LL;
+                } else {
+                    phase = SOAK_GAP;
+                    phase_end_ms = now + rng_range(&rng, 0, 5) * 1000LL;
+                }
+            }
+        } else if (now >= phase_end_ms) {
+            if (phase == SOAK_QUIET) {
+                quiet_check(&baseline, &have_baseline, &idle);
+                if (now >= end_ms) break;
+            } else if (now >= end_ms) {
+                phase = SOAK_QUIET;
+                phase_end_ms = now + SOAK_QUIET_SECONDS * 1000LL;
+                continue;
+            }
+            int duration;
+            wave++;
+            wave_pid = start_wave(&rng, wave, &duration, &kill_at_ms);
+            phase = SOAK_WAVE;
+        }
+        
+        if (now >= next_sample_ms) {
+            sample(wave, &last);
+            next_sample_ms = now + config.sample_every * 1000LL;
+        }
+        usleep(SOAK_TICK_MS * 1000);
+    }
+    
+    if (wave_pid > 0) {
+        kill(wave_pid, SIGKILL);
+        waitpid(wave_pid, NULL, 0);
+    }
+    if (csv) fclose(csv);
+    if (stop_requested) {
+        printf("Soak interrupted after %.0f s, %d waves\n", elapsed_s(), wave);
+        return 2;
+    }
+    
+    printf("\nSOAK PASSED: %.0f s, %d waves (%d killed early), idle rss %ld KB (%+ld), fds %d (%+d)\n", elapsed_s(),
+           wave, waves_killed, idle.rss_kb, idle.rss_kb - baseline.rss_kb, idle.fds, idle.fds - baseline.fds);
+    return 0;
+}
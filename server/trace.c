@@ -0,0 +1,257 @@
+#include "server.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Round lifecycle tracing
+//
+// With TRACE_FILE set, the event loop records spans for every step of a
+// round (READY/START_GAME, room_start_game, puzzle source, GAME_START
+// send, each SUBMIT, room_end_game, the wait for READY_NEXT_ROUND) into an
+// in-memory ring, oldest overwritten. Each game gets a random trace ID
+// when its first round starts, so all rounds of one game share it.
+//
+// The ring is exported as Chrome trace JSON (chrome://tracing, Perfetto):
+// handler and function spans are complete ("X") events on one track per
+// room, so nested calls stack; game, round and continue_wait are async
+// ("b"/"e") spans keyed by the trace ID. Timestamps are monotonic
+// microseconds since trace start. The file is written at shutdown and on
+// SIGUSR1; the SIGUSR1 snapshot is copied on the loop and written by a
+// helper thread.
+//
+// Only the event loop records or exports, so the ring needs no lock.
+
+typedef struct {
+    const char *name;      // Static string
+    const char *arg_name;  // Static string, NULL if the span has no argument
+    uint64_t trace_id;
+    int64_t start_ns;      // Since trace start
+    int64_t duration_ns;
+    int32_t arg;
+    int16_t room_id;
+    uint8_t round;
+    uint8_t async;         // Exported as a b/e pair instead of an X event
+} TraceEvent;
+
+_Static_assert((TRACE_BUFFER_EVENTS & (TRACE_BUFFER_EVENTS - 1)) == 0, "ring index wraps, size must be a power of two");
+
+// Event ring (event loop only)
+static TraceEvent events[TRACE_BUFFER_EVENTS];
+static unsigned long long event_count = 0;  // Events ever recorded (index = count % size)
+static int enabled = 0;
+static long long start_ns = 0;
+static char trace_path[256];
+static Rng id_rng;
+
+// SIGUSR1 snapshot writer
+typedef struct {
+    TraceEvent *events;
+    int count;
+    unsigned long long overwritten;
+} TraceSnapshot;
+
+static pthread_t snapshot_thread;
+static int snapshot_started = 0;
+static atomic_int snapshot_busy = 0;  // Snapshot thread still writing
+
+// Write one event (after the metadata, so always comma-led); async spans become a begin/end pair
+static void trace_write_event(FILE *file, const TraceEvent *event, int pid) {
+    char args[128];
+    int length = snprintf(args, sizeof(args), "{\"trace_id\":\"%016llx\",\"round\":%d",
+                          (unsigned long long)event->trace_id, event->round);
+    if (event->arg_name) {
+        length += snprintf(args + length, sizeof(args) - length, ",\"%s\":%d", event->arg_name, event->arg);
+    }
+    snprintf(args + length, sizeof(args) - length, "}");
+    
+    double ts = event->start_ns / 1000.0;
+    double duration = event->duration_ns / 1000.0;
+    
+    if (event->async) {
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"round\",\"ph\":\"b\",\"id\":\"0x%llx\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":%d,\"args\":%s}",
+                event->name, (unsigned long long)event->trace_id, ts, pid, event->room_id, args);
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"round\",\"ph\":\"e\",\"id\":\"0x%llx\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":%d}",
+                event->name, (unsigned long long)event->trace_id, ts + duration, pid, event->room_id);
+    } else {
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"game\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":%d,\"tid\":%d,\"args\":%s}",
+                event->name, ts, duration, pid, event->room_id, args);
+    }
+}
+
+// Write events (oldest first) as Chrome trace JSON, via a temporary file so readers never see half a trace
+static int trace_write_file(const TraceEvent *ring, int count, unsigned long long overwritten) {
+    char temp_path[sizeof(trace_path) + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", trace_path);
+    
+    FILE *file = fopen(temp_path, "w");
+    if (!file) {
+        perror("fopen");
+        return 0;
+    }
+    
+    int pid = (int)getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"overwritten_events\":\"%llu\"},\"traceEvents\":[", overwritten);
+    fprintf(file, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"game_server\"}}", pid);
+    
+    // Name the track of every room that appears
+    int named[MAX_ROOMS] = {0};
+    for (int i = 0; i < count; i++) {
+        int room_id = ring[i].room_id;
+        if (room_id >= 0 && room_id < MAX_ROOMS && !named[room_id]) {
+            named[room_id] = 1;
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"room %d\"}}",
+                    pid, room_id, room_id);
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        trace_write_event(file, &ring[i], pid);
+    }
+    fprintf(file, "\n]}\n");
+    
+    int ok = fflush(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp_path, trace_path) != 0) {
+        perror("trace write");
+        return 0;
+    }
+    return 1;
+}
+
+// Copy the ring out in recording order (event loop)
+static int trace_copy_events(TraceEvent *out, unsigned long long *overwritten) {
+    unsigned long long count = event_count < TRACE_BUFFER_EVENTS ? event_count : TRACE_BUFFER_EVENTS;
+    unsigned long long first = event_count - count;
+    
+    for (unsigned long long i = 0; i < count; i++) {
+        out[i] = events[(first + i) % TRACE_BUFFER_EVENTS];
+    }
+    *overwritten = first;
+    return (int)count;
+}
+
+// Snapshot thread main: write and free one copied ring
+static void *trace_snapshot_main(void *arg) {
+    TraceSnapshot *snapshot = arg;
+    
+    if (trace_write_file(snapshot->events, snapshot->count, snapshot->overwritten)) {
+        log_write(LOG_INFO, LOG_SERVER, "Trace snapshot: %d events written to %s", snapshot->count, trace_path);
+    }
+    free(snapshot->events);
+    free(snapshot);
+    atomic_store_explicit(&snapshot_busy, 0, memory_order_release);
+    return NULL;
+}
+
+// Start recording spans to export to path (0 = tracing disabled)
+int trace_init(const char *path) {
+    if (strlen(path) >= sizeof(trace_path)) {
+        log_write(LOG_ERROR, LOG_SERVER, "Trace path too long: %s", path);
+        return 0;
+    }
+    
+    strcpy(trace_path, path);
+    start_ns = time_now_ns();
+    rng_seed(&id_rng, (uint64_t)start_ns ^ ((uint64_t)getpid() << 32), 0);
+    event_count = 0;
+    enabled = 1;
+    
+    log_write(LOG_INFO, LOG_SERVER, "Tracing round lifecycle to %s (last %d spans kept)", path, TRACE_BUFFER_EVENTS);
+    return 1;
+}
+
+// Write the final trace (event loop, after the last round ended)
+void trace_shutdown(void) {
+    if (!enabled) return;
+    enabled = 0;
+    
+    if (snapshot_started) {
+        pthread_join(snapshot_thread, NULL);
+        snapshot_started = 0;
+    }
+    
+    TraceEvent *copy = malloc(sizeof(events));
+    if (!copy) {
+        perror("malloc");
+        return;
+    }
+    unsigned long long overwritten;
+    int count = trace_copy_events(copy, &overwritten);
+    if (trace_write_file(copy, count, overwritten)) {
+        log_write(LOG_INFO, LOG_SERVER, "Trace: %d events written to %s (%llu overwritten)", count, trace_path, overwritten);
+    }
+    free(copy);
+}
+
+// Write the current ring from a helper thread (SIGUSR1, skipped while a snapshot is still writing)
+void trace_snapshot(void) {
+    if (!enabled) return;
+    
+    if (atomic_load_explicit(&snapshot_busy, memory_order_acquire)) {
+        log_write(LOG_WARN, LOG_SERVER, "Trace snapshot still writing, skipped");
+        return;
+    }
+    if (snapshot_started) {
+        pthread_join(snapshot_thread, NULL);
+        snapshot_started = 0;
+    }
+    
+    TraceSnapshot *snapshot = malloc(sizeof(TraceSnapshot));
+    TraceEvent *copy = malloc(sizeof(events));
+    if (!snapshot || !copy) {
+        perror("malloc");
+        free(snapshot);
+        free(copy);
+        return;
+    }
+    snapshot->events = copy;
+    snapshot->count = trace_copy_events(copy, &snapshot->overwritten);
+    
+    atomic_store_explicit(&snapshot_busy, 1, memory_order_relaxed);
+    if (pthread_create(&snapshot_thread, NULL, trace_snapshot_main, snapshot) != 0) {
+        perror("pthread_create");
+        atomic_store_explicit(&snapshot_busy, 0, memory_order_relaxed);
+        free(copy);
+        free(snapshot);
+        return;
+    }
+    snapshot_started = 1;
+}
+
+// New trace ID for a game whose first round starts at start (monotonic ns)
+void trace_begin_game(Room *room, long long start) {
+    if (!enabled) return;
+    
+    room->trace_id = ((uint64_t)rng_next(&id_rng) << 32) | rng_next(&id_rng);
+    room->trace_game_ns = start;
+}
+
+static void trace_record(const Room *room, const char *name, long long start, int async,
+                         const char *arg_name, int arg) {
+    TraceEvent *event = &events[event_count % TRACE_BUFFER_EVENTS];
+    event->name = name;
+    event->arg_name = arg_name;
+    event->trace_id = room->trace_id;
+    event->start_ns = start - start_ns;
+    event->duration_ns = time_now_ns() - start;
+    event->arg = arg;
+    event->room_id = (int16_t)room->id;
+    event->round = (uint8_t)room->current_round;
+    event->async = (uint8_t)async;
+    event_count++;
+}
+
+// Record a span of room's current round from start (monotonic ns) to now,
+// with an optional named integer argument
+void trace_span(const Room *room, const char *name, long long start, const char *arg_name, int arg) {
+    if (!enabled) return;
+    trace_record(room, name, start, 0, arg_name, arg);
+}
+
+// Record an async span (game, round, continue_wait) from start to now
+void trace_async(const Room *room, const char *name, long long start) {
+    if (!enabled) return;
+    trace_record(room, name, start, 1, NULL, 0);
+}
@@ -0,0 +1,175 @@
+#include "server.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Event loop watchdog
+//
+// server_run() brackets every select() wakeup with watchdog_begin_iteration()
+// and watchdog_end_iteration() and names the phase it is in as it goes (I/O
+// dispatch, timers, broadcasts, housekeeping); handle_message() names the
+// command it is running. The loop itself accumulates per-phase time, records
+// iteration and phase durations as latency series, and when an iteration
+// goes over budget logs a stall report with the breakdown and the slowest
+// command.
+//
+// That report only appears once the loop is free again, so a watchdog thread
+// also polls the published state and reports an iteration that is still
+// running past its budget, with the phase and command it is stuck in. Every
+// room's TIMER and every PING waits on that iteration, so this is the line
+// to look for when players report freezes.
+//
+// Budget: STALL_BUDGET_MS, override with STALL_BUDGET_MS env (0 disables the
+// reports, iteration timing keeps running).
+
+static const char *phase_names[LOOP_PHASE_COUNT] = {"wait", "io", "timers", "broadcasts", "housekeeping"};
+
+// Published by the event loop, read by the watchdog thread
+static atomic_llong iteration_start_ns = 0;  // 0 while waiting in select()
+static atomic_ullong iteration = 0;
+static atomic_int current_phase = LOOP_PHASE_WAIT;
+static atomic_int current_command = -1;  // MetricCommand being handled, -1 if none
+static atomic_int current_client = -1;
+
+// Event loop only
+static long long budget_ns = (long long)STALL_BUDGET_MS * 1000000;
+static long long phase_start_ns = 0;
+static long long phase_ns[LOOP_PHASE_COUNT];
+static int slowest_command = -1;
+static int slowest_client = -1;
+static long long slowest_command_ns = 0;
+
+static pthread_t watchdog_thread;
+static atomic_int running = 0;
+
+// Close the current phase's time slice at now
+static void watchdog_close_phase(long long now) {
+    int phase = atomic_load_explicit(&current_phase, memory_order_relaxed);
+    phase_ns[phase] += now - phase_start_ns;
+    phase_start_ns = now;
+}
+
+// select() returned: start timing an iteration in the I/O phase
+void watchdog_begin_iteration(void) {
+    long long now = time_now_ns();
+    
+    memset(phase_ns, 0, sizeof(phase_ns));
+    phase_start_ns = now;
+    slowest_command = -1;
+    slowest_client = -1;
+    slowest_command_ns = 0;
+    
+    atomic_fetch_add_explicit(&iteration, 1, memory_order_relaxed);
+    atomic_store_explicit(&current_phase, LOOP_PHASE_IO, memory_order_relaxed);
+    atomic_store_explicit(&iteration_start_ns, now, memory_order_release);
+}
+
+void watchdog_enter_phase(LoopPhase phase) {
+    watchdog_close_phase(time_now_ns());
+    atomic_store_explicit(&current_phase, phase, memory_order_relaxed);
+}
+
+void watchdog_command_begin(MetricCommand command, int client_idx) {
+    atomic_store_explicit(&current_client, client_idx, memory_order_relaxed);
+    atomic_store_explicit(&current_command, command, memory_order_relaxed);
+}
+
+void watchdog_command_end(long long elapsed_ns) {
+    int command = atomic_load_explicit(&current_command, memory_order_relaxed);
+    
+    if (elapsed_ns > slowest_command_ns) {
+        slowest_command_ns = elapsed_ns;
+        slowest_command = command;
+        slowest_client = atomic_load_explicit(&current_client, memory_order_relaxed);
+    }
+    atomic_store_explicit(&current_command, -1, memory_order_relaxed);
+    atomic_store_explicit(&current_client, -1, memory_order_relaxed);
+}
+
+// Back to select(): record the iteration and report it if it ran over budget
+void watchdog_end_iteration(void) {
+    long long now = time_now_ns();
+    long long start = atomic_load_explicit(&iteration_start_ns, memory_order_relaxed);
+    long long elapsed = now - start;
+    
+    watchdog_close_phase(now);
+    atomic_store_explicit(&current_phase, LOOP_PHASE_WAIT, memory_order_relaxed);
+    atomic_store_explicit(&iteration_start_ns, 0, memory_order_release);
+    
+    metrics_record_latency(METRIC_LATENCY_LOOP_ITERATION, elapsed);
+    for (int p = LOOP_PHASE_IO; p < LOOP_PHASE_COUNT; p++) {
+        if (phase_ns[p] > 0) {
+            metrics_record_latency((MetricLatency)(METRIC_LATENCY_PHASE_IO + p - LOOP_PHASE_IO), phase_ns[p]);
+        }
+    }
+    
+    if (budget_ns <= 0 || elapsed <= budget_ns) return;
+    
+    metrics_count(METRIC_LOOP_STALLS, 1);
+    log_write(LOG_WARN, LOG_SERVER,
+              "stall iteration=%llu elapsed_ms=%.1f budget_ms=%lld io_ms=%.1f timers_ms=%.1f broadcasts_ms=%.1f "
+              "housekeeping_ms=%.1f slowest_command=%s client=%d command_ms=%.1f",
+              (unsigned long long)atomic_load_explicit(&iteration, memory_order_relaxed), elapsed / 1e6,
+              budget_ns / 1000000, phase_ns[LOOP_PHASE_IO] / 1e6, phase_ns[LOOP_PHASE_TIMERS] / 1e6,
+              phase_ns[LOOP_PHASE_BROADCASTS] / 1e6, phase_ns[LOOP_PHASE_HOUSEKEEPING] / 1e6,
+              slowest_command >= 0 ? metrics_command_name((MetricCommand)slowest_command) : "none",
+              slowest_client, slowest_command_ns / 1e6);
+}
+
+// Report an iteration that is still running past its budget (once per iteration)
+static void *watchdog_main(void *arg) {
+    (void)arg;
+    unsigned long long reported = 0;
+    long long interval_ns = budget_ns / 4;
+    if (interval_ns < 5000000) interval_ns = 5000000;
+    if (interval_ns > 50000000) interval_ns = 50000000;
+    struct timespec interval = {0, interval_ns};
+    
+    while (atomic_load(&running)) {
+        nanosleep(&interval, NULL);
+        
+        long long start = atomic_load_explicit(&iteration_start_ns, memory_order_acquire);
+        unsigned long long current = atomic_load_explicit(&iteration, memory_order_relaxed);
+        if (start == 0 || current == reported) continue;
+        
+        long long elapsed = time_now_ns() - start;
+        if (elapsed <= budget_ns) continue;
+        
+        int phase = atomic_load_explicit(&current_phase, memory_order_relaxed);
+        int command = atomic_load_explicit(&current_command, memory_order_relaxed);
+        int client = atomic_load_explicit(&current_client, memory_order_relaxed);
+        reported = current;
+        log_write(LOG_WARN, LOG_SERVER,
+                  "stall in progress iteration=%llu elapsed_ms=%.1f budget_ms=%lld phase=%s command=%s client=%d",
+                  current, elapsed / 1e6, budget_ns / 1000000, phase_names[phase],
+                  command >= 0 ? metrics_command_name((MetricCommand)command) : "none", client);
+    }
+    return NULL;
+}
+
+// Start the watchdog thread, returns 0 if reports are disabled or it can't start
+// (iteration timing keeps running either way)
+int watchdog_init(void) {
+    const char *override = getenv("STALL_BUDGET_MS");
+    if (override) budget_ns = atoll(override) * 1000000;
+    if (budget_ns <= 0) {
+        log_write(LOG_INFO, LOG_SERVER, "Stall watchdog: off");
+        return 0;
+    }
+    
+    atomic_store(&running, 1);
+    if (pthread_create(&watchdog_thread, NULL, watchdog_main, NULL) != 0) {
+        perror("pthread_create");
+        atomic_store(&running, 0);
+        return 0;
+    }
+    
+    log_write(LOG_INFO, LOG_SERVER, "Stall watchdog: %lld ms budget per loop iteration", budget_ns / 1000000);
+    return 1;
+}
+
+void watchdog_shutdown(void) {
+    if (!atomic_load(&running)) return;
+    
+    atomic_store(&running, 0);
+    pthread_join(watchdog_thread, NULL);
+}